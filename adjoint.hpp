@@ -0,0 +1,309 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file adjoint.hpp
+
+   \brief Adjoint sensitivity analysis with a checkpointed forward solve.
+
+   For an objective G = g(y(t1)) the gradients to the initial values and
+   the parameters follow from the adjoint system
+   \f[ \lambda' = -J^T \lambda, \quad \lambda(t_1) = \nabla g(y(t_1)), \f]
+   \f[ \mu' = -(\partial f / \partial p)^T \lambda, \quad \mu(t_1) = 0, \f]
+   as dG/dy0 = lambda(t0) and dG/dp = mu(t0). The cost is independent
+   of the number of parameters.
+
+   The backward solve needs y(t). Instead of storing the whole forward
+   trajectory, only the states at a number of checkpoints are kept. The
+   forward solution between two checkpoints is recomputed right before
+   the adjoint is integrated over that segment. This is the two-level
+   variant of binomial checkpointing: memory is n_checkpoints states plus
+   one segment of the trajectory, at the cost of one extra forward solve.
+*/
+
+#ifndef ADJOINT_HPP
+#define ADJOINT_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "irk.hpp"
+#include "sensitivity.hpp"
+
+
+namespace irk {
+
+
+/**
+   \brief Options for the adjoint solver.
+*/
+struct adjoint_options
+{
+	adjoint_options() : n_checkpoints(10), n_params(0) {}
+
+	/// Number of segments the forward solve is split in. More
+	/// checkpoints means less memory for the recomputed segments.
+	std::size_t n_checkpoints;
+
+	/// Number of parameters, i.e., the number of columns of func.dfdp.
+	/// If 0, only the gradient to the initial values is computed.
+	std::size_t n_params;
+
+	/// If not empty, use these times as checkpoints instead of an
+	/// equidistant split. Should be increasing and within (t0, t1).
+	std::vector<double> checkpoint_times;
+};
+
+
+/**
+   \brief Result of an adjoint solve.
+*/
+struct adjoint_output
+{
+	adjoint_output() : status(SUCCESS), objective(0.0),
+	                   forward_steps(0), recomputed_steps(0),
+	                   backward_steps(0), max_stored_states(0) {}
+
+	int status;          ///< See \ref odeint_status_codes
+	double objective;    ///< g(y(t1))
+	vec_type y1;         ///< The forward solution at t1
+	vec_type grad_y0;    ///< dG/dy0
+	vec_type grad_p;     ///< dG/dp
+
+	std::size_t forward_steps;     ///< Accepted steps of the forward pass
+	std::size_t recomputed_steps;  ///< Steps spent recomputing segments
+	std::size_t backward_steps;    ///< Accepted steps of the adjoint solve
+
+	/// Largest number of states held in memory at once.
+	std::size_t max_stored_states;
+};
+
+
+/**
+   \brief Dense representation of the forward solution on one segment,
+   interpolated with cubic Hermite polynomials.
+*/
+struct segment_trajectory
+{
+	std::vector<double> t_vals;
+	trajectory y_vals;
+	trajectory f_vals;
+
+	/// Evaluates the forward solution at time t.
+	vec_type operator()(double t) const
+	{
+		std::size_t Nt = t_vals.size();
+		assert(Nt > 0 && "Empty segment!");
+		if (t <= t_vals[0]) return y_vals[0];
+		if (t >= t_vals[Nt-1]) return y_vals[Nt-1];
+
+		auto it = std::upper_bound(t_vals.begin(), t_vals.end(), t);
+		std::size_t i = (it - t_vals.begin()) - 1;
+
+		double h = t_vals[i+1] - t_vals[i];
+		double s = (t - t_vals[i]) / h;
+		double s2 = s*s, s3 = s2*s;
+		double h00 =  2*s3 - 3*s2 + 1;
+		double h10 =    s3 - 2*s2 + s;
+		double h01 = -2*s3 + 3*s2;
+		double h11 =    s3 - s2;
+		return h00*y_vals[i] + h10*h*f_vals[i]
+			+ h01*y_vals[i+1] + h11*h*f_vals[i+1];
+	}
+};
+
+
+/**
+   \brief The adjoint ODE in reversed time s = t_end - t, for z = (lambda, mu).
+*/
+template <typename functor_type>
+struct adjoint_functor
+{
+	typedef mat_type jac_type;
+
+	adjoint_functor(functor_type &func, const segment_trajectory &traj,
+	                double t_end, std::size_t Neq, std::size_t n_params)
+		: func(func), traj(traj), t_end(t_end), Neq(Neq), P(n_params)
+	{ }
+
+	vec_type fun(double s, const vec_type &z)
+	{
+		double t = t_end - s;
+		vec_type y = traj(t);
+		mat_type J = func.jac(t, y);
+		vec_type lambda = z.head(Neq);
+
+		vec_type dz(Neq + P);
+		dz.head(Neq) = J.t()*lambda;
+		if (P > 0) {
+			mat_type fp = arma::zeros(Neq, P);
+			add_dfdp(func, t, y, fp, 0);
+			dz.tail(P) = fp.t()*lambda;
+		}
+		return dz;
+	}
+
+	jac_type jac(double s, const vec_type &z)
+	{
+		double t = t_end - s;
+		vec_type y = traj(t);
+		jac_type Jz = arma::zeros(Neq + P, Neq + P);
+		Jz.submat(0, 0, Neq-1, Neq-1) = func.jac(t, y).t();
+		if (P > 0) {
+			mat_type fp = arma::zeros(Neq, P);
+			add_dfdp(func, t, y, fp, 0);
+			Jz.submat(Neq, 0, Neq+P-1, Neq-1) = fp.t();
+		}
+		return Jz;
+	}
+
+	functor_type &func;
+	const segment_trajectory &traj;
+	double t_end;
+	std::size_t Neq, P;
+};
+
+
+/**
+   \brief Computes the gradient of g(y(t1)) to y0 and the parameters with
+   the adjoint method.
+
+   \param func         Functor of the ODE. Should provide dfdp(t, y) if
+                       adj_opts.n_params > 0.
+   \param t0           Starting time
+   \param t1           Final time
+   \param y0           Initial values
+   \param solver_opts  Options for both the forward and the adjoint solve.
+   \param adj_opts     Options for the adjoint (see \ref adjoint_options).
+   \param objective    Functor with members double value(const vec_type &y)
+                       and vec_type grad(const vec_type &y) for g.
+   \param method       The IRK method to use.
+   \param dt           Initial time step size.
+
+   \returns an adjoint_output with the objective value and the gradients.
+*/
+template <typename functor_type, typename objective_type> inline
+adjoint_output adjoint_gradient(functor_type &func, double t0, double t1,
+                                const vec_type &y0,
+                                solver_options solver_opts,
+                                const adjoint_options &adj_opts,
+                                objective_type &objective,
+                                int method = irk::RADAU_IIA_53,
+                                double dt = 1e-6)
+{
+	adjoint_output out;
+	const std::size_t Neq = y0.size();
+	const std::size_t P   = adj_opts.n_params;
+	solver_opts.sens_opts = nullptr;
+
+	// Segment boundaries:
+	std::vector<double> t_ck;
+	t_ck.push_back(t0);
+	if (!adj_opts.checkpoint_times.empty()) {
+		for (double tc : adj_opts.checkpoint_times) {
+			if (tc > t_ck.back() && tc < t1) t_ck.push_back(tc);
+		}
+	} else {
+		std::size_t n_split = std::max<std::size_t>(1, adj_opts.n_checkpoints);
+		for (std::size_t k = 1; k < n_split; ++k) {
+			t_ck.push_back(t0 + (t1 - t0)*k / n_split);
+		}
+	}
+	t_ck.push_back(t1);
+	std::size_t n_seg = t_ck.size() - 1;
+
+	output_options output_opts;
+
+	// Forward pass, keeping only the checkpoint states and step sizes.
+	// The step size is stored so that the recomputation reproduces
+	// exactly the same steps.
+	std::vector<vec_type> y_ck(n_seg + 1);
+	std::vector<double> dt_ck(n_seg + 1);
+	y_ck[0] = y0;
+	dt_ck[0] = dt;
+	for (std::size_t k = 0; k < n_seg; ++k) {
+		rk_output seg = odeint(func, t_ck[k], t_ck[k+1], y_ck[k],
+		                       solver_opts, output_opts, method, dt_ck[k]);
+		if (seg.status != SUCCESS) {
+			out.status = seg.status;
+			return out;
+		}
+		std::size_t Nt = seg.t_vals.size();
+		y_ck[k+1] = seg.y_vals[Nt-1];
+		dt_ck[k+1] = Nt > 1 ? seg.t_vals[Nt-1] - seg.t_vals[Nt-2] : dt_ck[k];
+		out.forward_steps += Nt - 1;
+		out.max_stored_states = std::max(out.max_stored_states,
+		                                 n_seg + 1 + Nt);
+	}
+
+	out.y1 = y_ck[n_seg];
+	out.objective = objective.value(out.y1);
+
+	// Backward pass over the segments, last one first:
+	vec_type z = arma::zeros(Neq + P);
+	z.head(Neq) = objective.grad(out.y1);
+
+	for (std::size_t kk = n_seg; kk-- > 0; ) {
+		rk_output seg = odeint(func, t_ck[kk], t_ck[kk+1], y_ck[kk],
+		                       solver_opts, output_opts, method, dt_ck[kk]);
+		if (seg.status != SUCCESS) {
+			out.status = seg.status;
+			return out;
+		}
+		std::size_t Nt = seg.t_vals.size();
+		out.recomputed_steps += Nt - 1;
+
+		segment_trajectory traj;
+		traj.t_vals = std::move(seg.t_vals);
+		traj.y_vals = std::move(seg.y_vals);
+		for (std::size_t i = 0; i < Nt; ++i) {
+			traj.f_vals.push_back(func.fun(traj.t_vals[i], traj.y_vals[i]));
+		}
+
+		double t_end = t_ck[kk+1];
+		double seg_len = t_end - t_ck[kk];
+		adjoint_functor<functor_type> adj(func, traj, t_end, Neq, P);
+		double dt_adj = std::min(dt_ck[kk+1], seg_len);
+		rk_output adj_sol = odeint(adj, 0.0, seg_len, z, solver_opts,
+		                           output_opts, method, dt_adj);
+		if (adj_sol.status != SUCCESS) {
+			out.status = adj_sol.status;
+			return out;
+		}
+		std::size_t Na = adj_sol.t_vals.size();
+		z = adj_sol.y_vals[Na-1];
+		out.backward_steps += Na - 1;
+		out.max_stored_states = std::max(out.max_stored_states,
+		                                 n_seg + 1 + Nt + Na);
+	}
+
+	out.grad_y0 = z.head(Neq);
+	if (P > 0) {
+		out.grad_p = z.tail(P);
+	}
+	return out;
+}
+
+
+} // namespace irk
+
+
+#endif // ADJOINT_HPP
@@ -0,0 +1,353 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file alloc_stats.hpp
+
+   \brief Optional heap allocation accounting.
+
+   If REHUEL_COUNT_ALLOCATIONS is defined (before any Rehuel header),
+   arma_include.hpp routes all Armadillo allocations through the counting
+   functions below, and the integrators report in their output how many
+   allocations the setup, the stepping and the output storage did.
+   Without it, all counters stay at zero and nothing is tracked. The
+   macro changes how memory is allocated and freed, so it has to be the
+   same for every translation unit, including the library sources.
+
+   Allocations outside Armadillo (std::vector and the like) are only
+   counted if exactly one translation unit of the program expands
+   REHUEL_DEFINE_COUNTING_NEW at namespace scope, which replaces the
+   global operator new and delete. This is meant for test and benchmark
+   builds only.
+
+   Counters are per thread, so solves on different threads do not
+   disturb each other's numbers.
+*/
+
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <vector>
+
+
+/**
+   \brief Allocation counters, either running totals or differences.
+*/
+struct alloc_counters
+{
+	alloc_counters() : allocs(0), frees(0), bytes(0), live_bytes(0),
+	                   peak_live_bytes(0) {}
+
+	std::size_t allocs;          ///< Number of allocations
+	std::size_t frees;           ///< Number of deallocations
+	std::size_t bytes;           ///< Total bytes allocated
+	long long int live_bytes;    ///< Bytes allocated but not yet freed
+	long long int peak_live_bytes; ///< Maximum of live_bytes
+
+	/// Adds the counts of a phase (the peak is the maximum of both).
+	alloc_counters &operator+=(const alloc_counters &o)
+	{
+		allocs += o.allocs;
+		frees  += o.frees;
+		bytes  += o.bytes;
+		live_bytes += o.live_bytes;
+		if (o.peak_live_bytes > peak_live_bytes) {
+			peak_live_bytes = o.peak_live_bytes;
+		}
+		return *this;
+	}
+
+	/// Difference of two running totals (peak is taken from *this).
+	alloc_counters operator-(const alloc_counters &o) const
+	{
+		alloc_counters d;
+		d.allocs = allocs - o.allocs;
+		d.frees  = frees - o.frees;
+		d.bytes  = bytes - o.bytes;
+		d.live_bytes = live_bytes - o.live_bytes;
+		d.peak_live_bytes = peak_live_bytes;
+		return d;
+	}
+};
+
+
+/**
+   \brief Allocation statistics of one solve.
+*/
+struct alloc_report
+{
+	alloc_report() : max_step_allocs(0), trajectory_bytes(0),
+	                 peak_trajectory_bytes(0) {}
+
+	alloc_counters setup;   ///< Before the first step
+	alloc_counters step;    ///< All steps, excluding output storage
+	alloc_counters output;  ///< Storing the solution
+
+	/// Largest number of allocations in a single step.
+	std::size_t max_step_allocs;
+
+	/// Memory held by the stored trajectory at the end of the solve.
+	std::size_t trajectory_bytes;
+
+	/// Largest memory held by the stored trajectory during the solve,
+	/// including the moments where growing storage holds both the old
+	/// and the new buffer. Only tracked if enabled, otherwise it is
+	/// equal to trajectory_bytes.
+	std::size_t peak_trajectory_bytes;
+
+	/// Sets the memory held by the trajectory now.
+	void set_trajectory_bytes(std::size_t b)
+	{
+		trajectory_bytes = b;
+		if (b > peak_trajectory_bytes) peak_trajectory_bytes = b;
+	}
+
+	/// Adds the phases of o. Leaves trajectory_bytes to the caller,
+	/// as merged storage is not simply the sum of both.
+	void merge(const alloc_report &o)
+	{
+		setup  += o.setup;
+		step   += o.step;
+		output += o.output;
+		if (o.max_step_allocs > max_step_allocs) {
+			max_step_allocs = o.max_step_allocs;
+		}
+		if (o.peak_trajectory_bytes > peak_trajectory_bytes) {
+			peak_trajectory_bytes = o.peak_trajectory_bytes;
+		}
+	}
+};
+
+
+namespace alloc_tracking {
+
+#ifdef REHUEL_COUNT_ALLOCATIONS
+static constexpr const bool enabled = true;
+#else
+static constexpr const bool enabled = false;
+#endif
+
+/// The running totals of the calling thread.
+inline alloc_counters &counters()
+{
+	static thread_local alloc_counters c;
+	return c;
+}
+
+/// Returns a copy of the running totals (zeros if not enabled).
+inline alloc_counters snapshot()
+{
+	return enabled ? counters() : alloc_counters();
+}
+
+/// Extra space in front of each block to remember its size. Keeps the
+/// 16-byte alignment that malloc provides.
+static constexpr const std::size_t header_size = 16;
+
+inline void *counted_malloc(std::size_t n)
+{
+	char *p = static_cast<char*>(std::malloc(n + header_size));
+	if (!p) return nullptr;
+	*reinterpret_cast<std::size_t*>(p) = n;
+
+	alloc_counters &c = counters();
+	++c.allocs;
+	c.bytes += n;
+	c.live_bytes += n;
+	if (c.live_bytes > c.peak_live_bytes) c.peak_live_bytes = c.live_bytes;
+	return p + header_size;
+}
+
+inline void counted_free(void *ptr)
+{
+	if (!ptr) return;
+	char *p = static_cast<char*>(ptr) - header_size;
+	std::size_t n = *reinterpret_cast<std::size_t*>(p);
+
+	alloc_counters &c = counters();
+	++c.frees;
+	c.live_bytes -= n;
+	std::free(p);
+}
+
+
+
+/**
+   \brief Attributes the allocations of a solve to its phases.
+
+   All members do nothing unless REHUEL_COUNT_ALLOCATIONS is defined.
+*/
+class phase_tracker
+{
+public:
+	phase_tracker() : in_step(false), out_allocs_at_step(0),
+	                  saved_peak(0), peak_output_bytes(0)
+	{
+		if (enabled) start = counters();
+	}
+
+	/// Call right before the step loop.
+	void end_setup()
+	{
+		if (!enabled) return;
+		setup_end = counters();
+		report.setup = setup_end - start;
+	}
+
+	/// Call at the start of every attempted step.
+	void begin_step()
+	{
+		if (!enabled) return;
+		close_step();
+		step_start = counters();
+		out_allocs_at_step = report.output.allocs;
+		in_step = true;
+	}
+
+	/// Call around storing output, which is excluded from the steps.
+	void begin_output()
+	{
+		if (!enabled) return;
+		// Restart the peak, so it only sees this output phase:
+		alloc_counters &c = counters();
+		saved_peak = c.peak_live_bytes;
+		c.peak_live_bytes = c.live_bytes;
+		out_start = c;
+	}
+
+	void end_output()
+	{
+		if (!enabled) return;
+		alloc_counters &c = counters();
+		long long peak = report.output.live_bytes
+			+ (c.peak_live_bytes - out_start.live_bytes);
+		if (peak > peak_output_bytes) peak_output_bytes = peak;
+		report.output += c - out_start;
+		if (saved_peak > c.peak_live_bytes) c.peak_live_bytes = saved_peak;
+	}
+
+	/// Call after the step loop. Returns the full report.
+	alloc_report finish(std::size_t trajectory_bytes)
+	{
+		report.set_trajectory_bytes(trajectory_bytes);
+		if (enabled) {
+			close_step();
+			report.step = (counters() - setup_end) - report.output;
+
+			// The output phases account for the growth of the
+			// trajectory from its size after the setup:
+			long long peak = static_cast<long long>(trajectory_bytes)
+				- report.output.live_bytes + peak_output_bytes;
+			if (peak > static_cast<long long>(
+				    report.peak_trajectory_bytes)) {
+				report.peak_trajectory_bytes = peak;
+			}
+		}
+		return report;
+	}
+
+private:
+	void close_step()
+	{
+		if (!in_step) return;
+		std::size_t n = counters().allocs - step_start.allocs;
+		n -= report.output.allocs - out_allocs_at_step;
+		if (n > report.max_step_allocs) report.max_step_allocs = n;
+		in_step = false;
+	}
+
+	alloc_counters start, setup_end, step_start, out_start;
+	alloc_report report;
+	bool in_step;
+	std::size_t out_allocs_at_step;
+	long long saved_peak;         ///< Peak before the output phase
+	long long peak_output_bytes;  ///< Peak growth due to output
+};
+
+
+/// Heap memory held by a vector of doubles.
+inline std::size_t heap_bytes(const std::vector<double> &v)
+{
+	return v.capacity()*sizeof(double);
+}
+
+/// False if x has no elements or keeps them in its own small buffer,
+/// as Armadillo does for up to 16 elements.
+template <typename arma_type> inline
+bool elems_on_heap(const arma_type &x)
+{
+	std::less<const char*> before;
+	const char *p = reinterpret_cast<const char*>(x.memptr());
+	const char *o = reinterpret_cast<const char*>(&x);
+	return x.n_elem > 0 && (before(p, o) || !before(p, o + sizeof(x)));
+}
+
+/// Heap memory held by a vector of Armadillo objects.
+template <typename arma_type> inline
+std::size_t heap_bytes(const std::vector<arma_type> &v)
+{
+	std::size_t b = v.capacity()*sizeof(arma_type);
+	for (const arma_type &x : v) {
+		if (elems_on_heap(x)) {
+			b += x.n_elem*sizeof(typename arma_type::elem_type);
+		}
+	}
+	return b;
+}
+
+} // namespace alloc_tracking
+
+
+/// Replaces the global operator new and delete with counting versions.
+/// Expand in exactly one translation unit, at namespace scope.
+#define REHUEL_DEFINE_COUNTING_NEW                                      \
+	void *operator new(std::size_t n)                               \
+	{                                                               \
+		void *p = alloc_tracking::counted_malloc(n);            \
+		if (!p) throw std::bad_alloc();                         \
+		return p;                                               \
+	}                                                               \
+	void *operator new[](std::size_t n)                             \
+	{                                                               \
+		return operator new(n);                                 \
+	}                                                               \
+	void operator delete(void *p) noexcept                          \
+	{                                                               \
+		alloc_tracking::counted_free(p);                        \
+	}                                                               \
+	void operator delete[](void *p) noexcept                        \
+	{                                                               \
+		alloc_tracking::counted_free(p);                        \
+	}                                                               \
+	void operator delete(void *p, std::size_t) noexcept             \
+	{                                                               \
+		alloc_tracking::counted_free(p);                        \
+	}                                                               \
+	void operator delete[](void *p, std::size_t) noexcept           \
+	{                                                               \
+		alloc_tracking::counted_free(p);                        \
+	}
+
+
+#endif // ALLOC_STATS_HPP
@@ -33,6 +33,13 @@
 #define ARMA_USE_OPENBLAS
 #define ARMA_USE_SUPERLU
 
+// Route Armadillo's allocations through the counters in alloc_stats.hpp:
+#ifdef REHUEL_COUNT_ALLOCATIONS
+#include "alloc_stats.hpp"
+#define ARMA_ALIEN_MEM_ALLOC_FUNCTION alloc_tracking::counted_malloc
+#define ARMA_ALIEN_MEM_FREE_FUNCTION  alloc_tracking::counted_free
+#endif
+
 #include <armadillo>
 
 
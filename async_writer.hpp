@@ -0,0 +1,333 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file async_writer.hpp
+
+   \brief Writes solver output on a background thread.
+
+   The integrator copies each output record (t, y) into a single-producer,
+   single-consumer ring buffer and continues stepping. A writer thread
+   takes the records out, formats them and writes them to the stream in
+   large blocks. The ring buffer is lock-free: the producer only writes
+   the tail index and the consumer only the head index.
+
+   If the ring buffer is full, the producer either waits for the writer
+   to catch up or drops the record, see async_writer_options.
+*/
+
+#ifndef ASYNC_WRITER_HPP
+#define ASYNC_WRITER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "arma_include.hpp"
+#include "options.hpp"
+
+
+/**
+   \brief Options for the asynchronous writer.
+*/
+struct async_writer_options
+{
+	/// \brief Output formats
+	enum formats {
+		TEXT = 0,   ///< Same as the synchronous output: "t y0 y1 ...\n"
+		BINARY = 1  ///< Raw native doubles t, y0, y1, ... per record
+	};
+
+	/// \brief What to do if the ring buffer is full
+	enum backpressure_policies {
+		BLOCK = 0,  ///< Wait for the writer (never loses records)
+		DROP = 1    ///< Drop the new record and count it
+	};
+
+	async_writer_options() : capacity(4096), format(TEXT),
+	                         backpressure(BLOCK), block_bytes(1 << 16),
+	                         idle_sleep_us(100) {}
+
+	std::size_t capacity;    ///< Records the ring buffer holds
+	int format;              ///< See formats
+	int backpressure;        ///< See backpressure_policies
+	std::size_t block_bytes; ///< Bytes collected before each write
+	unsigned idle_sleep_us;  ///< Writer sleep time when there is no work
+};
+
+
+/**
+   \brief Lock-free ring buffer of fixed-width records of doubles for one
+   producer and one consumer thread.
+*/
+class spsc_record_ring
+{
+public:
+	spsc_record_ring( std::size_t capacity, std::size_t width )
+		: capacity_(capacity > 0 ? capacity : 1), width_(width),
+		  data_(capacity_*width), head_(0), tail_(0)
+	{ }
+
+	std::size_t width() const { return width_; }
+	std::size_t capacity() const { return capacity_; }
+
+	/// Producer: copies a record in. Returns false if full.
+	bool try_push( double t, const double *y )
+	{
+		std::size_t tail = tail_.load(std::memory_order_relaxed);
+		std::size_t head = head_.load(std::memory_order_acquire);
+		if (tail - head == capacity_) return false;
+
+		double *slot = &data_[(tail % capacity_)*width_];
+		slot[0] = t;
+		if (width_ > 1) {
+			std::memcpy(slot + 1, y, (width_ - 1)*sizeof(double));
+		}
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Consumer: copies the oldest record out. Returns false if empty.
+	bool try_pop( double *rec )
+	{
+		std::size_t head = head_.load(std::memory_order_relaxed);
+		std::size_t tail = tail_.load(std::memory_order_acquire);
+		if (head == tail) return false;
+
+		std::memcpy(rec, &data_[(head % capacity_)*width_],
+		            width_*sizeof(double));
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Number of records in the buffer (approximate while in use).
+	std::size_t size() const
+	{
+		return tail_.load(std::memory_order_acquire)
+			- head_.load(std::memory_order_acquire);
+	}
+
+private:
+	const std::size_t capacity_, width_;
+	std::vector<double> data_;
+
+	// Padded apart, as each is written by another thread. (alignas
+	// would need over-aligned new, which C++11 does not have.)
+	std::atomic<std::size_t> head_;
+	char pad_[64];
+	std::atomic<std::size_t> tail_;
+};
+
+
+/**
+   \brief Formats and writes records on a background thread.
+
+   The stream is only touched by the writer thread until finish() has
+   returned. Text output copies the formatting flags of the stream at
+   construction, so it matches what the synchronous output would write.
+*/
+class async_writer
+{
+public:
+	async_writer( std::ostream &out, std::size_t n_values,
+	              const async_writer_options &opts = async_writer_options() )
+		: out_(out), opts_(opts), ring_(opts.capacity, n_values + 1),
+		  done_(false), finished_(false), pushed_(0), dropped_(0),
+		  written_(0)
+	{
+		fmt_.copyfmt(out);
+		worker_ = std::thread(&async_writer::run, this);
+	}
+
+	~async_writer()
+	{
+		finish();
+	}
+
+	async_writer( const async_writer & ) = delete;
+	async_writer &operator=( const async_writer & ) = delete;
+
+	/**
+	   \brief Queues the record (t, y[0], ..., y[n_values-1]).
+
+	   \returns false if the record was dropped.
+	*/
+	bool push( double t, const double *y )
+	{
+		++pushed_;
+		if (ring_.try_push(t, y)) return true;
+		if (opts_.backpressure == async_writer_options::DROP) {
+			++dropped_;
+			return false;
+		}
+		while (!ring_.try_push(t, y)) {
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+	bool push( double t, const arma::vec &y )
+	{
+		return push(t, y.memptr());
+	}
+
+	/// Writes all queued records, flushes the stream and stops the thread.
+	void finish()
+	{
+		if (finished_) return;
+		done_.store(true, std::memory_order_release);
+		worker_.join();
+		finished_ = true;
+	}
+
+	std::size_t pushed() const { return pushed_; }    ///< Records offered
+	std::size_t dropped() const { return dropped_; }  ///< Records dropped
+
+	/// Records written, only final after finish().
+	std::size_t written() const { return written_; }
+
+private:
+	void run()
+	{
+		std::vector<double> rec(ring_.width());
+		for (;;) {
+			// Check before draining, so nothing pushed before done_
+			// was set can be missed:
+			bool done = done_.load(std::memory_order_acquire);
+			std::size_t n = 0;
+			while (ring_.try_pop(rec.data())) {
+				format(rec);
+				++n;
+				if (pending_bytes() >= opts_.block_bytes) write_block();
+			}
+			if (n == 0) {
+				if (done) break;
+				std::this_thread::sleep_for(
+					std::chrono::microseconds(opts_.idle_sleep_us));
+			}
+		}
+		write_block();
+		out_.flush();
+	}
+
+	void format( const std::vector<double> &rec )
+	{
+		if (opts_.format == async_writer_options::BINARY) {
+			const char *p = reinterpret_cast<const char*>(rec.data());
+			bin_.insert(bin_.end(), p, p + rec.size()*sizeof(double));
+		} else {
+			fmt_ << rec[0];
+			for (std::size_t i = 1; i < rec.size(); ++i) {
+				fmt_ << " " << rec[i];
+			}
+			fmt_ << "\n";
+		}
+		++written_;
+	}
+
+	std::size_t pending_bytes()
+	{
+		if (opts_.format == async_writer_options::BINARY) return bin_.size();
+		return static_cast<std::size_t>(fmt_.tellp());
+	}
+
+	void write_block()
+	{
+		if (opts_.format == async_writer_options::BINARY) {
+			out_.write(bin_.data(), bin_.size());
+			bin_.clear();
+		} else {
+			const std::string &s = fmt_.str();
+			out_.write(s.data(), s.size());
+			fmt_.str("");
+		}
+	}
+
+	std::ostream &out_;
+	async_writer_options opts_;
+	spsc_record_ring ring_;
+
+	std::atomic<bool> done_;
+	bool finished_;
+	std::size_t pushed_, dropped_;  // Producer side
+	std::size_t written_;           // Writer side
+
+	std::ostringstream fmt_;
+	std::vector<char> bin_;
+	std::thread worker_;
+};
+
+
+/**
+   \brief The file output of the integrators, written either directly or
+   through an async_writer if output_options::async_write is set.
+*/
+class step_writer
+{
+public:
+	step_writer( const output_options &output_opts, std::size_t Neq )
+		: out_(output_opts.output_stream)
+	{
+		if (output_opts.write_to_file() && output_opts.async_write) {
+			async_.reset(new async_writer(*out_, Neq,
+			                              *output_opts.async_write));
+		}
+	}
+
+	/// Writes a state of another scalar type, converted to double.
+	template <typename eT>
+	void write( double t, const arma::Col<eT> &y )
+	{
+		write(t, arma::conv_to<arma::vec>::from(y));
+	}
+
+	void write( double t, const arma::vec &y )
+	{
+		if (async_) {
+			async_->push(t, y);
+			return;
+		}
+		*out_ << t;
+		for (std::size_t i = 0; i < y.n_elem; ++i) {
+			*out_ << " " << y[i];
+		}
+		*out_ << "\n";
+	}
+
+	/// Waits for all output to be written. Returns the dropped records.
+	std::size_t finish()
+	{
+		if (!async_) return 0;
+		async_->finish();
+		return async_->dropped();
+	}
+
+private:
+	std::ostream *out_;
+	std::unique_ptr<async_writer> async_;
+};
+
+
+#endif // ASYNC_WRITER_HPP
@@ -0,0 +1,402 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file autotune.hpp
+
+   \brief Picks a method and Newton settings from short pilot runs.
+
+   The cost of a solve depends a lot on the method, how often the Jacobi
+   matrix is refreshed and how many Newton iterations are allowed. The
+   tuner integrates the start of the interval with every candidate at
+   the target tolerance. It measures the wall time per unit of simulated
+   time and picks the cheapest candidate that succeeded.
+
+   The choice can be stored in a profile file, keyed by a problem name,
+   so that later runs of the same problem can skip the pilots:
+   \code{
+     autotune::candidate c;
+     if (!autotune::load_profile("rehuel.profiles", "my_problem", c)) {
+       c = autotune::tune(func, t0, t1, y0, opts).best;
+       autotune::save_profile("rehuel.profiles", "my_problem", c);
+     }
+   \code}
+*/
+
+#ifndef AUTOTUNE_HPP
+#define AUTOTUNE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "erk.hpp"
+#include "irk.hpp"
+
+
+/// \brief Automatic selection of solver settings.
+namespace autotune {
+
+typedef arma::vec vec_type;
+
+
+/**
+   \brief One combination of method and Newton settings.
+*/
+struct candidate
+{
+	/// \brief The solver family the method belongs to.
+	enum families {
+		IRK = 0, ///< irk::odeint
+		ERK = 1  ///< erk::odeint
+	};
+
+	candidate() : family(IRK), method(irk::RADAU_IIA_53),
+	              refresh_jac(1), maxit(10), newton_tol_factor(0.1) {}
+
+	candidate(int family, int method, int refresh_jac = 1, int maxit = 10)
+		: family(family), method(method), refresh_jac(refresh_jac),
+		  maxit(maxit), newton_tol_factor(0.1) {}
+
+	int family;  ///< See \ref families
+	int method;  ///< Method id of irk::rk_methods or erk::rk_methods
+
+	/// Newton settings, only used for IRK methods.
+	int refresh_jac;
+	int maxit;
+
+	/// The Newton tolerance is this times the relative tolerance.
+	double newton_tol_factor;
+
+	/// Human-readable description, e.g. "RADAU_IIA_53 refresh_jac=1 maxit=10".
+	std::string description() const
+	{
+		std::ostringstream s;
+		if (family == ERK) {
+			s << erk::method_to_name(method);
+		} else {
+			s << irk::method_to_name(method) << " refresh_jac="
+			  << refresh_jac << " maxit=" << maxit;
+		}
+		return s.str();
+	}
+};
+
+
+/**
+   \brief Options for the tuner.
+*/
+struct tuner_options
+{
+	tuner_options() : pilot_fraction(0.05), pilot_wall_time(1.0),
+	                  repeats(1), dt(1e-6) {}
+
+	/// The pilots integrate this fraction of [t0, t1].
+	double pilot_fraction;
+
+	/// Wall time budget of a single pilot run in seconds. Slow
+	/// candidates are stopped and rated on the time they reached.
+	double pilot_wall_time;
+
+	/// Number of runs per candidate. The fastest one counts.
+	int repeats;
+
+	/// Initial time step size of the pilots.
+	double dt;
+};
+
+
+/**
+   \brief Measurements of one pilot run.
+*/
+struct pilot_result
+{
+	pilot_result() : status(SUCCESS), wall_time(0.0), sim_time(0.0),
+	                 cost(std::numeric_limits<double>::infinity()),
+	                 steps(0), fun_evals(0), jac_evals(0) {}
+
+	candidate cand;
+	int status;             ///< Status of the pilot solve
+	double wall_time;       ///< Wall time in seconds
+	double sim_time;        ///< Length of the simulated interval reached
+	double cost;            ///< wall_time / sim_time, infinite on failure
+	std::size_t steps;      ///< Accepted steps
+	std::size_t fun_evals;  ///< Function evaluations
+	std::size_t jac_evals;  ///< Jacobi matrix evaluations
+};
+
+
+/**
+   \brief Result of tune().
+*/
+struct tuning_result
+{
+	tuning_result() : status(GENERAL_ERROR) {}
+
+	/// SUCCESS if at least one candidate worked.
+	int status;
+
+	/// The cheapest candidate that worked.
+	candidate best;
+
+	/// All pilots, in the order of the candidates.
+	std::vector<pilot_result> pilots;
+};
+
+
+/**
+   \brief Returns a candidate set that covers stiff and non-stiff
+   problems: a few stiffly accurate IRK methods with frequent and
+   infrequent Jacobi matrix updates, and the embedded ERK methods.
+*/
+inline std::vector<candidate> default_candidates()
+{
+	std::vector<candidate> cands;
+	for (int method : { irk::RADAU_IIA_32, irk::RADAU_IIA_53,
+	                    irk::RADAU_IIA_95, irk::LOBATTO_IIIC_43 }) {
+		for (int refresh_jac : { 1, 10 }) {
+			for (int maxit : { 5, 10 }) {
+				cands.push_back(candidate(candidate::IRK, method,
+				                          refresh_jac, maxit));
+			}
+		}
+	}
+	for (int method : { erk::BOGACKI_SHAMPINE_32, erk::CASH_KARP_54,
+	                    erk::DORMAND_PRINCE_54 }) {
+		cands.push_back(candidate(candidate::ERK, method));
+	}
+	return cands;
+}
+
+
+/**
+   \brief Applies the Newton settings of c.
+
+   \param c            The candidate.
+   \param solver_opts  Its rel_tol sets the Newton tolerance.
+   \param newton_opts  The options to fill in. They should outlive the
+                       solve, as solver_opts only points to them.
+*/
+inline void configure(const candidate &c, irk::solver_options &solver_opts,
+                      newton::options &newton_opts)
+{
+	newton_opts.refresh_jac = c.refresh_jac;
+	newton_opts.maxit = c.maxit;
+	newton_opts.tol = c.newton_tol_factor*solver_opts.rel_tol;
+	solver_opts.newton_opts = &newton_opts;
+}
+
+
+/**
+   \brief Integrates func with the settings of candidate c.
+
+   \returns the status, the time reached and the counters of the solve.
+*/
+template <typename functor_type> inline
+pilot_result run_candidate(functor_type &func, double t0, double t1,
+                           const vec_type &y0, const candidate &c,
+                           const common_solver_options &common_opts,
+                           double dt)
+{
+	typedef std::chrono::steady_clock clock;
+	pilot_result res;
+	res.cand = c;
+	output_options output_opts;
+	auto start = clock::now();
+	if (c.family == candidate::ERK) {
+		erk::solver_options so = erk::default_solver_options();
+		static_cast<common_solver_options&>(so) = common_opts;
+		erk::rk_output sol = erk::odeint(func, t0, t1, y0, so,
+		                                 output_opts, c.method, dt);
+		res.status = sol.status;
+		res.sim_time = sol.t_vals.back() - t0;
+		res.steps = sol.t_vals.size() - 1;
+		res.fun_evals = sol.count.fun_evals;
+	} else {
+		irk::solver_options so = irk::default_solver_options();
+		static_cast<common_solver_options&>(so) = common_opts;
+		newton::options newton_opts;
+		configure(c, so, newton_opts);
+		irk::rk_output sol = irk::odeint(func, t0, t1, y0, so,
+		                                 output_opts, c.method, dt);
+		res.status = sol.status;
+		res.sim_time = sol.t_vals.back() - t0;
+		res.steps = sol.t_vals.size() - 1;
+		res.fun_evals = sol.count.fun_evals;
+		res.jac_evals = sol.count.jac_evals;
+	}
+	res.wall_time = std::chrono::duration<double>(clock::now() - start).count();
+	return res;
+}
+
+
+/**
+   \brief Runs a pilot with every candidate and picks the cheapest.
+
+   Pilots that fail are rated as infinitely expensive. Pilots that run
+   out of wall time are rated on the part they managed.
+
+   \param func         Functor of the ODE. IRK candidates need jac.
+   \param t0           Starting time of the production run.
+   \param t1           Final time of the production run.
+   \param y0           Initial values.
+   \param common_opts  Options of the production run, in particular the
+                       target tolerances.
+   \param cands        The candidates to try.
+   \param opts         Options for the tuner.
+
+   \returns the best candidate and the measurements of all pilots.
+*/
+template <typename functor_type> inline
+tuning_result tune(functor_type &func, double t0, double t1,
+                   const vec_type &y0,
+                   const common_solver_options &common_opts,
+                   const std::vector<candidate> &cands = default_candidates(),
+                   const tuner_options &opts = tuner_options())
+{
+	tuning_result result;
+	double t_pilot = t0 + opts.pilot_fraction*(t1 - t0);
+
+	common_solver_options pilot_opts = common_opts;
+	pilot_opts.max_wall_time = opts.pilot_wall_time;
+	pilot_opts.progress = nullptr;
+	pilot_opts.steady_state_tol = 0.0;
+
+	double best_cost = std::numeric_limits<double>::infinity();
+	for (const candidate &c : cands) {
+		pilot_result best_run;
+		for (int r = 0; r < std::max(1, opts.repeats); ++r) {
+			pilot_result run = run_candidate(func, t0, t_pilot, y0, c,
+			                                 pilot_opts, opts.dt);
+			bool usable = (run.status == SUCCESS ||
+			               run.status == ERROR_BUDGET_EXCEEDED) &&
+				run.sim_time > 0;
+			if (usable) run.cost = run.wall_time / run.sim_time;
+			if (r == 0 || run.cost < best_run.cost) best_run = run;
+		}
+		result.pilots.push_back(best_run);
+		if (best_run.cost < best_cost) {
+			best_cost = best_run.cost;
+			result.best = c;
+			result.status = SUCCESS;
+		}
+	}
+	return result;
+}
+
+
+/**
+   \brief Looks up the candidate stored for problem in a profile file.
+
+   \returns false if the file or the entry does not exist.
+*/
+inline bool load_profile(const std::string &file, const std::string &problem,
+                         candidate &c)
+{
+	std::ifstream in(file);
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream s(line);
+		std::string key, family, method;
+		candidate entry;
+		if (!(s >> key >> family >> method >> entry.refresh_jac
+		        >> entry.maxit >> entry.newton_tol_factor)) {
+			continue;
+		}
+		if (key != problem) continue;
+
+		if (family == "erk") {
+			entry.family = candidate::ERK;
+			entry.method = erk::name_to_method(method);
+		} else if (family == "irk") {
+			entry.family = candidate::IRK;
+			entry.method = irk::name_to_method(method);
+		} else {
+			continue;
+		}
+		// Unknown method names map to 0:
+		if (entry.method == 0) continue;
+		c = entry;
+		return true;
+	}
+	return false;
+}
+
+
+/**
+   \brief Stores c for problem in a profile file, replacing an earlier
+   entry for the same problem.
+
+   The file is plain text with one line per problem. Methods are stored
+   by name, so profiles stay valid if the method ids change.
+
+   \returns false if problem contains whitespace or the file cannot be
+            written.
+*/
+inline bool save_profile(const std::string &file, const std::string &problem,
+                         const candidate &c)
+{
+	if (problem.empty() ||
+	    problem.find_first_of(" \t\r\n") != std::string::npos) {
+		return false;
+	}
+
+	std::vector<std::string> lines;
+	{
+		std::ifstream in(file);
+		std::string line, key;
+		while (std::getline(in, line)) {
+			std::istringstream s(line);
+			if (line.empty() || line[0] == '#' ||
+			    !(s >> key) || key != problem) {
+				lines.push_back(line);
+			}
+		}
+	}
+
+	std::ostringstream entry;
+	entry.precision(17);
+	if (c.family == candidate::ERK) {
+		entry << problem << " erk " << erk::method_to_name(c.method);
+	} else {
+		entry << problem << " irk " << irk::method_to_name(c.method);
+	}
+	entry << " " << c.refresh_jac << " " << c.maxit << " "
+	      << c.newton_tol_factor;
+	lines.push_back(entry.str());
+
+	std::ofstream out(file);
+	if (!out) return false;
+	for (const std::string &line : lines) {
+		out << line << "\n";
+	}
+	return static_cast<bool>(out);
+}
+
+
+} // namespace autotune
+
+
+#endif // AUTOTUNE_HPP
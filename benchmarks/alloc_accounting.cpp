@@ -0,0 +1,147 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file alloc_accounting.cpp
+
+   \brief Reports heap allocations per solve phase and checks that the
+   real-time step loop does not allocate.
+
+   Built with REHUEL_COUNT_ALLOCATIONS (see the Makefile). Returns a
+   non-zero exit code if irk::realtime_stepper allocates once it runs,
+   or if irk::odeint stores its output in a way that allocates per point
+   or temporarily needs much more memory than it ends up holding.
+*/
+
+#include <cstdio>
+
+#include "alloc_stats.hpp"
+#include "erk.hpp"
+#include "irk.hpp"
+#include "realtime.hpp"
+#include "test_equations.hpp"
+
+REHUEL_DEFINE_COUNTING_NEW
+
+
+void print_report(const char *label, const alloc_report &r, long long steps)
+{
+	std::printf("%s\n", label);
+	std::printf("  setup  : %8zu allocs, %10zu bytes\n",
+	            r.setup.allocs, r.setup.bytes);
+	std::printf("  steps  : %8zu allocs, %10zu bytes, %.1f allocs/step, "
+	            "max %zu in one step\n", r.step.allocs, r.step.bytes,
+	            steps > 0 ? double(r.step.allocs) / steps : 0.0,
+	            r.max_step_allocs);
+	std::printf("  output : %8zu allocs, %10zu bytes\n",
+	            r.output.allocs, r.output.bytes);
+	std::printf("  trajectory memory at the end: %zu bytes, peak %zu "
+	            "bytes\n\n", r.trajectory_bytes, r.peak_trajectory_bytes);
+}
+
+
+/// Checks the output storage of an irk::odeint solve.
+bool check_odeint(const irk::rk_output &sol, const irk::rk_output &no_store)
+{
+	bool ok = true;
+	const alloc_report &r = sol.allocs;
+	std::size_t n_points = sol.t_vals.size();
+
+	// Storage grows geometrically or in chunks, so the allocations per
+	// stored point (t, y, stages, error estimate) stay well below one
+	// per stored object:
+	if (r.output.allocs > 2*n_points) {
+		std::printf("FAIL: odeint output did %zu allocations for %zu "
+		            "points!\n", r.output.allocs, n_points);
+		ok = false;
+	}
+	// A vector that doubles holds old and new buffer at once, which is
+	// at most twice what is kept at the end:
+	if (r.peak_trajectory_bytes < r.trajectory_bytes ||
+	    r.peak_trajectory_bytes > 2*r.trajectory_bytes) {
+		std::printf("FAIL: odeint trajectory peaked at %zu bytes but "
+		            "holds %zu bytes!\n", r.peak_trajectory_bytes,
+		            r.trajectory_bytes);
+		ok = false;
+	}
+	// Without storage, the output phase should not allocate at all:
+	if (no_store.allocs.output.allocs > 0) {
+		std::printf("FAIL: odeint without storage did %zu output "
+		            "allocations!\n", no_store.allocs.output.allocs);
+		ok = false;
+	}
+	if (ok) std::printf("OK: odeint output storage is amortized.\n");
+	return ok;
+}
+
+
+int main()
+{
+	static_assert(alloc_tracking::enabled,
+	              "Build with -DREHUEL_COUNT_ALLOCATIONS!");
+	test_equations::vdpol func(0.1);
+	vec_type y0 = { 2.0, 0.0 };
+	output_options output_opts;
+
+	irk::solver_options iso = irk::default_solver_options();
+	newton::options n_opts;
+	n_opts.tol = 0.1*iso.rel_tol;
+	iso.newton_opts = &n_opts;
+	irk::rk_output isol = irk::odeint(func, 0.0, 10.0, y0, iso, output_opts);
+	print_report("irk::odeint, RADAU_IIA_53:", isol.allocs,
+	             isol.t_vals.size() - 1);
+
+	output_options no_store_opts;
+	no_store_opts.disable_store_in_vectors();
+	irk::rk_output inone = irk::odeint(func, 0.0, 10.0, y0, iso,
+	                                   no_store_opts);
+	print_report("irk::odeint, RADAU_IIA_53, no storage:", inone.allocs,
+	             inone.count.attempt);
+	bool ok = check_odeint(isol, inone);
+	std::printf("\n");
+
+	erk::solver_options eso;
+	erk::rk_output esol = erk::odeint(func, 0.0, 10.0, y0, eso, output_opts);
+	print_report("erk::odeint, DORMAND_PRINCE_54:", esol.allocs,
+	             esol.t_vals.size() - 1);
+
+	// The real-time stepper should not allocate at all after setup:
+	irk::realtime_options rt_opts;
+	irk::realtime_stepper<test_equations::vdpol> stepper(
+		func, 2, irk::RADAU_IIA_53, rt_opts);
+	vec_type y = y0;
+	double t = 0.0;
+	stepper.step(t, y, 1e-3);  // Warm-up
+
+	alloc_counters before = alloc_tracking::snapshot();
+	for (int i = 0; i < 10000; ++i) {
+		stepper.step(t, y, 1e-3);
+	}
+	alloc_counters loop = alloc_tracking::snapshot() - before;
+	std::printf("irk::realtime_stepper, 10000 steps: %zu allocs, "
+	            "%zu bytes\n", loop.allocs, loop.bytes);
+
+	if (loop.allocs > 0) {
+		std::printf("FAIL: the real-time step loop allocates!\n");
+		return 1;
+	}
+	std::printf("OK: the real-time step loop does not allocate.\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file blas_threads.cpp
+
+   \brief Shows the effect of the BLAS threading policy.
+
+   Solves a stiff reaction-diffusion system with irk::odeint in two
+   settings:
+   - An ensemble of medium sized systems on all cores. Once with every
+     solve allowed all BLAS threads (oversubscribed), once through
+     ensemble::reduce with the SERIAL policy for its workers.
+   - One large system, with serial BLAS and with the thread count from
+     the AUTO policy.
+
+   Single solves never change the BLAS thread count themselves, so this
+   sets it with a blas_thread_scope outside of them. The count is global,
+   so it is never changed from inside the worker threads.
+
+   Link against OpenBLAS to see a difference; with other BLAS libraries
+   the thread count is not changed.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "ensemble.hpp"
+#include "irk.hpp"
+
+
+/// y' = D y_xx - y^3 on a 1D grid with zero boundary values.
+struct reaction_diffusion
+{
+	typedef arma::mat jac_type;
+
+	explicit reaction_diffusion(std::size_t N, double D)
+		: N(N), c(D*(N + 1.0)*(N + 1.0)) {}
+
+	arma::vec fun(double t, const arma::vec &y)
+	{
+		arma::vec f(N);
+		for (std::size_t i = 0; i < N; ++i) {
+			double left  = i > 0 ? y(i-1) : 0.0;
+			double right = i + 1 < N ? y(i+1) : 0.0;
+			f(i) = c*(left - 2*y(i) + right) - y(i)*y(i)*y(i);
+		}
+		return f;
+	}
+
+	jac_type jac(double t, const arma::vec &y)
+	{
+		jac_type J(N, N, arma::fill::zeros);
+		for (std::size_t i = 0; i < N; ++i) {
+			J(i,i) = -2*c - 3*y(i)*y(i);
+			if (i > 0) J(i,i-1) = c;
+			if (i + 1 < N) J(i,i+1) = c;
+		}
+		return J;
+	}
+
+	std::size_t N;
+	double c;
+};
+
+
+irk::rk_output solve(std::size_t N, double amplitude)
+{
+	reaction_diffusion func(N, 1.0);
+	irk::solver_options so = irk::default_solver_options();
+	newton::options n_opts;
+	n_opts.tol = 0.1*so.rel_tol;
+	so.newton_opts = &n_opts;
+	output_options output_opts;
+	const double pi = std::acos(-1.0);
+	arma::vec y0(N);
+	for (std::size_t i = 0; i < N; ++i) {
+		y0(i) = amplitude*std::sin(pi*(i + 1.0) / (N + 1.0));
+	}
+	return irk::odeint(func, 0.0, 0.1, y0, so, output_opts,
+	                   irk::RADAU_IIA_53, 1e-4);
+}
+
+
+template <typename func_type>
+double time_ms(func_type f)
+{
+	typedef std::chrono::steady_clock clock;
+	auto start = clock::now();
+	f();
+	auto stop = clock::now();
+	return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+
+int main()
+{
+	unsigned n_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::size_t N_small = 150, N_large = 1000, n_traj = 4*n_threads;
+
+	blas_thread_policy all_threads;
+	all_threads.mode = blas_thread_policy::FIXED;
+	blas_thread_policy serial;
+	serial.mode = blas_thread_policy::SERIAL;
+	blas_thread_policy automatic;
+	automatic.mode = blas_thread_policy::AUTO;
+
+	std::printf("BLAS threads at start: %d, cores: %u\n",
+	            blas_threads::get_num_threads(), n_threads);
+
+	std::printf("Ensemble of %zu systems of size %zu:\n", n_traj, N_small);
+	double t_over = time_ms([&]()
+	{
+		blas_threads::blas_thread_scope blas_scope(
+			blas_threads::choose_blas_threads(N_small, &all_threads));
+		std::vector<std::thread> threads;
+		for (unsigned w = 0; w < n_threads; ++w) {
+			threads.emplace_back([&, w]()
+			{
+				for (std::size_t i = w; i < n_traj; i += n_threads) {
+					solve(N_small, 1.0 + 0.01*i);
+				}
+			});
+		}
+		for (std::thread &th : threads) th.join();
+	});
+	std::printf("  all BLAS threads in every solve: %10.1f ms\n", t_over);
+
+	std::vector<double> t_eval = { 0.0, 0.05, 0.1 };
+	ensemble::reducer proto(t_eval, N_small);
+	double t_ens = time_ms([&]()
+	{
+		ensemble::reduce(proto, n_traj, [&](std::size_t i)
+		{
+			return solve(N_small, 1.0 + 0.01*i);
+		}, n_threads, &serial);
+	});
+	std::printf("  ensemble::reduce (serial BLAS):  %10.1f ms\n", t_ens);
+
+	std::printf("One system of size %zu:\n", N_large);
+	double t_serial = time_ms([&]()
+	{
+		blas_threads::blas_thread_scope blas_scope(
+			blas_threads::choose_blas_threads(3*N_large, &serial));
+		solve(N_large, 1.0);
+	});
+	std::printf("  serial BLAS:                     %10.1f ms\n", t_serial);
+	double t_auto = time_ms([&]()
+	{
+		blas_threads::blas_thread_scope blas_scope(
+			blas_threads::choose_blas_threads(3*N_large, &automatic));
+		solve(N_large, 1.0);
+	});
+	std::printf("  AUTO policy:                     %10.1f ms\n", t_auto);
+
+	return 0;
+}
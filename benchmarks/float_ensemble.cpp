@@ -0,0 +1,121 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file float_ensemble.cpp
+
+   \brief Compares ensemble screening runs in single and double precision.
+
+   Solves an ensemble of Lorenz-96 systems with perturbed initial values
+   at a loose tolerance with erk::odeint, once with arma::vec and once
+   with arma::fvec states, and reduces both with ensemble::reduce. Prints
+   the wall time, the steps taken and the largest difference between the
+   ensemble means.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "ensemble.hpp"
+#include "erk.hpp"
+
+
+/// Lorenz-96 model for any scalar type.
+template <typename real_type>
+struct lorenz96
+{
+	typedef arma::Col<real_type> vec_t;
+
+	explicit lorenz96(real_type forcing) : forcing(forcing) {}
+
+	vec_t fun(double t, const vec_t &x)
+	{
+		const std::size_t N = x.n_elem;
+		vec_t f(N);
+		for (std::size_t i = 0; i < N; ++i) {
+			real_type xp1 = x((i + 1) % N);
+			real_type xm1 = x((i + N - 1) % N);
+			real_type xm2 = x((i + N - 2) % N);
+			f(i) = (xp1 - xm2)*xm1 - x(i) + forcing;
+		}
+		return f;
+	}
+
+	real_type forcing;
+};
+
+
+template <typename real_type>
+ensemble::reducer run(const char *label, std::size_t Neq, std::size_t n_traj,
+                      double t1, const std::vector<double> &t_eval)
+{
+	typedef std::chrono::steady_clock clock;
+	typedef arma::Col<real_type> vec_t;
+
+	erk::solver_options so = erk::default_solver_options();
+	so.rel_tol = so.abs_tol = 1e-3;
+	output_options output_opts;
+
+	std::vector<std::size_t> steps(n_traj, 0);
+	auto solve_one = [&](std::size_t i)
+	{
+		lorenz96<real_type> func(8);
+		vec_t y0(Neq);
+		y0.fill(8);
+		y0(0) += 0.01*(i + 1);
+		erk::basic_rk_output<real_type> sol =
+			erk::odeint(func, 0.0, t1, y0, so, output_opts);
+		steps[i] = sol.t_vals.size() - 1;
+		return sol;
+	};
+
+	ensemble::reducer proto(t_eval, Neq);
+	auto start = clock::now();
+	ensemble::reducer stats = ensemble::reduce(proto, n_traj, solve_one);
+	auto stop = clock::now();
+
+	std::size_t total_steps = 0;
+	for (std::size_t s : steps) total_steps += s;
+	double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+	std::printf("%-8s %10.1f ms, %8zu steps, %6.2f us/step\n", label, ms,
+	            total_steps, 1e3*ms / total_steps);
+	return stats;
+}
+
+
+int main()
+{
+	std::size_t Neq = 256, n_traj = 512;
+	double t1 = 5.0;
+	std::vector<double> t_eval;
+	for (std::size_t k = 0; k <= 50; ++k) t_eval.push_back(t1*k / 50);
+
+	std::printf("Lorenz-96, Neq = %zu, %zu trajectories, tol = 1e-3\n",
+	            Neq, n_traj);
+	ensemble::reducer sd = run<double>("double", Neq, n_traj, t1, t_eval);
+	ensemble::reducer sf = run<float>("float", Neq, n_traj, t1, t_eval);
+
+	mat_type diff = arma::abs(sd.mean() - sf.mean());
+	double max_diff = diff.max();
+	std::printf("Largest difference of the ensemble means: %g\n", max_diff);
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file realtime_latency.cpp
+
+   \brief Measures the per-step latency of irk::realtime_stepper.
+
+   Steps the stiff Van der Pol oscillator with a fixed dt and prints a
+   histogram of the wall time per step in power-of-two buckets, together
+   with the median, the 99th and 99.9th percentiles and the worst case.
+
+   Exits with a non-zero status if any step did more Newton iterations
+   or factorizations than the options allow, or, if a bound in ns is
+   given as the first argument, if the worst-case latency exceeds it.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "realtime.hpp"
+#include "test_equations.hpp"
+
+
+void print_histogram(const char *label, std::vector<double> &lat_ns)
+{
+	std::vector<std::size_t> buckets(32, 0);
+	for (double l : lat_ns) {
+		std::size_t b = 0;
+		while ((b + 1) < buckets.size() && (1ull << (b + 1)) <= l) ++b;
+		++buckets[b];
+	}
+
+	std::sort(lat_ns.begin(), lat_ns.end());
+	std::size_t N = lat_ns.size();
+	std::printf("%s\n", label);
+	std::printf("  median %10.0f ns, p99 %10.0f ns, p99.9 %10.0f ns, "
+	            "max %10.0f ns\n", lat_ns[N/2], lat_ns[(N*99)/100],
+	            lat_ns[(N*999)/1000], lat_ns[N-1]);
+	for (std::size_t b = 0; b < buckets.size(); ++b) {
+		if (buckets[b] == 0) continue;
+		std::printf("  [%10llu, %10llu) ns : %zu\n", 1ull << b,
+		            1ull << (b + 1), buckets[b]);
+	}
+}
+
+
+bool run(const char *label, const irk::realtime_options &rt_opts,
+         std::size_t n_steps, double dt, double max_latency_ns)
+{
+	typedef std::chrono::steady_clock clock;
+	test_equations::vdpol func(1e-3);
+	irk::realtime_stepper<test_equations::vdpol> stepper(
+		func, 2, irk::RADAU_IIA_53, rt_opts);
+
+	vec_type y = { 2.0, 0.0 };
+	double t = 0.0;
+	std::vector<double> lat_ns;
+	lat_ns.reserve(n_steps);
+	std::size_t fallbacks = 0, failures = 0;
+	int max_iters = 0, max_factorizations = 0;
+
+	for (std::size_t i = 0; i < n_steps; ++i) {
+		auto start = clock::now();
+		int status = stepper.step(t, y, dt);
+		auto stop = clock::now();
+		lat_ns.push_back(std::chrono::duration<double, std::nano>(
+			                 stop - start).count());
+		const irk::realtime_step_stats &stats = stepper.last_stats();
+		if (stats.used_fallback) ++fallbacks;
+		if (status != SUCCESS) ++failures;
+		max_iters = std::max(max_iters, stats.newton_iters);
+		max_factorizations = std::max(max_factorizations,
+		                              stats.factorizations);
+	}
+
+	print_histogram(label, lat_ns);
+	std::printf("  fallbacks %zu, failures %zu, t = %g, y = (%g, %g)\n",
+	            fallbacks, failures, t, y(0), y(1));
+	std::printf("  worst step: %d/%d Newton iterations, "
+	            "%d/%d factorizations\n", max_iters,
+	            rt_opts.max_step_newton_iters(), max_factorizations,
+	            rt_opts.max_step_factorizations());
+
+	bool ok = true;
+	if (max_iters > rt_opts.max_step_newton_iters() ||
+	    max_factorizations > rt_opts.max_step_factorizations()) {
+		std::printf("  FAIL: work bound exceeded!\n");
+		ok = false;
+	}
+	// lat_ns is sorted by print_histogram:
+	if (max_latency_ns > 0 && lat_ns.back() > max_latency_ns) {
+		std::printf("  FAIL: worst-case latency %.0f ns exceeds the "
+		            "bound of %.0f ns!\n", lat_ns.back(), max_latency_ns);
+		ok = false;
+	}
+	std::printf("\n");
+	return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+	std::size_t n_steps = 200000;
+	double dt = 1e-4;
+	double max_latency_ns = argc > 1 ? std::atof(argv[1]) : 0.0;
+	bool ok = true;
+
+	irk::realtime_options rt_opts;
+	ok &= run("Refactorize every step:", rt_opts, n_steps, dt,
+	          max_latency_ns);
+
+	rt_opts.reuse_factorization = true;
+	ok &= run("Reuse factorization:", rt_opts, n_steps, dt, max_latency_ns);
+
+	rt_opts.max_newton_iters = 2;
+	rt_opts.max_rejections = 0;
+	ok &= run("Reuse factorization, tight budget:", rt_opts, n_steps, dt,
+	          max_latency_ns);
+
+	return ok ? 0 : 1;
+}
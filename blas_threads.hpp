@@ -0,0 +1,313 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file blas_threads.hpp
+
+   \brief Chooses the number of BLAS/LAPACK threads per solve.
+
+   OpenBLAS runs every large arma::solve and arma::lu on its own thread
+   pool. That pays off for a single large stage system. When many small
+   systems are solved in parallel, e.g. in an ensemble, every worker
+   spawns BLAS threads as well and the cores get oversubscribed.
+
+   The thread count of OpenBLAS is global to the process, not per thread
+   or per solve. Changing it while another thread runs BLAS calls or
+   changes it as well is a race. So by default (mode LEAVE) nothing here
+   touches it, and a single solve never does. Only the parallel drivers
+   (ensemble::reduce, bvp::solve and the block-diagonal Jacobian backend)
+   apply a policy, through a parallel_region around their workers, and
+   only if one is set. bvp::solve and the block backend take it from
+   the blas_policy of the solver options, ensemble::reduce as an
+   argument. Do not run several of them concurrently with a policy other
+   than LEAVE.
+
+   Inside a parallel_region, AUTO gives every worker one thread, as the
+   workers already keep the cores busy. The size-dependent choice of
+   AUTO is only made by choose_blas_threads(): to size BLAS for one
+   large solve, wrap it in a blas_thread_scope with that count. The
+   count is only changed if OpenBLAS is linked in. With other BLAS
+   libraries the functions here do nothing.
+*/
+
+#ifndef BLAS_THREADS_HPP
+#define BLAS_THREADS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+
+#if defined(__GNUC__) && !defined(REHUEL_NO_BLAS_THREADS)
+// Weak, so that linking against a BLAS without these still works:
+extern "C" void openblas_set_num_threads(int) __attribute__((weak));
+extern "C" int openblas_get_num_threads(void) __attribute__((weak));
+#define REHUEL_HAVE_BLAS_THREADS 1
+#endif
+
+
+/**
+   \brief Policy for the number of BLAS threads of a solve.
+*/
+struct blas_thread_policy
+{
+	/// \brief How the number of threads is chosen.
+	enum modes {
+		LEAVE = 0, ///< Do not touch the BLAS settings
+		SERIAL,    ///< Always one thread
+		FIXED,     ///< Always max_threads threads
+		AUTO       ///< By system size in choose_blas_threads(), one
+		           ///< thread per worker in a parallel_region
+	};
+
+	blas_thread_policy() : mode(LEAVE), max_threads(0),
+	                       min_parallel_size(400) {}
+
+	int mode;  ///< See \ref modes
+
+	/// Thread count for FIXED, and the upper bound for AUTO. 0 means
+	/// hardware concurrency.
+	unsigned max_threads;
+
+	/// With AUTO, linear systems of at least this size use
+	/// max_threads threads. Smaller ones run single-threaded, since
+	/// the synchronization of the thread pool costs more than it saves.
+	std::size_t min_parallel_size;
+};
+
+
+namespace blas_threads {
+
+namespace detail {
+
+struct global_policy
+{
+	std::atomic<int> mode;
+	std::atomic<unsigned> max_threads;
+	std::atomic<std::size_t> min_parallel_size;
+
+	global_policy()
+	{
+		blas_thread_policy p;
+		mode = p.mode;
+		max_threads = p.max_threads;
+		min_parallel_size = p.min_parallel_size;
+	}
+};
+
+inline global_policy &global()
+{
+	static global_policy g;
+	return g;
+}
+
+inline bool &worker_flag()
+{
+	static thread_local bool in_worker = false;
+	return in_worker;
+}
+
+} // namespace detail
+
+
+/// Sets the policy used by drivers that do not get their own. As the
+/// BLAS thread count itself, it is global to the process.
+inline void set_default_policy( const blas_thread_policy &p )
+{
+	detail::global_policy &g = detail::global();
+	g.mode = p.mode;
+	g.max_threads = p.max_threads;
+	g.min_parallel_size = p.min_parallel_size;
+}
+
+/// Returns the policy used by drivers that do not get their own.
+inline blas_thread_policy default_policy()
+{
+	const detail::global_policy &g = detail::global();
+	blas_thread_policy p;
+	p.mode = g.mode;
+	p.max_threads = g.max_threads;
+	p.min_parallel_size = g.min_parallel_size;
+	return p;
+}
+
+/// True if the calling thread is a worker of a rehuel parallel driver.
+inline bool in_worker()
+{
+	return detail::worker_flag();
+}
+
+/// Returns the current number of BLAS threads, or 0 if unknown.
+inline int get_num_threads()
+{
+#ifdef REHUEL_HAVE_BLAS_THREADS
+	if (openblas_get_num_threads) return openblas_get_num_threads();
+#endif
+	return 0;
+}
+
+/// Sets the number of BLAS threads, if the BLAS library supports it.
+inline void set_num_threads( int n )
+{
+#ifdef REHUEL_HAVE_BLAS_THREADS
+	if (openblas_set_num_threads && n > 0) openblas_set_num_threads(n);
+#else
+	(void)n;
+#endif
+}
+
+
+/**
+   \brief Returns the number of BLAS threads for linear systems of size
+   N, or 0 if the settings should be left alone.
+
+   \param N       Size of the linear systems of the solve.
+   \param policy  The policy of the solve, or null for the default.
+*/
+inline int choose_blas_threads( std::size_t N,
+                                const blas_thread_policy *policy = nullptr )
+{
+	blas_thread_policy p = policy ? *policy : default_policy();
+	// The driver already limited BLAS for all its workers:
+	if (in_worker() || p.mode == blas_thread_policy::LEAVE) return 0;
+
+	unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+	unsigned max_threads = p.max_threads > 0 ? p.max_threads : hw;
+
+	switch (p.mode) {
+	case blas_thread_policy::SERIAL:
+		return 1;
+	case blas_thread_policy::FIXED:
+		return max_threads;
+	default:
+	case blas_thread_policy::AUTO:
+		return N < p.min_parallel_size ? 1 : max_threads;
+	}
+}
+
+
+/**
+   \brief Sets the number of BLAS threads and restores the previous value
+   when it goes out of scope. Does nothing for n == 0.
+*/
+class blas_thread_scope
+{
+public:
+	explicit blas_thread_scope( int n ) : prev_(0)
+	{
+		if (n <= 0) return;
+		prev_ = get_num_threads();
+		if (prev_ == n) {
+			prev_ = 0;
+			return;
+		}
+		set_num_threads(n);
+	}
+
+	~blas_thread_scope()
+	{
+		if (prev_ > 0) set_num_threads(prev_);
+	}
+
+	blas_thread_scope( const blas_thread_scope & ) = delete;
+	blas_thread_scope &operator=( const blas_thread_scope & ) = delete;
+
+private:
+	int prev_;
+};
+
+
+/**
+   \brief Marks the calling thread as a worker of a parallel driver for
+   the lifetime of the object, if active. Solves on a worker thread leave
+   the BLAS settings to the driver.
+*/
+class worker_scope
+{
+public:
+	explicit worker_scope( bool active = true )
+		: prev_(detail::worker_flag())
+	{
+		if (active) detail::worker_flag() = true;
+	}
+
+	~worker_scope()
+	{
+		detail::worker_flag() = prev_;
+	}
+
+	worker_scope( const worker_scope & ) = delete;
+	worker_scope &operator=( const worker_scope & ) = delete;
+
+private:
+	bool prev_;
+};
+
+
+/**
+   \brief Returns the number of BLAS threads for each of n_workers
+   parallel workers, or 0 if the settings should be left alone.
+
+   SERIAL and AUTO give one thread, as the workers already keep the
+   cores busy. FIXED gives max_threads.
+*/
+inline int choose_region_threads( unsigned n_workers,
+                                  const blas_thread_policy *policy = nullptr )
+{
+	blas_thread_policy p = policy ? *policy : default_policy();
+	if (n_workers <= 1 || in_worker()) return 0;
+
+	switch (p.mode) {
+	case blas_thread_policy::LEAVE:
+		return 0;
+	case blas_thread_policy::FIXED:
+		return p.max_threads > 0 ? p.max_threads
+			: std::max(1u, std::thread::hardware_concurrency());
+	default:
+		return 1;
+	}
+}
+
+
+/**
+   \brief Used by the parallel drivers around their worker threads.
+
+   Applies choose_region_threads() while the workers run, and restores
+   the previous count afterwards. Each worker should hold a
+   worker_scope(n_workers > 1), so that nested drivers leave BLAS alone.
+*/
+class parallel_region
+{
+public:
+	explicit parallel_region( unsigned n_workers,
+	                          const blas_thread_policy *policy = nullptr )
+		: blas_(choose_region_threads(n_workers, policy))
+	{ }
+
+private:
+	blas_thread_scope blas_;
+};
+
+
+} // namespace blas_threads
+
+
+#endif // BLAS_THREADS_HPP
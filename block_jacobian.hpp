@@ -0,0 +1,287 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file block_jacobian.hpp
+
+   \brief Block-diagonal Jacobi matrices and their factorizations.
+
+   Models made of many independent or weakly coupled cells (compartments,
+   per-site chemistry, ...) have a block-diagonal Jacobi matrix with small
+   blocks. A functor opts in by declaring
+   \code{
+     typedef block_diag_mat jac_type;
+     block_diag_mat jac(double t, const arma::vec &y);
+   \code}
+   The implicit solvers then factor the stage matrix block by block.
+   For an Ns-stage method and blocks B_k, the stage matrix
+   I - dt*kron(A, J) is, after grouping the unknowns of each block over
+   all stages, block-diagonal with blocks I - dt*kron(A, B_k). So the
+   cost is linear in the number of blocks instead of cubic in Ns*Neq,
+   and the blocks can be factored in parallel.
+*/
+
+#ifndef BLOCK_JACOBIAN_HPP
+#define BLOCK_JACOBIAN_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "arma_include.hpp"
+#include "blas_threads.hpp"
+
+
+/**
+   \brief A square block-diagonal matrix, stored as its diagonal blocks.
+
+   The blocks can have different sizes. Block k covers the rows and
+   columns offset(k), ..., offset(k) + block(k).n_rows - 1.
+*/
+class block_diag_mat
+{
+public:
+	block_diag_mat() : n_(0) {}
+
+	/// Creates n_blocks zero blocks of size block_size.
+	block_diag_mat(std::size_t n_blocks, std::size_t block_size) : n_(0)
+	{
+		for (std::size_t k = 0; k < n_blocks; ++k) {
+			add_block(arma::zeros(block_size, block_size));
+		}
+	}
+
+	/// Creates zero blocks with the given sizes.
+	explicit block_diag_mat(const std::vector<std::size_t> &sizes) : n_(0)
+	{
+		for (std::size_t s : sizes) {
+			add_block(arma::zeros(s, s));
+		}
+	}
+
+	/// Appends B as the next diagonal block.
+	void add_block(const arma::mat &B)
+	{
+		assert(B.n_rows == B.n_cols && "Diagonal blocks must be square!");
+		offsets_.push_back(n_);
+		blocks_.push_back(B);
+		n_ += B.n_rows;
+	}
+
+	std::size_t n_rows() const { return n_; }
+	std::size_t n_cols() const { return n_; }
+	std::size_t n_blocks() const { return blocks_.size(); }
+
+	/// First row and column of block k.
+	std::size_t offset(std::size_t k) const { return offsets_[k]; }
+
+	arma::mat &block(std::size_t k) { return blocks_[k]; }
+	const arma::mat &block(std::size_t k) const { return blocks_[k]; }
+
+	/// Returns the full matrix. Mostly useful for testing.
+	arma::mat to_dense() const
+	{
+		arma::mat D = arma::zeros(n_, n_);
+		for (std::size_t k = 0; k < blocks_.size(); ++k) {
+			std::size_t o = offsets_[k];
+			std::size_t e = o + blocks_[k].n_rows - 1;
+			D.submat(o, o, e, e) = blocks_[k];
+		}
+		return D;
+	}
+
+private:
+	std::size_t n_;
+	std::vector<arma::mat> blocks_;
+	std::vector<std::size_t> offsets_;
+};
+
+
+/// Product of a block-diagonal matrix with a vector or matrix.
+inline arma::mat operator*(const block_diag_mat &J, const arma::mat &X)
+{
+	assert(X.n_rows == J.n_rows() && "Matrix dimensions do not match!");
+	arma::mat res(X.n_rows, X.n_cols);
+	for (std::size_t k = 0; k < J.n_blocks(); ++k) {
+		std::size_t o = J.offset(k);
+		std::size_t e = o + J.block(k).n_rows - 1;
+		res.rows(o, e) = J.block(k)*X.rows(o, e);
+	}
+	return res;
+}
+
+
+/**
+   \brief The Jacobi matrix type of a functor: functor_type::jac_type if
+   it declares one, arma::mat otherwise.
+*/
+template <typename functor_type, typename = void>
+struct jacobian_of
+{
+	typedef arma::mat type;
+};
+
+template <typename functor_type>
+struct jacobian_of<functor_type,
+                   typename std::conditional<
+	                   true, void,
+	                   typename functor_type::jac_type>::type>
+{
+	typedef typename functor_type::jac_type type;
+};
+
+
+/**
+   \brief LU decompositions of kron(I, M_k) - dt*kron(A, B_k) for all
+   blocks B_k of a block-diagonal matrix.
+
+   With A the 1x1 identity, this factors M - dt*J, as needed for the
+   error estimate. With A the Butcher matrix of an Ns-stage method, it
+   factors the stage matrix. Vectors to solve for are in the usual stage
+   order, i.e., entry i of stage j is at j*Neq + i.
+*/
+class block_lu
+{
+public:
+	block_lu() : n_threads(1), min_parallel_work(1 << 20), mass(nullptr),
+	             blas_policy(nullptr) {}
+
+	/**
+	   \brief Factors all blocks.
+
+	   \param J   The block-diagonal Jacobi matrix.
+	   \param dt  Scaling of J.
+	   \param A   Coupling between the stages (Ns x Ns).
+
+	   \returns false if the LU decomposition of any block failed.
+	*/
+	bool factorize(const block_diag_mat &J, double dt, const arma::mat &A)
+	{
+		const std::size_t Ns  = A.n_rows;
+		const std::size_t Neq = J.n_rows();
+		const std::size_t n_blocks = J.n_blocks();
+		L_.resize(n_blocks);
+		U_.resize(n_blocks);
+		P_.resize(n_blocks);
+		rows_.resize(n_blocks);
+
+		// The factorizations cost about (Ns*n)^3 each. Threads are only
+		// worth starting if every worker gets enough of that to do:
+		std::size_t work = 0;
+		for (std::size_t k = 0; k < n_blocks; ++k) {
+			std::size_t m = Ns*J.block(k).n_rows;
+			work += m*m*m;
+		}
+
+		std::atomic<bool> success(true);
+		auto factor_block = [&](std::size_t k)
+		{
+			const arma::mat &B = J.block(k);
+			const std::size_t n = B.n_rows, o = J.offset(k);
+			arma::uvec &rows = rows_[k];
+			rows.set_size(Ns*n);
+			for (std::size_t j = 0; j < Ns; ++j) {
+				for (std::size_t i = 0; i < n; ++i) {
+					rows(j*n + i) = j*Neq + o + i;
+				}
+			}
+
+			arma::mat Mk;
+			if (mass) {
+				Mk = arma::kron(arma::eye(Ns, Ns),
+				                mass->submat(o, o, o + n - 1, o + n - 1));
+			} else {
+				Mk = arma::eye(Ns*n, Ns*n);
+			}
+			Mk -= dt*arma::kron(A, B);
+			if (!arma::lu(L_[k], U_[k], P_[k], Mk)) success = false;
+		};
+
+		unsigned workers = n_threads;
+		if (workers == 0) {
+			workers = std::max(1u, std::thread::hardware_concurrency());
+		}
+		workers = std::min<std::size_t>(workers, n_blocks);
+		if (min_parallel_work > 0) {
+			workers = std::min<std::size_t>(workers,
+			                                work / min_parallel_work);
+		}
+		if (workers <= 1) {
+			for (std::size_t k = 0; k < n_blocks; ++k) factor_block(k);
+		} else {
+			std::atomic<std::size_t> next(0);
+			blas_threads::parallel_region region(workers, blas_policy);
+			auto worker = [&]()
+			{
+				blas_threads::worker_scope in_worker;
+				std::size_t k;
+				while ((k = next++) < n_blocks) factor_block(k);
+			};
+			std::vector<std::thread> threads;
+			for (unsigned w = 1; w < workers; ++w) {
+				threads.emplace_back(worker);
+			}
+			worker();
+			for (std::thread &th : threads) {
+				th.join();
+			}
+		}
+		return success;
+	}
+
+	/// Returns the solution of the factored system for vectors and matrices.
+	template <typename T>
+	T solve(const T &R) const
+	{
+		T res(R.n_rows, R.n_cols);
+		for (std::size_t k = 0; k < rows_.size(); ++k) {
+			arma::mat Rk = R.rows(rows_[k]);
+			arma::mat tmp = arma::solve(arma::trimatl(L_[k]), P_[k]*Rk);
+			res.rows(rows_[k]) = arma::solve(arma::trimatu(U_[k]), tmp);
+		}
+		return res;
+	}
+
+	/// Number of threads that factor blocks (0 means hardware concurrency).
+	unsigned n_threads;
+
+	/// Estimated work (about (Ns*n)^3 per block of size n) that each
+	/// thread should get at least. Below that, fewer threads are used,
+	/// so small systems are factored without starting any.
+	std::size_t min_parallel_work;
+
+	/// Mass matrix, or nullptr for the identity. It has to have the
+	/// same block structure as J, only its diagonal blocks are used.
+	const arma::mat *mass;
+
+	/// BLAS policy while the blocks are factored in parallel (see
+	/// blas_threads.hpp). If null, the global default is used.
+	const blas_thread_policy *blas_policy;
+
+private:
+	std::vector<arma::mat> L_, U_, P_;
+	std::vector<arma::uvec> rows_;  ///< Rows of R that belong to each block
+};
+
+
+#endif // BLOCK_JACOBIAN_HPP
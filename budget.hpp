@@ -0,0 +1,122 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file budget.hpp
+
+   \brief Work budgets and cooperative cancellation for the integrators.
+
+   The integrators check the budget once per attempted step. If it ran
+   out, or if the cancel token was triggered, they stop and return what
+   they have so far, with status ERROR_BUDGET_EXCEEDED or CANCELLED.
+*/
+
+#ifndef BUDGET_HPP
+#define BUDGET_HPP
+
+#include <atomic>
+#include <chrono>
+
+#include "enums.hpp"
+#include "options.hpp"
+
+
+/**
+   \brief A flag that another thread can set to cancel a running solve.
+
+   Pass a pointer to it in common_solver_options::cancel. It can be
+   shared by any number of solves.
+*/
+class cancel_token
+{
+public:
+	cancel_token() : flag(false) {}
+
+	/// Requests cancellation. Safe to call from any thread.
+	void cancel()
+	{
+		flag.store(true, std::memory_order_relaxed);
+	}
+
+	/// Clears the request so the token can be re-used.
+	void reset()
+	{
+		flag.store(false, std::memory_order_relaxed);
+	}
+
+	/// Returns true if cancellation was requested.
+	bool cancelled() const
+	{
+		return flag.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<bool> flag;
+};
+
+
+/**
+   \brief Checks the budgets set in common_solver_options.
+*/
+class budget_monitor
+{
+public:
+	typedef std::chrono::steady_clock clock;
+
+	explicit budget_monitor(const common_solver_options &opts)
+		: opts(opts), start(clock::now()) {}
+
+	/**
+	   \brief Checks cancellation and all budgets.
+
+	   \param fun_evals  Function evaluations so far.
+	   \param jac_evals  Jacobi matrix evaluations so far.
+
+	   \returns SUCCESS, CANCELLED or ERROR_BUDGET_EXCEEDED.
+	*/
+	int check(std::size_t fun_evals, std::size_t jac_evals) const
+	{
+		if (opts.cancel && opts.cancel->cancelled()) {
+			return CANCELLED;
+		}
+		if (opts.max_fun_evals >= 0 &&
+		    fun_evals > static_cast<std::size_t>(opts.max_fun_evals)) {
+			return ERROR_BUDGET_EXCEEDED;
+		}
+		if (opts.max_jac_evals >= 0 &&
+		    jac_evals > static_cast<std::size_t>(opts.max_jac_evals)) {
+			return ERROR_BUDGET_EXCEEDED;
+		}
+		if (opts.max_wall_time > 0) {
+			std::chrono::duration<double> elapsed = clock::now() - start;
+			if (elapsed.count() > opts.max_wall_time) {
+				return ERROR_BUDGET_EXCEEDED;
+			}
+		}
+		return SUCCESS;
+	}
+
+private:
+	const common_solver_options &opts;
+	clock::time_point start;
+};
+
+
+#endif // BUDGET_HPP
@@ -0,0 +1,410 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file bvp.hpp
+
+   \brief Multiple shooting for two-point boundary value problems.
+
+   The problem y' = f(t,y), g(y(a), y(b)) = 0 is split at the nodes
+   a = t_0 < t_1 < ... < t_m = b. The unknowns are the states s_k at the
+   start of each interval. With phi_k(s_k) the solution of the IVP on
+   [t_k, t_{k+1}] starting at s_k, the shooting system reads
+   \f[ \phi_k(s_k) - s_{k+1} = 0, \quad k = 0, \dots, m-2, \f]
+   \f[ g(s_0, \phi_{m-1}(s_{m-1})) = 0. \f]
+   Its Jacobi matrix is block-bidiagonal, apart from the boundary
+   condition row. The blocks G_k = dphi_k/ds_k are the forward
+   sensitivities of the intervals. All intervals are independent, so
+   they are integrated in parallel.
+
+   The Newton steps are not solved with the full (m*Neq)^2 matrix.
+   The continuity conditions give ds_{k+1} = G_k*ds_k + r_k, so
+   eliminating them (condensing) leaves an Neq x Neq system for ds_0:
+   \f[ (B_a + B_b G_{m-1} \cdots G_0) ds_0 = -r_{m-1} - B_b e_{m-1}, \f]
+   with e_k the accumulated continuity residuals. The other ds_k follow
+   by forward recursion.
+
+   Compared to single shooting, each IVP only spans a fraction of the
+   domain, which keeps the growth of G_k (and so the conditioning of the
+   Newton system) in check.
+*/
+
+#ifndef BVP_HPP
+#define BVP_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "irk.hpp"
+#include "newton.hpp"
+#include "sensitivity.hpp"
+
+
+/// \brief A namespace with solvers for boundary value problems.
+namespace bvp {
+
+typedef arma::vec vec_type;
+typedef arma::mat mat_type;
+
+
+/**
+   \brief Options for the multiple shooting solver.
+*/
+struct solver_options
+{
+	solver_options() : method(irk::RADAU_IIA_53), dt(1e-6), n_threads(1),
+	                   newton_opts(nullptr), dense_output(true)
+	{
+		ivp_opts = irk::default_solver_options();
+		ivp_opts.out_interval = 0;
+		ivp_newton_opts.refresh_jac = 25;
+		ivp_newton_opts.tol = 0.1*std::min(ivp_opts.abs_tol,
+		                                   ivp_opts.rel_tol);
+	}
+
+	/// Options for the IVP solves on each interval.
+	irk::solver_options ivp_opts;
+
+	/// Newton options for the IVP solves, used if ivp_opts.newton_opts
+	/// is not set. They are pointed to at solve time, so copies of
+	/// these options stay valid.
+	newton::options ivp_newton_opts;
+
+	int method;          ///< IRK method for the intervals.
+	double dt;           ///< Initial time step for each interval.
+	unsigned n_threads;  ///< Worker threads (0 means hardware concurrency).
+
+	/// Options for the Newton iteration on the shooting system. Only
+	/// dx_delta and maxit are used. If null, a tolerance based on the
+	/// IVP tolerances is used.
+	const newton::options *newton_opts;
+
+	/// If true, integrate once more after convergence to obtain the
+	/// full trajectory in bvp_output::sol.
+	bool dense_output;
+};
+
+
+/**
+   \brief Result of a multiple shooting solve.
+*/
+struct bvp_output
+{
+	bvp_output() : status(SUCCESS), ivp_solves(0) {}
+
+	int status;                     ///< See \ref odeint_status_codes
+	std::vector<double> t_nodes;    ///< Shooting nodes t_0, ..., t_m
+	std::vector<vec_type> y_nodes;  ///< Solution at the nodes
+	newton::status newton_stats;    ///< Statistics of the outer Newton
+	std::size_t ivp_solves;         ///< Number of interval integrations
+
+	/// Full trajectory over [a, b], if dense_output was set.
+	irk::rk_output sol;
+};
+
+
+/**
+   \brief The shooting system.
+
+   The interval solves give both the residual and the blocks of the
+   Jacobi matrix, so the last evaluation is cached.
+*/
+template <typename functor_type, typename bc_type>
+struct shooting_system
+{
+	shooting_system(functor_type &func, bc_type &bc,
+	                const std::vector<double> &t_nodes,
+	                const solver_options &opts)
+		: func(func), bc(bc), t_nodes(t_nodes), opts(opts),
+		  m(t_nodes.size() - 1), Neq(0), ivp_solves(0)
+	{ }
+
+	vec_type fun(const vec_type &x)
+	{
+		update(x);
+		return F;
+	}
+
+	/// Integrates all intervals from the states in x.
+	void update(const vec_type &x)
+	{
+		if (same_as_cache(x)) return;
+		Neq = x.size() / m;
+		phi.assign(m, vec_type());
+		G.assign(m, mat_type());
+		std::vector<int> status(m, SUCCESS);
+
+		sensitivity_options sens;
+		sens.S0 = arma::eye(Neq, Neq);
+		sens.param_col = Neq;
+
+		unsigned n_threads = opts.n_threads;
+		if (n_threads == 0) {
+			n_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		n_threads = std::min<unsigned>(n_threads, m);
+		std::atomic<std::size_t> next(0);
+		blas_threads::parallel_region region(n_threads,
+		                                     opts.ivp_opts.blas_policy);
+
+		// Each worker gets its own copy of the functor, so it does
+		// not need to be safe to call from several threads.
+		auto worker = [this, &x, &sens, &status, &next, n_threads]()
+		{
+			blas_threads::worker_scope in_worker(n_threads > 1);
+			functor_type local_func(func);
+			irk::solver_options ivp_opts = opts.ivp_opts;
+			if (!ivp_opts.newton_opts) {
+				ivp_opts.newton_opts = &opts.ivp_newton_opts;
+			}
+			ivp_opts.sens_opts = &sens;
+			output_options output_opts;
+			std::size_t k;
+			while ((k = next++) < m) {
+				vec_type s_k = x.subvec(k*Neq, (k+1)*Neq - 1);
+				irk::rk_output sol = irk::odeint(local_func, t_nodes[k],
+				                                 t_nodes[k+1], s_k,
+				                                 ivp_opts, output_opts,
+				                                 opts.method, opts.dt);
+				status[k] = sol.status;
+				if (sol.status == SUCCESS) {
+					phi[k] = sol.y_vals.back();
+					G[k] = sol.sens_vals.back();
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned w = 1; w < n_threads; ++w) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (std::thread &th : threads) {
+			th.join();
+		}
+		ivp_solves += m;
+
+		assemble(x, status);
+		x_cache = x;
+	}
+
+	bool same_as_cache(const vec_type &x) const
+	{
+		if (x_cache.size() != x.size()) return false;
+		for (std::size_t i = 0; i < x.size(); ++i) {
+			if (x_cache(i) != x(i)) return false;
+		}
+		return true;
+	}
+
+	/// Builds the residual and the boundary condition derivatives.
+	void assemble(const vec_type &x, const std::vector<int> &status)
+	{
+		F = arma::zeros(m*Neq);
+
+		for (std::size_t k = 0; k < m; ++k) {
+			if (status[k] != SUCCESS) {
+				// Makes the Newton iteration bail out.
+				F.fill(std::numeric_limits<double>::quiet_NaN());
+				return;
+			}
+		}
+
+		for (std::size_t k = 0; k + 1 < m; ++k) {
+			std::size_t r0 = k*Neq, r1 = r0 + Neq - 1;
+			F.subvec(r0, r1) = phi[k] - x.subvec(r1 + 1, r1 + Neq);
+		}
+
+		vec_type ya = x.subvec(0, Neq - 1);
+		const vec_type &yb = phi[m-1];
+		F.subvec((m-1)*Neq, m*Neq - 1) = bc.fun(ya, yb);
+		Ba = bc.jac_a(ya, yb);
+		Bb = bc.jac_b(ya, yb);
+	}
+
+	/**
+	   \brief Solves J*dx = -F for the Newton step by condensing.
+
+	   \returns false if the condensed system is singular.
+	*/
+	bool newton_step(vec_type &dx) const
+	{
+		// ds_k = E*ds_0 + e for the current k:
+		mat_type E = arma::eye(Neq, Neq);
+		vec_type e = arma::zeros(Neq);
+		for (std::size_t k = 0; k + 1 < m; ++k) {
+			E = G[k]*E;
+			e = G[k]*e + F.subvec(k*Neq, (k+1)*Neq - 1);
+		}
+		mat_type S = Ba + Bb*G[m-1]*E;
+		vec_type rhs = -F.subvec((m-1)*Neq, m*Neq - 1) - Bb*G[m-1]*e;
+
+		vec_type ds;
+		if (!arma::solve(ds, S, rhs)) return false;
+
+		dx.set_size(m*Neq);
+		dx.subvec(0, Neq - 1) = ds;
+		for (std::size_t k = 0; k + 1 < m; ++k) {
+			ds = G[k]*ds + F.subvec(k*Neq, (k+1)*Neq - 1);
+			dx.subvec((k+1)*Neq, (k+2)*Neq - 1) = ds;
+		}
+		return true;
+	}
+
+	functor_type &func;
+	bc_type &bc;
+	const std::vector<double> &t_nodes;
+	const solver_options &opts;
+
+	std::size_t m, Neq, ivp_solves;
+	std::vector<vec_type> phi;
+	std::vector<mat_type> G;
+	vec_type x_cache, F;
+	mat_type Ba, Bb;
+};
+
+
+/**
+   \brief Solves a two-point boundary value problem with multiple shooting.
+
+   \param func     Functor of the ODE, as for irk::odeint. Each worker
+                   thread uses its own copy.
+   \param bc       Functor for the boundary conditions, with members
+                   \code{
+                     vec_type fun(const vec_type &ya, const vec_type &yb);
+                     mat_type jac_a(const vec_type &ya, const vec_type &yb);
+                     mat_type jac_b(const vec_type &ya, const vec_type &yb);
+                   \code}
+                   fun returns Neq residuals, jac_a and jac_b are its
+                   derivatives to ya and yb.
+   \param t_nodes  Shooting nodes, increasing, with t_nodes.front() = a
+                   and t_nodes.back() = b.
+   \param y_guess  Initial guess for the solution at each node but the
+                   last (so t_nodes.size() - 1 vectors).
+   \param opts     Solver options (see \ref solver_options).
+
+   \returns a bvp_output with the solution at the nodes.
+*/
+template <typename functor_type, typename bc_type> inline
+bvp_output solve(functor_type &func, bc_type &bc,
+                 const std::vector<double> &t_nodes,
+                 const std::vector<vec_type> &y_guess,
+                 const solver_options &opts = solver_options())
+{
+	bvp_output out;
+	assert(t_nodes.size() >= 2 && "Need at least two shooting nodes!");
+	assert(y_guess.size() == t_nodes.size() - 1 &&
+	       "Need an initial guess for each shooting interval!");
+
+	const std::size_t m = t_nodes.size() - 1;
+	const std::size_t Neq = y_guess[0].size();
+	vec_type x(m*Neq);
+	for (std::size_t k = 0; k < m; ++k) {
+		x.subvec(k*Neq, (k+1)*Neq - 1) = y_guess[k];
+	}
+
+	newton::options n_opts;
+	if (opts.newton_opts) {
+		n_opts = *opts.newton_opts;
+	} else {
+		n_opts.tol = 10*std::min(opts.ivp_opts.abs_tol,
+		                         opts.ivp_opts.rel_tol);
+		n_opts.dx_delta = n_opts.tol;
+		n_opts.maxit = 50;
+		n_opts.refresh_jac = 1;
+	}
+
+	shooting_system<functor_type, bc_type> system(func, bc, t_nodes, opts);
+	newton::status &stats = out.newton_stats;
+	stats.conv_status = newton::MAXIT_EXCEEDED;
+	system.update(x);
+	while (stats.iters < n_opts.maxit) {
+		vec_type dx;
+		if (!system.F.is_finite() || !system.newton_step(dx)) {
+			stats.conv_status = newton::GENERIC_ERROR;
+			break;
+		}
+		x += dx;
+		system.update(x);
+		++stats.iters;
+
+		if (arma::norm(dx, "inf") < n_opts.dx_delta) {
+			stats.conv_status = newton::SUCCESS;
+			break;
+		}
+	}
+	stats.res = arma::norm(system.F);
+	if (!std::isfinite(stats.res)) {
+		stats.conv_status = newton::GENERIC_ERROR;
+	}
+	out.ivp_solves = system.ivp_solves;
+
+	if (stats.conv_status != newton::SUCCESS) {
+		out.status = GENERAL_ERROR;
+		return out;
+	}
+
+	out.t_nodes = t_nodes;
+	for (std::size_t k = 0; k < m; ++k) {
+		out.y_nodes.push_back(x.subvec(k*Neq, (k+1)*Neq - 1));
+	}
+	out.y_nodes.push_back(system.phi[m-1]);
+
+	if (opts.dense_output) {
+		output_options output_opts;
+		irk::solver_options ivp_opts = opts.ivp_opts;
+		if (!ivp_opts.newton_opts) {
+			ivp_opts.newton_opts = &opts.ivp_newton_opts;
+		}
+		for (std::size_t k = 0; k < m; ++k) {
+			irk::rk_output sol_k = irk::odeint(func, t_nodes[k],
+			                                   t_nodes[k+1], out.y_nodes[k],
+			                                   ivp_opts, output_opts,
+			                                   opts.method, opts.dt);
+			++out.ivp_solves;
+			if (k == 0) {
+				out.sol = std::move(sol_k);
+			} else {
+				// Drop the duplicate point at the node:
+				sol_k.t_vals.erase(sol_k.t_vals.begin());
+				sol_k.y_vals.drop_front(1);
+				sol_k.stages.drop_front(1);
+				sol_k.err_est.drop_front(1);
+				sol_k.err.erase(sol_k.err.begin());
+				irk::append_rk_output(out.sol, std::move(sol_k));
+			}
+		}
+		out.status |= out.sol.status;
+	}
+
+	return out;
+}
+
+
+} // namespace bvp
+
+
+#endif // BVP_HPP
@@ -0,0 +1,510 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file compressed_trajectory.hpp
+
+   \brief Compressed storage for long trajectories.
+
+   Records (t, y) are stored in chunks of a fixed number of records, each
+   chunk being an independent bit stream:
+
+   - The first record of a chunk is stored verbatim.
+   - Times are stored as the delta-of-delta of their bit patterns. This
+     is exact for any sequence of doubles, and small if the time step
+     varies smoothly.
+   - State components are coded the same way: the bit pattern is
+     predicted by linear extrapolation from the previous two values,
+     and the difference to the prediction is stored. Like the XOR in
+     the Gorilla time series format, only the window of meaningful bits
+     of the difference is written, and the window is re-used while the
+     differences fit in it.
+
+   The lossy mode rounds every component to the coarsest mantissa whose
+   rounding error is below abs_tol + rel_tol*|y|. The solution is only
+   accurate to the solver tolerances anyway, and the zeroed low bits
+   make the windows much shorter.
+
+   Chunks decode independently, so random access costs at most one
+   chunk of decoding.
+*/
+
+#ifndef COMPRESSED_TRAJECTORY_HPP
+#define COMPRESSED_TRAJECTORY_HPP
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "arma_include.hpp"
+#include "options.hpp"
+
+
+/**
+   \brief Options for the compressed trajectory store.
+*/
+struct compression_options
+{
+	compression_options() : chunk_records(128), lossy(false),
+	                        abs_tol(0.0), rel_tol(0.0) {}
+
+	/// Number of records per independently decodable chunk.
+	std::size_t chunk_records;
+
+	/// If true, round the states to within abs_tol + rel_tol*|y|.
+	bool lossy;
+
+	double abs_tol;  ///< Absolute error bound of the lossy mode.
+	double rel_tol;  ///< Relative error bound of the lossy mode.
+};
+
+
+/**
+   \brief Returns lossy compression options with error bounds at a
+   fraction of the solver tolerances.
+*/
+inline compression_options lossy_compression(const common_solver_options &opts,
+                                             double fraction = 0.1)
+{
+	compression_options c;
+	c.lossy = true;
+	c.abs_tol = fraction*opts.abs_tol;
+	c.rel_tol = fraction*opts.rel_tol;
+	return c;
+}
+
+
+namespace compression_impl {
+
+inline std::uint64_t to_bits(double x)
+{
+	std::uint64_t b;
+	std::memcpy(&b, &x, sizeof(b));
+	return b;
+}
+
+inline double from_bits(std::uint64_t b)
+{
+	double x;
+	std::memcpy(&x, &b, sizeof(x));
+	return x;
+}
+
+inline unsigned leading_zeros(std::uint64_t x)
+{
+	unsigned n = 0;
+	for (std::uint64_t m = std::uint64_t(1) << 63; m && !(x & m); m >>= 1) ++n;
+	return n;
+}
+
+inline unsigned trailing_zeros(std::uint64_t x)
+{
+	unsigned n = 0;
+	for (; n < 64 && !(x & 1); x >>= 1) ++n;
+	return n;
+}
+
+/// Rounds x to the coarsest mantissa with a rounding error below bound.
+inline double quantize(double x, double bound)
+{
+	if (!(bound > 0) || x == 0.0 || !std::isfinite(x)) return x;
+	std::uint64_t b = to_bits(x);
+	int biased_exp = (b >> 52) & 0x7ff;
+	if (biased_exp == 0) return x;
+
+	// The last mantissa bit of x is worth 2^(biased_exp - 1075), and
+	// rounding off k bits changes x by at most 2^(k-1) of those.
+	int k = std::ilogb(bound) - (biased_exp - 1075) + 1;
+	if (k <= 0) return x;
+	if (k > 52) k = 52;
+	std::uint64_t half = std::uint64_t(1) << (k - 1);
+	b = (b + half) & ~((std::uint64_t(1) << k) - 1);
+	return from_bits(b);
+}
+
+
+/// Appends bits to a vector of words, most significant bit first.
+class bit_writer
+{
+public:
+	bit_writer( std::vector<std::uint64_t> &words, std::size_t &n_bits )
+		: words_(words), n_bits_(n_bits) {}
+
+	void write( std::uint64_t v, unsigned n )
+	{
+		if (n == 0) return;
+		if (n < 64) v &= (std::uint64_t(1) << n) - 1;
+		unsigned used = n_bits_ % 64;
+		if (used == 0) words_.push_back(0);
+		unsigned room = 64 - used;
+		if (n <= room) {
+			words_.back() |= v << (room - n);
+		} else {
+			words_.back() |= v >> (n - room);
+			words_.push_back(v << (64 - (n - room)));
+		}
+		n_bits_ += n;
+	}
+
+private:
+	std::vector<std::uint64_t> &words_;
+	std::size_t &n_bits_;
+};
+
+
+/// Reads bits written by bit_writer.
+class bit_reader
+{
+public:
+	explicit bit_reader( const std::vector<std::uint64_t> &words )
+		: words_(words), pos_(0) {}
+
+	std::uint64_t read( unsigned n )
+	{
+		if (n == 0) return 0;
+		std::size_t w = pos_ / 64;
+		unsigned used = pos_ % 64;
+		unsigned room = 64 - used;
+		std::uint64_t v;
+		if (n <= room) {
+			v = words_[w] >> (room - n);
+		} else {
+			v = (words_[w] << (n - room)) | (words_[w+1] >> (64 - (n - room)));
+		}
+		pos_ += n;
+		return n < 64 ? v & ((std::uint64_t(1) << n) - 1) : v;
+	}
+
+	bool read_bit() { return read(1) != 0; }
+
+private:
+	const std::vector<std::uint64_t> &words_;
+	std::size_t pos_;
+};
+
+
+/**
+   \brief State of the coder for one component of the records.
+
+   The bit pattern of the next value is predicted by linear
+   extrapolation of the previous two. The difference to the prediction
+   has many leading zeros for smooth components, and many trailing zeros
+   after quantization, so only its sign and the window of meaningful
+   bits in between are stored.
+*/
+struct component_coder
+{
+	component_coder() : prev(0), prev2(0), lead(0xff), trail(0) {}
+
+	void reset(std::uint64_t b)
+	{
+		*this = component_coder();
+		prev = prev2 = b;
+	}
+
+	std::uint64_t predict() const { return 2*prev - prev2; }
+
+	void update(std::uint64_t b)
+	{
+		prev2 = prev;
+		prev = b;
+	}
+
+	std::uint64_t prev, prev2;
+	unsigned char lead, trail;  ///< Current window, lead = 0xff if none
+};
+
+inline void encode(bit_writer &out, component_coder &s, std::uint64_t cur)
+{
+	std::uint64_t x = cur - s.predict();
+	s.update(cur);
+	if (x == 0) {
+		out.write(0, 1);
+		return;
+	}
+	// Sign and magnitude keep the trailing zeros of the difference:
+	bool negative = std::int64_t(x) < 0;
+	if (negative) x = -x;
+	out.write(1, 1);
+	out.write(negative, 1);
+	unsigned lead = leading_zeros(x);
+	unsigned trail = trailing_zeros(x);
+	if (s.lead != 0xff && lead >= s.lead && trail >= s.trail) {
+		// Fits in the previous window:
+		out.write(0, 1);
+		out.write(x >> s.trail, 64 - s.lead - s.trail);
+		return;
+	}
+	unsigned len = 64 - lead - trail;
+	out.write(1, 1);
+	out.write(lead, 6);
+	out.write(len - 1, 6);
+	out.write(x >> trail, len);
+	s.lead = lead;
+	s.trail = trail;
+}
+
+inline std::uint64_t decode(bit_reader &in, component_coder &s)
+{
+	std::uint64_t x = 0;
+	if (in.read_bit()) {
+		bool negative = in.read_bit();
+		if (in.read_bit()) {
+			s.lead = in.read(6);
+			unsigned len = in.read(6) + 1;
+			s.trail = 64 - s.lead - len;
+		}
+		unsigned len = 64 - s.lead - s.trail;
+		x = in.read(len) << s.trail;
+		if (negative) x = -x;
+	}
+	s.update(s.predict() + x);
+	return s.prev;
+}
+
+} // namespace compression_impl
+
+
+/**
+   \brief Compressed, append-only store of (t, y) records.
+*/
+class compressed_trajectory
+{
+public:
+	explicit compressed_trajectory( const compression_options &opts
+	                                = compression_options() )
+		: opts_(opts), n_rows_(0), size_(0)
+	{
+		if (opts_.chunk_records == 0) opts_.chunk_records = 1;
+	}
+
+	/// Number of stored records.
+	std::size_t size() const { return size_; }
+
+	bool empty() const { return size_ == 0; }
+
+	/// Length of the stored states.
+	std::size_t n_rows() const { return n_rows_; }
+
+	/// Number of chunks.
+	std::size_t n_chunks() const { return chunks_.size(); }
+
+	const compression_options &options() const { return opts_; }
+
+	/// Appends the record (t, y[0], ..., y[n-1]).
+	void push_back( double t, const double *y, std::size_t n )
+	{
+		using namespace compression_impl;
+		if (size_ == 0) {
+			n_rows_ = n;
+			coders_.resize(n + 1);
+		}
+		assert(n == n_rows_ && "State length does not match!");
+
+		std::size_t in_chunk = size_ % opts_.chunk_records;
+		if (in_chunk == 0) {
+			chunks_.push_back(chunk());
+		}
+		chunk &c = chunks_.back();
+		bit_writer out(c.words, c.n_bits);
+
+		// Coder 0 is for the time, the rest for the state:
+		std::uint64_t tb = to_bits(t);
+		if (in_chunk == 0) {
+			out.write(tb, 64);
+			coders_[0].reset(tb);
+		} else {
+			encode(out, coders_[0], tb);
+		}
+
+		for (std::size_t i = 0; i < n; ++i) {
+			double yi = y[i];
+			if (opts_.lossy) {
+				yi = quantize(yi, opts_.abs_tol + opts_.rel_tol*std::fabs(yi));
+			}
+			std::uint64_t yb = to_bits(yi);
+			if (in_chunk == 0) {
+				out.write(yb, 64);
+				coders_[i+1].reset(yb);
+			} else {
+				encode(out, coders_[i+1], yb);
+			}
+		}
+		++c.count;
+		++size_;
+	}
+
+	void push_back( double t, const arma::vec &y )
+	{
+		push_back(t, y.memptr(), y.n_elem);
+	}
+
+	/// Stores a state of another scalar type, converted to double.
+	template <typename eT>
+	void push_back( double t, const arma::Col<eT> &y )
+	{
+		push_back(t, arma::conv_to<arma::vec>::from(y));
+	}
+
+	/// Chunk that contains record i.
+	std::size_t chunk_of( std::size_t i ) const
+	{
+		return i / opts_.chunk_records;
+	}
+
+	/// Index of the first record of chunk k.
+	std::size_t chunk_start( std::size_t k ) const
+	{
+		return k * opts_.chunk_records;
+	}
+
+	/// Number of records in chunk k.
+	std::size_t chunk_size( std::size_t k ) const
+	{
+		return chunks_[k].count;
+	}
+
+	/**
+	   \brief Decodes chunk k.
+
+	   \param k  The chunk to decode.
+	   \param t  Receives chunk_size(k) times.
+	   \param y  Receives chunk_size(k) states, stored column-wise.
+	*/
+	void decode_chunk( std::size_t k, double *t, double *y ) const
+	{
+		using namespace compression_impl;
+		assert(k < chunks_.size() && "Chunk index out of bounds!");
+		const chunk &c = chunks_[k];
+		bit_reader in(c.words);
+		std::vector<component_coder> cs(n_rows_ + 1);
+
+		for (std::size_t j = 0; j < c.count; ++j) {
+			double *yj = y + j*n_rows_;
+			for (std::size_t i = 0; i <= n_rows_; ++i) {
+				if (j == 0) {
+					cs[i].reset(in.read(64));
+				} else {
+					decode(in, cs[i]);
+				}
+			}
+			t[j] = from_bits(cs[0].prev);
+			for (std::size_t i = 0; i < n_rows_; ++i) {
+				yj[i] = from_bits(cs[i+1].prev);
+			}
+		}
+	}
+
+	/// Decodes chunk k into a vector of times and a matrix of states.
+	void decode_chunk( std::size_t k, std::vector<double> &t,
+	                   arma::mat &Y ) const
+	{
+		t.resize(chunk_size(k));
+		Y.set_size(n_rows_, chunk_size(k));
+		decode_chunk(k, t.data(), Y.memptr());
+	}
+
+	/// Returns the time of record i.
+	double t( std::size_t i ) const
+	{
+		std::size_t k = chunk_of(i);
+		std::vector<double> ts;
+		arma::mat Y;
+		decode_chunk(k, ts, Y);
+		return ts[i - chunk_start(k)];
+	}
+
+	/// Returns the state of record i.
+	arma::vec y( std::size_t i ) const
+	{
+		std::size_t k = chunk_of(i);
+		std::vector<double> ts;
+		arma::mat Y;
+		decode_chunk(k, ts, Y);
+		return Y.col(i - chunk_start(k));
+	}
+
+	/// Decodes all times.
+	std::vector<double> t_vals() const
+	{
+		std::vector<double> ts(size_);
+		std::vector<double> ys(opts_.chunk_records * n_rows_);
+		for (std::size_t k = 0; k < chunks_.size(); ++k) {
+			decode_chunk(k, ts.data() + chunk_start(k), ys.data());
+		}
+		return ts;
+	}
+
+	/// Decodes all states into one n_rows() x size() matrix.
+	arma::mat to_mat() const
+	{
+		arma::mat Y(n_rows_, size_);
+		std::vector<double> ts(opts_.chunk_records);
+		for (std::size_t k = 0; k < chunks_.size(); ++k) {
+			decode_chunk(k, ts.data(), Y.colptr(chunk_start(k)));
+		}
+		return Y;
+	}
+
+	/// Heap memory held by the compressed data.
+	std::size_t heap_bytes() const
+	{
+		std::size_t b = chunks_.capacity()*sizeof(chunk)
+			+ coders_.capacity()*sizeof(compression_impl::component_coder);
+		for (const chunk &c : chunks_) {
+			b += c.words.capacity()*sizeof(std::uint64_t);
+		}
+		return b;
+	}
+
+	/// Memory the records would take uncompressed.
+	std::size_t raw_bytes() const
+	{
+		return size_*(n_rows_ + 1)*sizeof(double);
+	}
+
+	/// Size of the compressed bit streams in bytes.
+	std::size_t compressed_bytes() const
+	{
+		std::size_t bits = 0;
+		for (const chunk &c : chunks_) bits += c.n_bits;
+		return (bits + 7) / 8;
+	}
+
+private:
+	struct chunk
+	{
+		chunk() : count(0), n_bits(0) {}
+		std::size_t count, n_bits;
+		std::vector<std::uint64_t> words;
+	};
+
+	compression_options opts_;
+	std::size_t n_rows_, size_;
+	std::vector<chunk> chunks_;
+
+	/// Encoder state of the last chunk, time first.
+	std::vector<compression_impl::component_coder> coders_;
+};
+
+
+#endif // COMPRESSED_TRAJECTORY_HPP
@@ -0,0 +1,513 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file ensemble.hpp
+
+   \brief Streaming statistics over ensembles of trajectories.
+
+   The reducer in here keeps running statistics of y(t) on a fixed output
+   grid, so memory is O(grid x Neq) no matter how many trajectories are
+   added to it.
+*/
+
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "arma_include.hpp"
+#include "blas_threads.hpp"
+
+
+/**
+   \namespace ensemble
+   \brief Contains functions for reducing ensembles of solutions.
+*/
+namespace ensemble {
+
+typedef arma::vec vec_type;
+typedef arma::mat mat_type;
+
+
+/**
+   \brief Streaming estimate of a single quantile with the P^2 algorithm
+   of Jain and Chlamtac (1985).
+
+   Uses five markers, so memory is constant in the number of samples.
+*/
+class p2_quantile {
+public:
+	p2_quantile() : p_(0.5), count_(0) { init_increments(); }
+
+	explicit p2_quantile(double p) : p_(p), count_(0)
+	{
+		assert(p > 0.0 && p < 1.0 && "Quantile must be in (0,1)!");
+		init_increments();
+	}
+
+	/// Adds a sample to the estimate.
+	void add(double x)
+	{
+		if (count_ < 5) {
+			q_[count_] = x;
+			++count_;
+			if (count_ == 5) {
+				std::sort(q_, q_ + 5);
+				for (int i = 0; i < 5; ++i) {
+					n_[i] = i;
+				}
+				np_[0] = 0.0;
+				np_[1] = 2.0*p_;
+				np_[2] = 4.0*p_;
+				np_[3] = 2.0 + 2.0*p_;
+				np_[4] = 4.0;
+			}
+			return;
+		}
+
+		int k = 0;
+		if (x < q_[0]) {
+			q_[0] = x;
+			k = 0;
+		} else if (x >= q_[4]) {
+			q_[4] = x;
+			k = 3;
+		} else {
+			while (k < 3 && x >= q_[k+1]) ++k;
+		}
+
+		for (int i = k+1; i < 5; ++i) {
+			n_[i] += 1.0;
+		}
+		for (int i = 0; i < 5; ++i) {
+			np_[i] += dn_[i];
+		}
+		++count_;
+
+		// Adjust the middle markers if they drifted off their
+		// desired positions:
+		for (int i = 1; i < 4; ++i) {
+			double d = np_[i] - n_[i];
+			if ((d >= 1.0 && n_[i+1] - n_[i] > 1.0) ||
+			    (d <= -1.0 && n_[i-1] - n_[i] < -1.0)) {
+				double s = d > 0 ? 1.0 : -1.0;
+				double qs = parabolic(i, s);
+				if (q_[i-1] < qs && qs < q_[i+1]) {
+					q_[i] = qs;
+				} else {
+					q_[i] = linear(i, s);
+				}
+				n_[i] += s;
+			}
+		}
+	}
+
+	/**
+	   \brief Merges another estimate into this one.
+
+	   \note P^2 markers cannot be merged exactly. If both estimates
+	         are past their warm-up, marker heights are averaged
+	         weighted by sample count, which is accurate as long as
+	         both sides sample the same distribution.
+	*/
+	void merge(const p2_quantile &o)
+	{
+		if (o.count_ == 0) return;
+		if (o.count_ < 5) {
+			for (std::size_t i = 0; i < o.count_; ++i) {
+				add(o.q_[i]);
+			}
+			return;
+		}
+		if (count_ < 5) {
+			p2_quantile tmp(o);
+			for (std::size_t i = 0; i < count_; ++i) {
+				tmp.add(q_[i]);
+			}
+			*this = tmp;
+			return;
+		}
+
+		double w1 = count_, w2 = o.count_;
+		double wt = w1 + w2;
+		q_[0] = std::min(q_[0], o.q_[0]);
+		q_[4] = std::max(q_[4], o.q_[4]);
+		for (int i = 1; i < 4; ++i) {
+			q_[i] = (w1*q_[i] + w2*o.q_[i]) / wt;
+		}
+		count_ += o.count_;
+		double N = count_ - 1;
+		for (int i = 0; i < 5; ++i) {
+			n_[i]  = dn_[i]*N;
+			np_[i] = dn_[i]*N;
+		}
+	}
+
+	/// Returns the current estimate of the quantile.
+	double value() const
+	{
+		if (count_ == 0) return 0.0;
+		if (count_ < 5) {
+			double tmp[5];
+			std::copy(q_, q_ + count_, tmp);
+			std::sort(tmp, tmp + count_);
+			std::size_t idx = static_cast<std::size_t>(p_*(count_-1) + 0.5);
+			return tmp[idx];
+		}
+		return q_[2];
+	}
+
+	/// Returns the number of samples seen.
+	std::size_t count() const { return count_; }
+
+private:
+	double p_;
+	std::size_t count_;
+	double q_[5];   ///< Marker heights
+	double n_[5];   ///< Actual marker positions
+	double np_[5];  ///< Desired marker positions
+	double dn_[5];  ///< Increments of the desired positions
+
+	void init_increments()
+	{
+		dn_[0] = 0.0;
+		dn_[1] = 0.5*p_;
+		dn_[2] = p_;
+		dn_[3] = 0.5*(1.0 + p_);
+		dn_[4] = 1.0;
+	}
+
+	double parabolic(int i, double s) const
+	{
+		double a = s / (n_[i+1] - n_[i-1]);
+		double b = (n_[i] - n_[i-1] + s)*(q_[i+1] - q_[i]) / (n_[i+1] - n_[i]);
+		double c = (n_[i+1] - n_[i] - s)*(q_[i] - q_[i-1]) / (n_[i] - n_[i-1]);
+		return q_[i] + a*(b + c);
+	}
+
+	double linear(int i, double s) const
+	{
+		int j = i + static_cast<int>(s);
+		return q_[i] + s*(q_[j] - q_[i]) / (n_[j] - n_[i]);
+	}
+};
+
+
+
+/**
+   \brief Accumulates mean, variance, min, max and quantiles of
+   trajectories sampled on a shared output grid.
+
+   Mean and variance use Welford's update, so they are numerically stable
+   for large ensembles. Reducers filled on different threads can be
+   combined with merge().
+*/
+class reducer {
+public:
+	/**
+	   \param t_eval     The shared output grid (must be increasing).
+	   \param Neq        Number of equations of the ODE.
+	   \param quantiles  Quantiles to track, e.g. { 0.05, 0.5, 0.95 }.
+	*/
+	reducer(const std::vector<double> &t_eval, std::size_t Neq,
+	        const std::vector<double> &quantiles = std::vector<double>())
+		: t_eval_(t_eval), Neq_(Neq), quantiles_(quantiles),
+		  n_(t_eval.size(), 0),
+		  mean_(Neq, t_eval.size(), arma::fill::zeros),
+		  m2_(Neq, t_eval.size(), arma::fill::zeros),
+		  min_(Neq, t_eval.size()),
+		  max_(Neq, t_eval.size()),
+		  n_trajectories_(0)
+	{
+		min_.fill(std::numeric_limits<double>::infinity());
+		max_.fill(-std::numeric_limits<double>::infinity());
+		sketches_.reserve(quantiles.size()*Neq*t_eval.size());
+		for (double q : quantiles) {
+			for (std::size_t i = 0; i < Neq*t_eval.size(); ++i) {
+				sketches_.push_back(p2_quantile(q));
+			}
+		}
+	}
+
+	/**
+	   \brief Adds the sample y at the grid point with index grid_idx.
+	*/
+	void add_sample(std::size_t grid_idx, const vec_type &y)
+	{
+		assert(grid_idx < t_eval_.size() && "Grid index out of range!");
+		assert(y.size() == Neq_ && "Sample has wrong size!");
+
+		double n = ++n_[grid_idx];
+		for (std::size_t j = 0; j < Neq_; ++j) {
+			double yj = y(j);
+			double delta = yj - mean_(j, grid_idx);
+			mean_(j, grid_idx) += delta / n;
+			m2_(j, grid_idx) += delta*(yj - mean_(j, grid_idx));
+			min_(j, grid_idx) = std::min(min_(j, grid_idx), yj);
+			max_(j, grid_idx) = std::max(max_(j, grid_idx), yj);
+		}
+		for (std::size_t k = 0; k < quantiles_.size(); ++k) {
+			for (std::size_t j = 0; j < Neq_; ++j) {
+				sketches_[sketch_index(k, grid_idx, j)].add(y(j));
+			}
+		}
+	}
+
+	/**
+	   \brief Samples a finished solution on the output grid and adds it.
+
+	   Values between stored time points come from the dense output of
+	   the method if the solution has one (see irk::dense_output), and
+	   are linearly interpolated otherwise. Grid points outside the
+	   solved interval are skipped, so a failed solve only contributes
+	   to the points it reached.
+
+	   \param sol  Any solution struct that derives from scalar_output.
+	               Single precision solutions are converted to double.
+	*/
+	template <typename output_type>
+	void add_trajectory(const output_type &sol)
+	{
+		std::size_t Nt = sol.t_vals.size();
+		if (Nt == 0) return;
+
+		std::size_t i = 0;
+		vec_type yi(Neq_);
+		for (std::size_t k = 0; k < t_eval_.size(); ++k) {
+			double tk = t_eval_[k];
+			if (tk < sol.t_vals[0] || tk > sol.t_vals[Nt-1]) continue;
+
+			while (i + 1 < Nt && sol.t_vals[i+1] < tk) ++i;
+
+			if (i + 1 == Nt || sol.t_vals[i] == tk) {
+				yi = arma::conv_to<vec_type>::from(sol.y_vals[i]);
+				add_sample(k, yi);
+				continue;
+			}
+			yi = interpolate(sol, i, tk, 0);
+			add_sample(k, yi);
+		}
+		++n_trajectories_;
+	}
+
+	/**
+	   \brief Merges the statistics of another reducer into this one.
+
+	   Both reducers need to have the same grid, size and quantiles.
+	*/
+	void merge(const reducer &o)
+	{
+		assert(o.t_eval_.size() == t_eval_.size() && o.Neq_ == Neq_ &&
+		       o.quantiles_.size() == quantiles_.size() &&
+		       "Cannot merge reducers of different shape!");
+
+		for (std::size_t k = 0; k < t_eval_.size(); ++k) {
+			double na = n_[k];
+			double nb = o.n_[k];
+			if (nb == 0) continue;
+			double n = na + nb;
+			for (std::size_t j = 0; j < Neq_; ++j) {
+				double delta = o.mean_(j,k) - mean_(j,k);
+				mean_(j,k) += delta*nb / n;
+				m2_(j,k) += o.m2_(j,k) + delta*delta*na*nb / n;
+				min_(j,k) = std::min(min_(j,k), o.min_(j,k));
+				max_(j,k) = std::max(max_(j,k), o.max_(j,k));
+			}
+			n_[k] += o.n_[k];
+		}
+		for (std::size_t i = 0; i < sketches_.size(); ++i) {
+			sketches_[i].merge(o.sketches_[i]);
+		}
+		n_trajectories_ += o.n_trajectories_;
+	}
+
+	/// Returns the mean, one column per grid point.
+	const mat_type &mean() const { return mean_; }
+
+	/// Returns the sample variance, one column per grid point.
+	mat_type variance() const
+	{
+		mat_type var(Neq_, t_eval_.size(), arma::fill::zeros);
+		for (std::size_t k = 0; k < t_eval_.size(); ++k) {
+			if (n_[k] < 2) continue;
+			var.col(k) = m2_.col(k) / (n_[k] - 1.0);
+		}
+		return var;
+	}
+
+	/// Returns the minimum, one column per grid point.
+	const mat_type &min() const { return min_; }
+
+	/// Returns the maximum, one column per grid point.
+	const mat_type &max() const { return max_; }
+
+	/// Returns the estimate of the k-th requested quantile.
+	mat_type quantile(std::size_t k) const
+	{
+		assert(k < quantiles_.size() && "Quantile index out of range!");
+		mat_type q(Neq_, t_eval_.size());
+		for (std::size_t i = 0; i < t_eval_.size(); ++i) {
+			for (std::size_t j = 0; j < Neq_; ++j) {
+				q(j,i) = sketches_[sketch_index(k, i, j)].value();
+			}
+		}
+		return q;
+	}
+
+	/// Returns the number of samples at grid point k.
+	std::size_t count(std::size_t k) const { return n_[k]; }
+
+	/// Returns the number of trajectories added.
+	std::size_t n_trajectories() const { return n_trajectories_; }
+
+	/// Returns the output grid.
+	const std::vector<double> &t_eval() const { return t_eval_; }
+
+	/// Returns a reducer with the same shape but no samples.
+	reducer empty_copy() const
+	{
+		return reducer(t_eval_, Neq_, quantiles_);
+	}
+
+private:
+	std::vector<double> t_eval_;
+	std::size_t Neq_;
+	std::vector<double> quantiles_;
+
+	std::vector<std::size_t> n_;
+	mat_type mean_, m2_, min_, max_;
+	std::vector<p2_quantile> sketches_;
+	std::size_t n_trajectories_;
+
+	std::size_t sketch_index(std::size_t k, std::size_t grid_idx,
+	                         std::size_t j) const
+	{
+		return (k*t_eval_.size() + grid_idx)*Neq_ + j;
+	}
+
+	/// Dense output, for solutions that provide it.
+	template <typename output_type>
+	static auto interpolate(const output_type &sol, std::size_t i, double t,
+	                        int) -> decltype(dense_output(sol, i, t), vec_type())
+	{
+		if (sol.b_interp.n_elem == 0) return interpolate(sol, i, t, 0L);
+		return arma::conv_to<vec_type>::from(dense_output(sol, i, t));
+	}
+
+	/// Linear interpolation between the stored points.
+	template <typename output_type>
+	static vec_type interpolate(const output_type &sol, std::size_t i,
+	                            double t, long)
+	{
+		double ta = sol.t_vals[i];
+		double tb = sol.t_vals[i+1];
+		double theta = (t - ta) / (tb - ta);
+		return arma::conv_to<vec_type>::from(
+			(1.0 - theta)*sol.y_vals[i] + theta*sol.y_vals[i+1]);
+	}
+};
+
+
+
+/**
+   \brief Solves an ensemble in parallel and reduces it on the fly.
+
+   Each worker thread owns its own reducer, so no locking is needed while
+   adding trajectories. The per-thread reducers are merged at the end.
+   A trajectory is dropped as soon as it has been added.
+
+   \param proto      An empty reducer that sets grid, size and quantiles.
+   \param n_traj     Number of trajectories to solve.
+   \param solve_one  Callable with signature output(std::size_t i) that
+                     solves trajectory i. It is called from several threads
+                     at once, so it must not share mutable state.
+   \param n_threads  Number of worker threads (0 means hardware concurrency).
+   \param blas_policy BLAS threads while the workers run (see
+                     blas_threads.hpp). If null, the global default is used.
+                     The blas_policy in the solver options that solve_one
+                     uses does not apply here.
+
+   \returns the reducer with the statistics of all trajectories. If
+   solve_one throws, the remaining trajectories are skipped and the first
+   exception is rethrown once all workers are done.
+*/
+template <typename solve_func> inline
+reducer reduce(const reducer &proto, std::size_t n_traj,
+               solve_func solve_one, unsigned n_threads = 0,
+               const blas_thread_policy *blas_policy = nullptr)
+{
+	if (n_threads == 0) {
+		n_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	std::vector<reducer> partial(n_threads, proto.empty_copy());
+	std::atomic<std::size_t> next(0);
+	std::exception_ptr error;
+	std::mutex error_lock;
+
+	// The trajectories already keep all cores busy:
+	blas_threads::parallel_region region(n_threads, blas_policy);
+	auto worker = [&, n_traj, n_threads](unsigned w)
+	{
+		blas_threads::worker_scope in_worker(n_threads > 1);
+		std::size_t i;
+		try {
+			while ((i = next++) < n_traj) {
+				partial[w].add_trajectory(solve_one(i));
+			}
+		} catch (...) {
+			// An exception escaping a std::thread would terminate:
+			std::lock_guard<std::mutex> lock(error_lock);
+			if (!error) error = std::current_exception();
+			next = n_traj;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned w = 1; w < n_threads; ++w) {
+		threads.emplace_back(worker, w);
+	}
+	worker(0);
+	for (std::thread &th : threads) {
+		th.join();
+	}
+	if (error) std::rethrow_exception(error);
+
+	reducer total = proto.empty_copy();
+	for (const reducer &r : partial) {
+		total.merge(r);
+	}
+	return total;
+}
+
+
+} // namespace ensemble
+
+
+#endif // ENSEMBLE_HPP
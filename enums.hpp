@@ -27,6 +27,8 @@
 #ifndef ENUMS_HPP
 #define ENUMS_HPP
 
+#include <limits>
+
 
 #define FOREACH_MULTISTEP_METHOD(METHOD) \
 	METHOD(ADAMS_BASHFORTH, 10) \
@@ -121,10 +123,40 @@ enum odeint_status_codes {
 	/// The error exceeded the absolute tolerance
 	ERROR_LARGER_THAN_ABSTOL = 64,
 
-	ERROR_MAX_STEPS_EXCEEDED = 128
-	
+	ERROR_MAX_STEPS_EXCEEDED = 128,
+
+	/// Integration stopped early because a steady state was reached
+	STEADY_STATE_REACHED = 256,
+
+	/// A wall time or work budget ran out
+	ERROR_BUDGET_EXCEEDED = 512,
+
+	/// The solve was cancelled through a cancel_token
+	CANCELLED = 1024
+
 };
 
-static constexpr const double machine_precision = 1e-17;
+/**
+   \brief Lower bound for error estimates of a solution in scalar type T.
+
+   Below this the error estimate is rounding noise.
+*/
+template <typename T> constexpr
+double machine_precision_of()
+{
+	return std::numeric_limits<T>::epsilon() / 16;
+}
+
+/**
+   \brief Smallest relative tolerance that a solution in scalar type T
+   can meet.
+*/
+template <typename T> constexpr
+double min_rel_tol()
+{
+	return 10*std::numeric_limits<T>::epsilon();
+}
+
+static constexpr const double machine_precision = machine_precision_of<double>();
 
 #endif // ENUMS_HPP
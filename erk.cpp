@@ -1,3 +1,6 @@
+#include <map>
+#include <utility>
+
 #include "erk.hpp"
 
 
@@ -256,22 +259,49 @@ bool verify_solver_coeffs( const erk::solver_coeffs &sc )
 }
 
 
+namespace {
+
+// Function-local statics are initialized once in a thread-safe way, and
+// the tables are only read afterwards.
+const std::map<int,std::string> &method_to_string_table()
+{
+	static const std::map<int,std::string> table = {
+		FOREACH_ERK_METHOD(GENERATE_STRING)
+	};
+	return table;
+}
+
+const std::map<std::string,int> &string_to_method_table()
+{
+	static const std::map<std::string,int> table = {
+		FOREACH_ERK_METHOD(GENERATE_MAP)
+	};
+	return table;
+}
+
+} // namespace
+
+
 const char *method_to_name( int method )
 {
-	return erk::rk_method_to_string[method].c_str();
+	const std::map<int,std::string> &table = method_to_string_table();
+	auto it = table.find(method);
+	return it == table.end() ? "" : it->second.c_str();
 }
 
 
 int name_to_method( const std::string &name )
 {
-	return erk::rk_string_to_method[name];
+	const std::map<std::string,int> &table = string_to_method_table();
+	auto it = table.find(name);
+	return it == table.end() ? 0 : it->second;
 }
 
 
 std::vector<std::string> all_method_names()
 {
 	std::vector<std::string> methods;
-	for (auto pair : rk_string_to_method){
+	for (auto pair : string_to_method_table()){
 		methods.push_back(pair.first);
 	}
 	return methods;
@@ -298,5 +328,49 @@ vec_type project_b( double theta, const erk::solver_coeffs &sc )
 	return sc.b_interp * ts;
 }
 
+rk_output merge_rk_output( const rk_output &sol1, const rk_output &sol2 )
+{
+	rk_output merger( sol1 );
+	merge_rk_counters( merger, sol2, sol1.t_vals.size(),
+	                   sol2.t_vals.size() );
+
+	merger.t_vals.insert( merger.t_vals.end(),
+	                      sol2.t_vals.begin(), sol2.t_vals.end() );
+	merger.y_vals.append( sol2.y_vals );
+	merger.stages.append( sol2.stages );
+	merger.err_est.append( sol2.err_est );
+	merger.err.insert( merger.err.end(),
+	                   sol2.err.begin(), sol2.err.end() );
+	merger.allocs.set_trajectory_bytes( trajectory_bytes( merger ) );
+
+	return merger;
+}
+
+
+void append_rk_output( rk_output &sol1, rk_output &&sol2 )
+{
+	merge_rk_counters( sol1, sol2, sol1.t_vals.size(),
+	                   sol2.t_vals.size() );
+
+	sol1.t_vals.insert( sol1.t_vals.end(),
+	                    sol2.t_vals.begin(), sol2.t_vals.end() );
+	sol1.y_vals.append( std::move(sol2.y_vals) );
+	sol1.stages.append( std::move(sol2.stages) );
+	sol1.err_est.append( std::move(sol2.err_est) );
+	sol1.err.insert( sol1.err.end(),
+	                 sol2.err.begin(), sol2.err.end() );
+	sol1.allocs.set_trajectory_bytes( trajectory_bytes( sol1 ) );
+
+	sol2.t_vals.clear();
+	sol2.err.clear();
+}
+
+
+rk_output merge_rk_output( rk_output &&sol1, rk_output &&sol2 )
+{
+	append_rk_output( sol1, std::move(sol2) );
+	return std::move(sol1);
+}
+
 
 }
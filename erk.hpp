@@ -38,6 +38,14 @@
 #include "newton.hpp"
 #include "options.hpp"
 #include "output.hpp"
+#include "stage_eval.hpp"
+#include "steady_state.hpp"
+#include "budget.hpp"
+#include "progress.hpp"
+#include "logging.hpp"
+#include "alloc_stats.hpp"
+#include "compressed_trajectory.hpp"
+#include "async_writer.hpp"
 
 
 
@@ -111,38 +119,87 @@ struct solver_options : common_solver_options {
 };
 
 
-static std::map<int,std::string> rk_method_to_string = {
-	FOREACH_ERK_METHOD(GENERATE_STRING)
-};
-
-static std::map<std::string,int> rk_string_to_method = {
-	FOREACH_ERK_METHOD(GENERATE_MAP)
-};
-
-
 /**
    \brief a struct that contains time stamps and stages that can be used for
    constructing the solution all time points in the interval (dense output).
+
+   \tparam real_type  The scalar type the solution was computed in.
 */
-struct rk_output : basic_output
+template <typename real_type>
+struct basic_rk_output : scalar_output<real_type>
 {
 	struct counters {
 		counters() : attempt(0), reject_err(0), fun_evals(0) {}
 
+		counters &operator+=( const counters &o )
+		{
+			attempt    += o.attempt;
+			reject_err += o.reject_err;
+			fun_evals  += o.fun_evals;
+			return *this;
+		}
+
 		std::size_t attempt, reject_err;
 		std::size_t fun_evals;
 	};
 
-	std::vector<vec_type> stages;
+	basic_trajectory<real_type> stages;
 
-	std::vector<vec_type> err_est;
+	basic_trajectory<real_type> err_est;
 	std::vector<double>   err;
 
 	double elapsed_time, accept_frac;
 
 	counters count;
+
+	/// Allocation statistics (see alloc_stats.hpp).
+	alloc_report allocs;
 };
 
+/// The output of the double precision solver.
+typedef basic_rk_output<double> rk_output;
+
+
+/**
+   \brief Returns the heap memory held by the stored trajectory.
+*/
+template <typename real_type> inline
+std::size_t trajectory_bytes(const basic_rk_output<real_type> &sol)
+{
+	using alloc_tracking::heap_bytes;
+	return heap_bytes(sol.t_vals) + sol.y_vals.heap_bytes()
+		+ sol.stages.heap_bytes() + sol.err_est.heap_bytes()
+		+ heap_bytes(sol.err);
+}
+
+
+/**
+   \brief Merges two rk_output structs.
+
+   \param sol1 First rk_output struct.
+   \param sol2 Second rk_output struct.
+
+   \returns a solution struct that contains the merged contents of both.
+*/
+rk_output merge_rk_output( const rk_output &sol1, const rk_output &sol2 );
+
+
+/**
+   \brief Appends sol2 to sol1 without copying the stored vectors.
+
+   The storage of sol2 is moved into sol1, and all counters are merged.
+   sol2 is left without a trajectory.
+*/
+void append_rk_output( rk_output &sol1, rk_output &&sol2 );
+
+
+/**
+   \brief Merges two rk_output structs, re-using their storage.
+
+   \overload merge_rk_output
+*/
+rk_output merge_rk_output( rk_output &&sol1, rk_output &&sol2 );
+
 
 /**
    \brief Returns a vector with all method names.
@@ -227,7 +284,8 @@ vec_type project_b( double theta, const erk::solver_coeffs &sc );
    \param Ks stage matrix
    \param Ns number of stages.
 */
-void apply_fsal(mat_type &Ks, std::size_t Ns)
+template <typename eT> inline
+void apply_fsal(arma::Mat<eT> &Ks, std::size_t Ns)
 {
 	Ks.col(0) = std::move(Ks.col(Ns-1));
 }
@@ -239,11 +297,46 @@ void apply_fsal(mat_type &Ks, std::size_t Ns)
    \param Ks stage matrix
    \param Ns number of stages.
 */
-void no_apply_fsal_dummy(mat_type &Ks, std::size_t Ns)
+template <typename eT> inline
+void no_apply_fsal_dummy(arma::Mat<eT> &Ks, std::size_t Ns)
 { }
 
 
 
+/**
+   \brief Splits the stages from first on into groups of consecutive
+   stages that do not depend on each other.
+
+   \param A      The Butcher tableau matrix.
+   \param first  The first stage to compute.
+   \param batch  If false, every stage gets its own group.
+
+   \returns the first stage of each group, followed by the number of
+            stages.
+*/
+inline std::vector<std::size_t> independent_stage_groups(const mat_type &A,
+                                                         std::size_t first,
+                                                         bool batch)
+{
+	std::size_t Ns = A.n_rows;
+	std::vector<std::size_t> groups;
+	std::size_t start = first;
+	groups.push_back(start);
+	for (std::size_t i = first + 1; i < Ns; ++i) {
+		bool depends = !batch;
+		for (std::size_t j = start; j < i; ++j) {
+			if (A(i,j) != 0.0) depends = true;
+		}
+		if (depends) {
+			start = i;
+			groups.push_back(start);
+		}
+	}
+	if (groups.back() != Ns) groups.push_back(Ns);
+	return groups;
+}
+
+
 /**
    \brief Guts of the explicit RK integrator.
    Time-integrates a given ODE from t0 to t1, starting at y0
@@ -258,23 +351,47 @@ void no_apply_fsal_dummy(mat_type &Ks, std::size_t Ns)
    \param dt           Initial time step size.
    \param sc           Coefficients of the solver.
 
+   The state, the stages and the stored solution are of the scalar type
+   of y0. Time, step size and error norm are always kept in double.
+   The switches in policy (see \ref step_policy) replace the run-time
+   checks of the corresponding options.
+
    \returns an output struct with the solution.
 */
-template <typename functor_type> inline
-rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
-                   const solver_options &solver_opts, double dt,
-                   const solver_coeffs &sc, const output_options &output_opts)
+template <typename policy, typename functor_type, typename real_type> inline
+basic_rk_output<real_type>
+erk_guts_impl(functor_type &func, double t0, double t1,
+              const arma::Col<real_type> &y0, solver_options solver_opts,
+              double dt, const solver_coeffs &sc,
+              const output_options &output_opts)
 {
+	typedef arma::Col<real_type> vec_t;
+	typedef arma::Mat<real_type> mat_t;
+
+	alloc_tracking::phase_tracker alloc_phases;
+	log_sink *log = output_opts.log;
 	if( t0 + dt > t1 ){
-		std::cerr << "    Rehuel: Initial dt (" << dt;
+		REHUEL_LOG(log, REHUEL_LOG_WARNING)
+			<< "    Rehuel: Initial dt (" << dt
+			<< ") too large for interval! Reducing to "
+			<< t1 - t0 << "\n";
 		dt = t1 - t0;
-		std::cerr << ") too large for interval! Reducing to "
-		          << dt << "\n";
 	}
 
-	std::cerr << "    Rehuel: Integrating over interval [ "
-	          << t0 << ", " << t1 << " ]...\n"
-	          << "            Method = " << sc.name << "\n";
+	REHUEL_LOG(log, REHUEL_LOG_INFO)
+		<< "    Rehuel: Integrating over interval [ "
+		<< t0 << ", " << t1 << " ]...\n"
+		<< "            Method = " << sc.name << "\n";
+
+	// Tolerances below the resolution of real_type cannot be met:
+	double min_rtol = min_rel_tol<real_type>();
+	if (policy::adaptive_step && solver_opts.rel_tol < min_rtol) {
+		REHUEL_LOG(log, REHUEL_LOG_WARNING)
+			<< "    Rehuel: rel_tol (" << solver_opts.rel_tol
+			<< ") below the precision of the scalar type! Raising to "
+			<< min_rtol << "\n";
+		solver_opts.rel_tol = min_rtol;
+	}
 
 
 	// Explicit RK methods are a lot simpler.
@@ -282,31 +399,38 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 
 	my_timer timer;
 	double t = t0;
-	rk_output sol;
+	basic_rk_output<real_type> sol;
 	sol.status = SUCCESS;
 
 	assert (dt > 0 && "Cannot use time step size <= 0!");
 	std::size_t Neq = y0.size();
 	std::size_t Ns  = sc.b.size();
 
-	vec_type y = y0;
+	// The weights are applied in the precision of the state:
+	vec_t b  = arma::conv_to<vec_t>::from(sc.b);
+	vec_t b2 = arma::conv_to<vec_t>::from(sc.b2);
+
+	vec_t y = y0;
 	// Ks is the stages at the new time step.
-	mat_type Ks(Neq,Ns);
+	mat_t Ks(Neq,Ns);
 	long long int step = 0;
 	// For time step size control.
 	double dts[3] = {dt, dt, dt}, errs[3] = {0.9,0.9,0.9};
 
 	if (solver_opts.out_interval > 0){
-		std::cerr  << "    Rehuel: step  t  dt   err\n";
+		REHUEL_LOG(log, REHUEL_LOG_INFO)
+			<< "    Rehuel: step  t  dt   err\n";
 	}
 
 	double err = 0.0;
-	vec_type err_est = arma::zeros(Neq);
+	vec_t err_est(Neq, arma::fill::zeros);
 	sol.t_vals.push_back(t);
 	sol.y_vals.push_back(y);
 	sol.stages.push_back(vectorise(Ks));
 	sol.err_est.push_back( err_est );
 	sol.err.push_back( err );
+	if (output_opts.compressed) output_opts.compressed->push_back(t, y);
+	step_writer file_out(output_opts, Neq);
 
 	// This will keep track of error estimates during integration.
 	std::size_t min_order = std::min( sc.order, sc.order2 );
@@ -314,54 +438,105 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 	// If your method has FSAL, you never have to compute the first stage
 	// after the first step.
 	std::size_t stage_iter_start = 0;
-	auto fsal_hook_fptr = no_apply_fsal_dummy;
+	auto fsal_hook_fptr = no_apply_fsal_dummy<real_type>;
 
 	// By wrapping the function call in this lambda, you can more easily
 	// count the number of function evaluations.
-	auto eval_fun = [&func,&sol](double t, const vec_type &Y)
+	auto eval_fun = [&func,&sol](double t, const vec_t &Y)
 	                { ++sol.count.fun_evals; return func.fun(t, Y); };
 	if (sc.FSAL) {
 		stage_iter_start = 1;
 		Ks.col(0) = eval_fun(t, y0);
-		fsal_hook_fptr = apply_fsal;
+		fsal_hook_fptr = apply_fsal<real_type>;
 	}
 
+	// Stages that do not depend on each other are evaluated together
+	// if the functor can do that (see stage_eval.hpp):
+	std::vector<std::size_t> stage_groups = independent_stage_groups(
+		sc.A, stage_iter_start, has_fun_stages<functor_type, real_type>::value);
+
+	std::vector<double> tstops = active_tstops(solver_opts, t0, t1);
+	std::size_t next_stop = 0;
+	double dt_before_stop = dt;
+	steady_state_monitor steady(solver_opts);
+	budget_monitor budget(solver_opts);
+	publish_progress(solver_opts.progress, t0, t1, t, dt, 0, 0, 0,
+	                 sol.count.fun_evals);
+
+	alloc_phases.end_setup();
 	while (t < t1) {
+		alloc_phases.begin_step();
 		// ****************  Calculate stages:   ************
 		// Make sure you stop exactly at t = t1.
 		if( t + dt > t1 ){
 			dt = t1 - t;
 		}
+		// Land exactly on the next stop point. Steps that would end
+		// just short of it are stretched a tiny bit instead.
+		bool at_stop = false, stop_reached = false;
+		if (next_stop < tstops.size() &&
+		    t + dt*(1.0 + 1e-10) >= tstops[next_stop]) {
+			dt_before_stop = dt;
+			dt = tstops[next_stop] - t;
+			at_stop = true;
+		}
 		sol.count.attempt++;
 
 		if (solver_opts.max_steps >= 0 &&
 		    step > solver_opts.max_steps) {
-			std::cerr << "    Rehuel: Maximum number of attempts exceeded.\n";
+			REHUEL_LOG(log, REHUEL_LOG_ERROR)
+				<< "    Rehuel: Maximum number of attempts exceeded.\n";
 			sol.status = ERROR_MAX_STEPS_EXCEEDED;
-			return sol;
+			break;
+		}
+
+		// Stop with partial results if the budget ran out:
+		int budget_status = budget.check(sol.count.fun_evals, 0);
+		if (budget_status != SUCCESS) {
+			sol.status = budget_status;
+			break;
 		}
 
 		int integrator_status = 0;
 
 		// Formula for explicit stages are
 		// k_i = f(t + ci*dt, y0 + sum_{j=1}^{i-1} A(i,j)*k_j)
-		for (std::size_t i = stage_iter_start; i < Ns; ++i) {
-			vec_type tmp = y;
-			for (std::size_t j = 0; j < i; ++j) {
-				tmp += dt*sc.A(i,j)*Ks.col(j);
+		for (std::size_t g = 0; g + 1 < stage_groups.size(); ++g) {
+			std::size_t i0 = stage_groups[g], i1 = stage_groups[g+1];
+			if (i1 - i0 == 1) {
+				vec_t tmp = y;
+				for (std::size_t j = 0; j < i0; ++j) {
+					tmp += dt*sc.A(i0,j)*Ks.col(j);
+				}
+				Ks.col(i0) = eval_fun(t + sc.c(i0)*dt, tmp);
+				continue;
+			}
+
+			vec_type ts(i1 - i0);
+			mat_t Ys(Neq, i1 - i0);
+			for (std::size_t i = i0; i < i1; ++i) {
+				vec_t tmp = y;
+				for (std::size_t j = 0; j < i0; ++j) {
+					tmp += dt*sc.A(i,j)*Ks.col(j);
+				}
+				Ys.col(i - i0) = tmp;
+				ts(i - i0) = t + sc.c(i)*dt;
 			}
-			Ks.col(i) = eval_fun(t + sc.c(i)*dt, tmp);
+			// Writes straight into the columns of Ks:
+			mat_t Fs(Ks.colptr(i0), Neq, i1 - i0, false, true);
+			eval_stages(func, ts, Ys, Fs);
+			sol.count.fun_evals += i1 - i0;
 		}
 
 		// ************* Form solution at t + dt: ***********
-		vec_type delta_y = Ks*sc.b;
-		vec_type y_n     = y + dt*delta_y;
+		vec_t delta_y    = Ks*b;
+		vec_t y_n        = y + dt*delta_y;
 		double new_dt    = dt;
 
 		// If you have no adaptive step size, error calculation
 		// might not be very sensible.
-		if (solver_opts.adaptive_step_size) {
-			vec_type delta_alt = Ks*sc.b2;
+		if (policy::adaptive_step) {
+			vec_t delta_alt = Ks*b2;
 
 			// ************* Error estimate: ***********
 			double err_tot = 0.0;
@@ -380,8 +555,8 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 			err = std::sqrt(err_tot / n);
 			assert( err_tot >= 0.0 && "Error cannot be negative!" );
 
-			if (err < machine_precision) {
-				err = machine_precision;
+			if (err < machine_precision_of<real_type>()) {
+				err = machine_precision_of<real_type>();
 			}
 			errs[2] = errs[1];
 			errs[1] = errs[0];
@@ -391,7 +566,7 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 			// TODO: This might need optimization geared
 			//       to explicit methods.
 			// Error is too large to tolerate:
-			if (solver_opts.adaptive_step_size && (err >= 1.0)) {
+			if (err >= 1.0) {
 				integrator_status = 1;
 				sol.count.reject_err++;
 			}
@@ -417,45 +592,101 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 		// ********************* Output if user requested **************
 		if (solver_opts.out_interval > 0 &&
 		    (step % solver_opts.out_interval == 0) ) {
-			std::cerr << "    Rehuel: " << step << " " << t
-			          << " " <<  dt << " " << err << "\n";
+			REHUEL_LOG(log, REHUEL_LOG_INFO)
+				<< "    Rehuel: " << step << " " << t
+				<< " " <<  dt << " " << err << "\n";
 		}
 
 		if (output_opts.write_to_file()) {
-			*output_opts.output_stream << t;
-			for (std::size_t y_idx = 0; y_idx < y_n.size(); ++y_idx) {
-				*output_opts.output_stream << " " << y_n[y_idx];
-			}
-			*output_opts.output_stream << "\n";
+			file_out.write(t, y_n);
 		}
 
 		// ********************* Update y and time ***************
-		if (!solver_opts.adaptive_step_size || integrator_status == 0) {
+		if (!policy::adaptive_step || integrator_status == 0) {
 			y  = y_n;
 			t += dt;
 			++step;
-
-			sol.t_vals.push_back(t);
-			sol.y_vals.push_back(y_n);
-			// Since K is a matrix, it needs to be flattened:
-			sol.stages.push_back(arma::vectorise(Ks));
-			sol.err_est.push_back(err_est);
-			sol.err.push_back(err);
+			if (at_stop) {
+				t = tstops[next_stop++];
+				stop_reached = true;
+			}
+			publish_progress(solver_opts.progress, t0, t1, t, dt, step,
+			                 sol.count.attempt, sol.count.reject_err,
+			                 sol.count.fun_evals);
+
+			alloc_phases.begin_output();
+			if (policy::store_solution) {
+				sol.t_vals.push_back(t);
+				sol.y_vals.push_back(y_n);
+				// Since K is a matrix, it needs to be flattened:
+				sol.stages.push_back(arma::vectorise(Ks));
+				sol.err_est.push_back(err_est);
+				sol.err.push_back(err);
+			}
+			if (output_opts.compressed) {
+				output_opts.compressed->push_back(t, y_n);
+			}
+			alloc_phases.end_output();
 
 			// If you reach here, your new time step has been
 			// accepted and your last stage can now be uesd
 			// as your first stage:
 			fsal_hook_fptr(Ks, Ns);
+
+			if (steady.enabled()) {
+				// With FSAL, f at the new state is already known.
+				vec_t f_n = sc.FSAL ? vec_t(Ks.col(0))
+				                    : vec_t(eval_fun(t, y));
+				if (steady.update(f_n, y, dt, new_dt)) {
+					if (solver_opts.steady_state_jump && t < t1 &&
+					    policy::store_solution) {
+						sol.t_vals.push_back(t1);
+						sol.y_vals.push_back(y);
+						sol.stages.push_back(arma::vectorise(Ks));
+						sol.err_est.push_back(err_est);
+						sol.err.push_back(err);
+					}
+					if (solver_opts.steady_state_jump && t < t1 &&
+					    output_opts.compressed) {
+						output_opts.compressed->push_back(t1, y);
+					}
+					sol.status = STEADY_STATE_REACHED;
+					break;
+				}
+			}
 		}
 
 		// **************** Set the new time step size. *********************
-		if (solver_opts.adaptive_step_size) {
+		if (policy::adaptive_step) {
 			dt = new_dt;
 		}
 		dts[2] = dts[1];
 		dts[1] = dts[0];
 		dts[0] = dt;
+
+		if (stop_reached) {
+			// Restart after the discontinuity. The FSAL stage is
+			// f at the left limit, so evaluate it again.
+			dt = solver_opts.tstop_dt > 0 ? solver_opts.tstop_dt
+			                              : dt_before_stop;
+			if (solver_opts.max_dt > 0) {
+				dt = std::min(solver_opts.max_dt, dt);
+			}
+			dts[0] = dts[1] = dts[2] = dt;
+			errs[0] = errs[1] = errs[2] = 0.9;
+			if (sc.FSAL) {
+				Ks.col(0) = eval_fun(t, y);
+			}
+		}
 	}
+	std::size_t dropped = file_out.finish();
+	if (dropped > 0) {
+		REHUEL_LOG(log, REHUEL_LOG_WARNING)
+			<< "Rehuel: output writer dropped " << dropped
+			<< " records\n";
+	}
+
+	sol.allocs = alloc_phases.finish(trajectory_bytes(sol));
 	double elapsed = timer.toc();
 	sol.elapsed_time = elapsed;
 	sol.accept_frac = static_cast<double>(step) / sol.count.attempt;
@@ -463,6 +694,41 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 }
 
 
+/**
+   \brief Guts of the explicit RK integrator.
+
+   Picks the instantiation of erk_guts_impl that matches the options.
+   The explicit solver does not time its internals.
+*/
+template <typename functor_type, typename real_type> inline
+basic_rk_output<real_type>
+erk_guts(functor_type &func, double t0, double t1,
+         const arma::Col<real_type> &y0, const solver_options &solver_opts,
+         double dt, const solver_coeffs &sc,
+         const output_options &output_opts)
+{
+	int policy_bits = 0;
+	policy_bits += 1 * ( solver_opts.adaptive_step_size == true );
+	policy_bits += 2 * ( output_opts.store_in_vectors() == true );
+
+	switch(policy_bits){
+	default:
+	case 0:
+		return erk_guts_impl<step_policy<0, 0, 0> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 1:
+		return erk_guts_impl<step_policy<1, 0, 0> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 2:
+		return erk_guts_impl<step_policy<0, 0, 1> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 3:
+		return erk_guts_impl<step_policy<1, 0, 1> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	}
+}
+
+
 /**
    \brief Time-integrate a given ODE from t0 to t1, starting at y0
 
@@ -477,21 +743,67 @@ rk_output erk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 
    \returns a status code (see \ref odeint_status_codes)
 */
-template <typename functor_type> inline
-rk_output odeint(functor_type &func, double t0, double t1, const vec_type &y0,
-                 solver_options solver_opts, const output_options &output_opts,
-                 int method = erk::DORMAND_PRINCE_54, double dt = 1e-6)
+template <typename functor_type, typename real_type> inline
+basic_rk_output<real_type>
+odeint_scalar(functor_type &func, double t0, double t1,
+              const arma::Col<real_type> &y0, solver_options solver_opts,
+              const output_options &output_opts,
+              int method = erk::DORMAND_PRINCE_54, double dt = 1e-6)
 {
 	solver_coeffs sc = get_coefficients(method);
 	if (solver_opts.adaptive_step_size && sc.b2.size() == 0) {
-		output_opts.log_out << "    Rehuel: WARNING: Cannot have adaptive time "
-		          << "step with non-embedding method! Disabling "
-		          << "adaptive time step size!\n";
+		REHUEL_LOG(output_opts.log, REHUEL_LOG_WARNING)
+			<< "    Rehuel: WARNING: Cannot have adaptive time "
+			<< "step with non-embedding method! Disabling "
+			<< "adaptive time step size!\n";
 		solver_opts.adaptive_step_size = false;
 	}
 
 	assert (verify_solver_coeffs(sc) && "Invalid solver coefficients!");
-	return erk_guts(func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	basic_rk_output<real_type> sol = erk_guts(func, t0, t1, y0, solver_opts,
+	                                          dt, sc, output_opts);
+	if (solver_opts.progress) solver_opts.progress->mark_done();
+	return sol;
+}
+
+
+/**
+   \brief Time-integrate a given ODE from t0 to t1, starting at y0
+
+   \overload odeint_scalar
+*/
+template <typename functor_type> inline
+rk_output odeint(functor_type &func, double t0, double t1, const vec_type &y0,
+                 solver_options solver_opts, const output_options &output_opts,
+                 int method = erk::DORMAND_PRINCE_54, double dt = 1e-6)
+{
+	return odeint_scalar(func, t0, t1, y0, solver_opts, output_opts,
+	                     method, dt);
+}
+
+
+/**
+   \brief Time-integrate a given ODE in single precision.
+
+   The functor should provide
+   \code{
+     arma::fvec fun(double t, const arma::fvec &y);
+   \code}
+   Time and step size stay in double precision. rel_tol is raised to
+   min_rel_tol<float>() if it is lower.
+
+   \overload odeint_scalar
+*/
+template <typename functor_type> inline
+basic_rk_output<float> odeint(functor_type &func, double t0, double t1,
+                              const arma::fvec &y0,
+                              solver_options solver_opts,
+                              const output_options &output_opts,
+                              int method = erk::DORMAND_PRINCE_54,
+                              double dt = 1e-6)
+{
+	return odeint_scalar(func, t0, t1, y0, solver_opts, output_opts,
+	                     method, dt);
 }
 
 
@@ -198,7 +198,7 @@ void print_output(const rk_output &sol)
 	std::size_t n_times = sol.t_vals.size();
 	for (std::size_t n = 0; n < n_times; ++n) {
 		std::cout << sol.t_vals[n];
-		std::size_t n_ys = sol.y_vals[n].size();
+		std::size_t n_ys = sol.y_vals[n].n_elem;
 		for (std::size_t j = 0; j < n_ys; ++j) {
 			std::cout << " " << sol.y_vals[n](j);
 		}
@@ -268,6 +268,8 @@ template <typename functor_type>
 int int_equation(functor_type &F, const user_options &u_opts, vec_type Y0)
 {
 	output_options output_opts;
+	stream_sink log(std::cerr, REHUEL_LOG_INFO);
+	output_opts.log = &log;
 	std::ofstream output_file_stream;
 	if (!u_opts.output_fname.empty()) {
 		std::cerr << "Writing to file\n";
@@ -39,9 +39,9 @@ public:
 	typedef arma::mat jac_type;
 
 	/// Evaluates the RHS of the differential equation.
-	virtual arma::vec fun( double t, const vec_type &y ) = 0;
+	virtual arma::vec fun( double t, const arma::vec &y ) = 0;
 	/// Evaluates the Jacobi matrix of the ODE RHS.
-	virtual jac_type jac( double t, const vec_type &y ) = 0;
+	virtual jac_type jac( double t, const arma::vec &y ) = 0;
 
 	/**
 	   \brief calculates the ordinary differential equation's
@@ -64,7 +64,7 @@ public:
 	   
 	   \returns    The RHS of the ODE
 	*/
-	virtual arma::vec compute(double t, const vec_type &y,
+	virtual arma::vec compute(double t, const arma::vec &y,
 	                          jac_type &J, bool calc_J)
 	{
 		if (calc_J) J = jac(t, y);
@@ -1,5 +1,8 @@
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <string>
+#include <utility>
 
 #include "irk.hpp"
 
@@ -108,6 +111,17 @@ bool verify_solver_coeffs( const solver_coeffs &sc )
 }
 
 
+bool is_method_stiffly_accurate( const solver_coeffs &sc )
+{
+	std::size_t Ns = sc.b.size();
+	if( Ns == 0 || sc.A.n_rows != Ns ) return false;
+	for( std::size_t j = 0; j < Ns; ++j ){
+		if( std::fabs( sc.A(Ns-1,j) - sc.b(j) ) > 1e-14 ) return false;
+	}
+	return true;
+}
+
+
 mat_type collocation_interpolate_coeffs( const vec_type& c )
 {
 	// Interpolates on a solution interval as
@@ -698,22 +712,49 @@ bool verify_solver_options( solver_options &opts )
 }
 
 
+namespace {
+
+// Function-local statics are initialized once in a thread-safe way, and
+// the tables are only read afterwards.
+const std::map<int,std::string> &method_to_string_table()
+{
+	static const std::map<int,std::string> table = {
+		FOREACH_IRK_METHOD(GENERATE_STRING)
+	};
+	return table;
+}
+
+const std::map<std::string,int> &string_to_method_table()
+{
+	static const std::map<std::string,int> table = {
+		FOREACH_IRK_METHOD(GENERATE_MAP)
+	};
+	return table;
+}
+
+} // namespace
+
+
 const char *method_to_name( int method )
 {
-	return irk::rk_method_to_string[method].c_str();
+	const std::map<int,std::string> &table = method_to_string_table();
+	auto it = table.find(method);
+	return it == table.end() ? "" : it->second.c_str();
 }
 
 
 int name_to_method( const std::string &name )
 {
-	return irk::rk_string_to_method[name];
+	const std::map<std::string,int> &table = string_to_method_table();
+	auto it = table.find(name);
+	return it == table.end() ? 0 : it->second;
 }
 
 
 std::vector<std::string> all_method_names()
 {
 	std::vector<std::string> methods;
-	for( auto pair : rk_string_to_method ){
+	for( auto pair : string_to_method_table() ){
 		methods.push_back( pair.first );
 	}
 	return methods;
@@ -723,8 +764,13 @@ std::vector<std::string> all_method_names()
 vec_type project_b( double theta, const irk::solver_coeffs &sc )
 {
 	assert( sc.b_interp.size() > 0 && "Chosen method does not have dense output!" );
+	return project_b( theta, sc.b_interp );
+}
 
-	std::size_t Ns = sc.b.size();
+
+vec_type project_b( double theta, const mat_type &b_interp )
+{
+	std::size_t Ns = b_interp.n_rows;
         vec_type ts(Ns);
 
 	// ts will contain { t, t^2, t^3, ..., t^{Ns} }
@@ -734,47 +780,82 @@ vec_type project_b( double theta, const irk::solver_coeffs &sc )
 		ts(j) = tt;
 		tt *= theta;
 	}
-	// Now bs = sc.b_interp * ts;
-        return sc.b_interp * ts;
+	// Now bs = b_interp * ts;
+        return b_interp * ts;
 }
 
 
+namespace {
+
+/// Dense output only stays valid if both parts have it.
+void merge_b_interp( rk_output &merger, const rk_output &sol2 )
+{
+	if( merger.t_vals.empty() ){
+		merger.b_interp = sol2.b_interp;
+	}else if( !arma::approx_equal( merger.b_interp, sol2.b_interp,
+	                               "absdiff", 0.0 ) ){
+		// Different methods, even with the same number of stages,
+		// have different interpolants, so neither one fits all steps:
+		merger.b_interp.reset();
+	}
+}
+
+} // namespace
+
+
 rk_output merge_rk_output( const rk_output &sol1, const rk_output &sol2 )
 {
 	rk_output merger( sol1 );
-	merger.status |= sol2.status;
+	merge_rk_counters( merger, sol2, sol1.t_vals.size(),
+	                   sol2.t_vals.size() );
+	merge_b_interp( merger, sol2 );
 
 	merger.t_vals.insert( merger.t_vals.end(),
 	                      sol2.t_vals.begin(), sol2.t_vals.end() );
-	merger.y_vals.insert( merger.y_vals.end(),
-	                      sol2.y_vals.begin(), sol2.y_vals.end() );
-	merger.stages.insert( merger.stages.end(),
-	                      sol2.stages.begin(), sol2.stages.end() );
-	merger.err_est.insert( merger.err_est.end(),
-	                       sol2.err_est.begin(), sol2.err_est.end() );
+	merger.y_vals.append( sol2.y_vals );
+	merger.stages.append( sol2.stages );
+	merger.err_est.append( sol2.err_est );
 	merger.err.insert( merger.err.end(),
 	                   sol2.err.begin(), sol2.err.end() );
-
-	merger.elapsed_time += sol2.elapsed_time;
-	double steps1 = sol1.t_vals.size();
-	double steps2 = sol2.t_vals.size();
-	double total_steps = steps1 + steps2;
-	merger.accept_frac = steps1*sol1.accept_frac + steps2*sol2.accept_frac;
-	merger.accept_frac /= total_steps;
-
-	merger.count.attempt += sol2.count.attempt;
-	merger.count.reject_newton += sol2.count.reject_newton;
-	merger.count.reject_err += sol2.count.reject_err;
-	merger.count.newton_success += sol2.count.newton_success;
-	merger.count.newton_incr_diverge += sol2.count.newton_incr_diverge;
-	merger.count.newton_iter_error_too_large +=
-		sol2.count.newton_iter_error_too_large;
-	merger.count.newton_maxit_exceed += sol2.count.newton_maxit_exceed;
+	merger.sens_vals.insert( merger.sens_vals.end(),
+	                         sol2.sens_vals.begin(), sol2.sens_vals.end() );
+	merger.allocs.set_trajectory_bytes( trajectory_bytes( merger ) );
 
 	return merger;
 }
 
 
+void append_rk_output( rk_output &sol1, rk_output &&sol2 )
+{
+	merge_rk_counters( sol1, sol2, sol1.t_vals.size(),
+	                   sol2.t_vals.size() );
+	merge_b_interp( sol1, sol2 );
+
+	sol1.t_vals.insert( sol1.t_vals.end(),
+	                    sol2.t_vals.begin(), sol2.t_vals.end() );
+	sol1.y_vals.append( std::move(sol2.y_vals) );
+	sol1.stages.append( std::move(sol2.stages) );
+	sol1.err_est.append( std::move(sol2.err_est) );
+	sol1.err.insert( sol1.err.end(),
+	                 sol2.err.begin(), sol2.err.end() );
+	sol1.sens_vals.insert( sol1.sens_vals.end(),
+	                       std::make_move_iterator(sol2.sens_vals.begin()),
+	                       std::make_move_iterator(sol2.sens_vals.end()) );
+	sol1.allocs.set_trajectory_bytes( trajectory_bytes( sol1 ) );
+
+	sol2.t_vals.clear();
+	sol2.err.clear();
+	sol2.sens_vals.clear();
+}
+
+
+rk_output merge_rk_output( rk_output &&sol1, rk_output &&sol2 )
+{
+	append_rk_output( sol1, std::move(sol2) );
+	return std::move(sol1);
+}
+
+
 
 void restore_state( const rk_output &sol, double &t, vec_type &y, vec_type &K,
                     vec_type &err_est, double errs[3], double dts[3] )
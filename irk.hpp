@@ -39,6 +39,17 @@
 #include "newton.hpp"
 #include "options.hpp"
 #include "output.hpp"
+#include "sensitivity.hpp"
+#include "stage_eval.hpp"
+#include "steady_state.hpp"
+#include "budget.hpp"
+#include "progress.hpp"
+#include "logging.hpp"
+#include "alloc_stats.hpp"
+#include "compressed_trajectory.hpp"
+#include "async_writer.hpp"
+#include "blas_threads.hpp"
+#include "block_jacobian.hpp"
 
 
 /**
@@ -103,7 +114,9 @@ struct solver_options : common_solver_options {
 	solver_options() : adaptive_step_size(true),
 	                   use_newton_iters_adaptive_step(true),
 	                   verbose_newton(false),
-	                   extrapolate_stage(false)
+	                   extrapolate_stage(false),
+	                   mass_matrix(nullptr),
+	                   block_threads(1)
 	{ }
 
 	~solver_options()
@@ -121,15 +134,19 @@ struct solver_options : common_solver_options {
 
 	/// If true, use the current stages and extrapolate to the next time level.
 	bool extrapolate_stage;
-};
-
 
-static std::map<int,std::string> rk_method_to_string = {
-	FOREACH_IRK_METHOD(GENERATE_STRING)
-};
-
-static std::map<std::string,int> rk_string_to_method = {
-	FOREACH_IRK_METHOD(GENERATE_MAP)
+	/// If set, solve M*y' = f(t,y) with this constant mass matrix.
+	/// M may be singular (index-1 DAEs), in which case the method has to
+	/// be stiffly accurate (Radau IIA, Lobatto IIIC) and the initial
+	/// values have to be consistent.
+	const mat_type *mass_matrix;
+
+	/// Number of threads that factor the blocks of a block-diagonal
+	/// Jacobi matrix (see block_jacobian.hpp). 0 means hardware
+	/// concurrency. This is an upper bound; systems too small to
+	/// benefit are factored on fewer threads, or on the calling one.
+	/// Has no effect for dense Jacobi matrices.
+	unsigned block_threads;
 };
 
 
@@ -146,6 +163,20 @@ struct rk_output : basic_output
 		             newton_maxit_exceed(0),
 		             fun_evals(0), jac_evals(0) {}
 
+		counters &operator+=( const counters &o )
+		{
+			attempt += o.attempt;
+			reject_newton += o.reject_newton;
+			reject_err += o.reject_err;
+			newton_success += o.newton_success;
+			newton_incr_diverge += o.newton_incr_diverge;
+			newton_iter_error_too_large += o.newton_iter_error_too_large;
+			newton_maxit_exceed += o.newton_maxit_exceed;
+			fun_evals += o.fun_evals;
+			jac_evals += o.jac_evals;
+			return *this;
+		}
+
 		std::size_t attempt, reject_newton, reject_err;
 
 		std::size_t newton_success, newton_incr_diverge,
@@ -153,16 +184,41 @@ struct rk_output : basic_output
 		std::size_t fun_evals, jac_evals;
 	};
 
-	std::vector<vec_type> stages;
-	std::vector<vec_type> err_est;
+	/// The stages dt*k_j of the step that ended at t_vals[i], one
+	/// Neq-block per stage. Only filled if b_interp is set.
+	trajectory stages;
+	trajectory err_est;
 	std::vector<double>   err;
 
+	/// Forward sensitivities at t_vals, only if solver_opts.sens_opts is set.
+	std::vector<mat_type> sens_vals;
+
+	/// Interpolation coefficients of the method for dense output (see
+	/// dense_output). Empty if the method has no dense output or if not
+	/// every step was stored (output_interval > 1).
+	mat_type b_interp;
+
 	double elapsed_time, accept_frac;
 
 	counters count;
+
+	/// Allocation statistics (see alloc_stats.hpp).
+	alloc_report allocs;
 };
 
 
+/**
+   \brief Returns the heap memory held by the stored trajectory.
+*/
+inline std::size_t trajectory_bytes(const rk_output &sol)
+{
+	using alloc_tracking::heap_bytes;
+	return heap_bytes(sol.t_vals) + sol.y_vals.heap_bytes()
+		+ sol.stages.heap_bytes() + sol.err_est.heap_bytes()
+		+ heap_bytes(sol.err) + heap_bytes(sol.sens_vals);
+}
+
+
 /**
    \brief Merges two rk_output structs.
 
@@ -174,6 +230,26 @@ struct rk_output : basic_output
 rk_output merge_rk_output( const rk_output &sol1, const rk_output &sol2 );
 
 
+/**
+   \brief Appends sol2 to sol1 without copying the stored vectors.
+
+   The storage of sol2 is moved into sol1, and all counters are merged.
+   sol2 is left without a trajectory.
+
+   \param sol1 The rk_output struct to append to.
+   \param sol2 The rk_output struct to append.
+*/
+void append_rk_output( rk_output &sol1, rk_output &&sol2 );
+
+
+/**
+   \brief Merges two rk_output structs, re-using their storage.
+
+   \overload merge_rk_output
+*/
+rk_output merge_rk_output( rk_output &&sol1, rk_output &&sol2 );
+
+
 /**
    \brief Returns a vector with all method names.
 */
@@ -235,6 +311,13 @@ bool is_method_dirk( const solver_coeffs &sc );
 bool is_method_sdirk( const solver_coeffs &sc );
 
 
+/**
+   \brief Checks if the given method is stiffly accurate, i.e., if the
+   last row of A equals b. Only those methods can solve DAEs.
+*/
+bool is_method_stiffly_accurate( const solver_coeffs &sc );
+
+
 /**
    \brief Returns default solver options.
    \returns default solver options.
@@ -278,6 +361,37 @@ const char *method_to_name( int method );
 vec_type project_b( double theta, const irk::solver_coeffs &sc );
 
 
+/**
+   \brief evaluates the weight functions of the interpolation matrix
+   b_interp to given theta.
+
+   \overload project_b
+*/
+vec_type project_b( double theta, const mat_type &b_interp );
+
+
+/**
+   \brief Evaluates the dense output of sol at time t.
+
+   Uses the interpolating polynomial of the step from t_vals[i] to
+   t_vals[i+1], so t should lie in between those. Requires b_interp.
+*/
+inline vec_type dense_output(const rk_output &sol, std::size_t i, double t)
+{
+	assert(i + 1 < sol.t_vals.size() && "Index out of range!");
+	assert(sol.b_interp.n_elem > 0 && "Solution has no dense output!");
+
+	vec_type y = sol.y_vals[i];
+	double h = sol.t_vals[i+1] - sol.t_vals[i];
+	if (h <= 0.0) return y;
+
+	std::size_t Ns = sol.b_interp.n_rows;
+	vec_type K = sol.stages[i+1];
+	mat_type Ks(K.memptr(), y.n_elem, Ns, false, true);
+	return y + Ks*project_b((t - sol.t_vals[i]) / h, sol.b_interp);
+}
+
+
 /**
    \brief expands the coefficient lists.
 
@@ -361,31 +475,257 @@ inline void print_timing_breakdown(const std::vector<double> &timings,
 
 /**
    \brief Construct the residual vector of the non-linear systme to solve.
+
+   \param mass  If not null, the residual is kron(I,M)*Y - dt*kron(A,I)*F.
 */
 template <typename functor_type> inline
 arma::vec construct_R(functor_type &func,
                       const vec_type &y, double t, double dt,
                       const solver_coeffs &sc, const vec_type &Y,
-                      const mat_type &I_neq)
+                      const mat_type &I_neq, const mat_type *mass = nullptr)
 {
 	vec_type F(Y.size());
 	std::size_t Ns = sc.b.size();
 	std::size_t Neq = y.size();
-	vec_type e = arma::ones(Ns);
-	arma::vec R = Y;
-	for (std::size_t i = 0; i < Ns; ++i) {
-		std::size_t i0 = Neq*i;
-		std::size_t i1 = i0 + Neq - 1;
+	arma::vec R;
+	if (mass) {
+		R = arma::vectorise((*mass)*arma::reshape(Y, Neq, Ns));
+	} else {
+		R = Y;
+	}
 
-		auto Yi = Y.subvec(i0,i1);
-		F.subvec(i0, i1) = func.fun(t + sc.c(i)*dt, y + Yi);
+	// All stages are evaluated in one go, see stage_eval.hpp.
+	vec_type ts(Ns);
+	mat_type Ys = arma::reshape(Y, Neq, Ns);
+	for (std::size_t i = 0; i < Ns; ++i) {
+		ts(i) = t + sc.c(i)*dt;
+		Ys.col(i) += y;
 	}
+	// Writes straight into F:
+	mat_type Fs(F.memptr(), Neq, Ns, false, true);
+	eval_stages(func, ts, Ys, Fs);
+
 	R -= dt*arma::kron(sc.A, I_neq)*F;
 	return R;
 }
 
 
 
+/**
+   \brief LU decomposition of the stage iteration matrix I - dt*kron(A, J).
+
+   Keeping it around allows re-using it for other linear solves with the
+   same matrix, such as the forward sensitivities. If mass is set, the
+   identity is replaced by kron(I, M). If iterative.opts is set, the
+   systems are solved with preconditioned GMRES instead of an LU
+   decomposition (see krylov.hpp).
+*/
+struct stage_matrix
+{
+	stage_matrix() : mass(nullptr) {}
+
+	/// Returns the unfactored stage matrix.
+	mat_type construct(const mat_type &J, double dt,
+	                   const solver_coeffs &sc) const
+	{
+		const std::size_t Ns = sc.b.size();
+		const std::size_t NN = Ns*J.n_rows;
+		mat_type J_Y;
+		if (mass) {
+			J_Y = arma::kron(arma::eye(Ns,Ns), *mass);
+		} else {
+			J_Y = arma::eye(NN,NN);
+		}
+		J_Y -= dt*arma::kron(sc.A, J);
+		return J_Y;
+	}
+
+	/// Constructs and factorizes the stage matrix.
+	/// Returns false if the LU decomposition failed.
+	bool factorize(const mat_type &J, double dt, const solver_coeffs &sc)
+	{
+		mat_type J_Y = construct(J, dt, sc);
+		if (iterative.opts) {
+			iterative.set_matrix(J_Y);
+			return true;
+		}
+		return arma::lu(L, U, P, J_Y);
+	}
+
+	/// Returns inv(I - dt*kron(A, J))*R, for both vectors and matrices R.
+	template <typename T>
+	T solve(const T &R) const
+	{
+		if (iterative.opts) return iterative.solve(R);
+		T tmp = arma::solve(arma::trimatl(L), P*R);
+		return arma::solve(arma::trimatu(U), tmp);
+	}
+
+	/// Returns true if the last solve did not reach its tolerance,
+	/// which can only happen for the iterative solver.
+	bool solve_failed() const
+	{
+		return iterative.opts && iterative.last_status != krylov::SUCCESS;
+	}
+
+	mat_type L, U, P;
+
+	/// Replaces the LU decomposition if its options are set.
+	krylov::solver iterative;
+
+	/// Mass matrix, or nullptr for the identity.
+	const mat_type *mass;
+};
+
+
+/**
+   \brief The stage matrix for block-diagonal Jacobi matrices.
+
+   Each block of the stage matrix is factored on its own, see
+   block_jacobian.hpp.
+*/
+struct block_stage_matrix
+{
+	block_stage_matrix() : mass(nullptr), n_threads(1),
+	                       blas_policy(nullptr) {}
+
+	/// Returns the unfactored stage matrix as a dense matrix.
+	mat_type construct(const block_diag_mat &J, double dt,
+	                   const solver_coeffs &sc) const
+	{
+		stage_matrix dense;
+		dense.mass = mass;
+		return dense.construct(J.to_dense(), dt, sc);
+	}
+
+	/// Factorizes the blocks of the stage matrix.
+	/// Returns false if the LU decomposition of a block failed.
+	bool factorize(const block_diag_mat &J, double dt, const solver_coeffs &sc)
+	{
+		lu.mass = mass;
+		lu.n_threads = n_threads;
+		lu.blas_policy = blas_policy;
+		return lu.factorize(J, dt, sc.A);
+	}
+
+	/// Returns inv(I - dt*kron(A, J))*R, for both vectors and matrices R.
+	template <typename T>
+	T solve(const T &R) const
+	{
+		return lu.solve(R);
+	}
+
+	/// The block LU solves are direct, so they never fail.
+	bool solve_failed() const { return false; }
+
+	block_lu lu;
+
+	/// Mass matrix, or nullptr for the identity.
+	const mat_type *mass;
+
+	/// Number of threads that factor blocks.
+	unsigned n_threads;
+
+	/// BLAS policy while the blocks are factored in parallel.
+	const blas_thread_policy *blas_policy;
+};
+
+
+/**
+   \brief The matrix M - gamma*dt*J of the error estimate.
+*/
+struct error_matrix
+{
+	error_matrix() : mass(nullptr) {}
+
+	bool factorize(const mat_type &J, double gam)
+	{
+		A = mass ? mat_type(*mass - gam*J)
+			: mat_type(arma::eye(J.n_rows, J.n_cols) - gam*J);
+		return true;
+	}
+
+	template <typename T>
+	T solve(const T &R) const
+	{
+		return arma::solve(A, R);
+	}
+
+	mat_type A;
+
+	/// Mass matrix, or nullptr for the identity.
+	const mat_type *mass;
+};
+
+
+/**
+   \brief The matrix M - gamma*dt*J of the error estimate for block-diagonal
+   Jacobi matrices.
+*/
+struct block_error_matrix
+{
+	block_error_matrix() : mass(nullptr), n_threads(1),
+	                       blas_policy(nullptr) {}
+
+	bool factorize(const block_diag_mat &J, double gam)
+	{
+		lu.mass = mass;
+		lu.n_threads = n_threads;
+		lu.blas_policy = blas_policy;
+		return lu.factorize(J, gam, arma::eye(1, 1));
+	}
+
+	template <typename T>
+	T solve(const T &R) const
+	{
+		return lu.solve(R);
+	}
+
+	block_lu lu;
+
+	/// Mass matrix, or nullptr for the identity.
+	const mat_type *mass;
+
+	/// Number of threads that factor blocks.
+	unsigned n_threads;
+
+	/// BLAS policy while the blocks are factored in parallel.
+	const blas_thread_policy *blas_policy;
+};
+
+
+/**
+   \brief Selects the linear solvers that go with a Jacobi matrix type.
+*/
+template <typename jac_type>
+struct linear_solvers
+{
+	typedef stage_matrix stage_type;
+	typedef error_matrix error_type;
+
+	static void configure(stage_type &M, error_type &,
+	                      const solver_options &opts)
+	{
+		M.iterative.opts = opts.newton_opts->krylov;
+	}
+};
+
+template <>
+struct linear_solvers<block_diag_mat>
+{
+	typedef block_stage_matrix stage_type;
+	typedef block_error_matrix error_type;
+
+	static void configure(stage_type &M, error_type &E,
+	                      const solver_options &opts)
+	{
+		M.n_threads = opts.block_threads;
+		E.n_threads = opts.block_threads;
+		M.blas_policy = E.blas_policy = opts.blas_policy;
+	}
+};
+
+
 /**
    \brief Performs simplified Newton iteration for IRKs to find stages
 
@@ -393,16 +733,20 @@ arma::vec construct_R(functor_type &func,
    with k_i the original stages.
 
    \param Y Contains the stages
+   \param M Will contain the LU decomposition of the last iteration matrix
+            (only if PLU_decomposition is true).
 */
 template <typename functor_type,
           bool adaptive_step=true,
-          bool PLU_decomposition=false> inline
+          bool PLU_decomposition=false,
+          typename jac_type, typename stage_type> inline
 int newton_solve_stages(functor_type &func, const vec_type &y, double t,
                         double dt, const solver_coeffs &sc,
                         int maxit, int refresh_jac,
-                        double xtol, double Rtol, vec_type &Y, mat_type &J,
+                        double xtol, double Rtol, vec_type &Y, jac_type &J,
                         newton::status &stats,
-                        std::size_t &fun_evals, std::size_t &jac_evals)
+                        std::size_t &fun_evals, std::size_t &jac_evals,
+                        stage_type &M)
 {
 	const std::size_t Neq = y.size();
 	const std::size_t Ns  = sc.b.size();
@@ -416,30 +760,35 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
 	// Jacobi matrix:
 	// Idea: Refresh Jacobi matrix after every so many iterations.
 	mat_type J_Y;
-	mat_type L, U, P;
 
 	auto refresh_jacobi_matrix =
-		[&func, &J, &J_Y, NN, &L, &U, &P, t, dt, y, sc, &jac_evals]()
+		[&func, &J, &J_Y, &M, t, dt, &y, &sc, &jac_evals]() -> bool
 		{
 			J = func.jac(t,y);
-			J_Y = arma::eye(NN,NN);
-			J_Y -= dt*kron(sc.A,J);
+			++jac_evals;
 
 			// Since we re-use the same Jacobi matrix,
 			// pre-construct the LU decomposition:
 			if (PLU_decomposition) {
-				assert(arma::lu(L,U,P, J_Y) &&
-				       "LU decomposition of Jacobi matrix failed!");
+				return M.factorize(J, dt, sc);
+			} else {
+				J_Y = M.construct(J, dt, sc);
+				return true;
 			}
-			++jac_evals;
 		};
 
-	refresh_jacobi_matrix();
+	// A singular stage matrix fails the Newton solve, so that the
+	// caller retries with a smaller time step:
+	if (!refresh_jacobi_matrix()) {
+		stats.iters = 0;
+		stats.conv_status = newton::GENERIC_ERROR;
+		return newton::GENERIC_ERROR;
+	}
 
 	// Start iterating:
 	double xtol2 = xtol*xtol;
 	double Rtol2 = Rtol*Rtol;
-	vec_type R = construct_R(func, y, t, dt, sc, Y, I_neq);
+	vec_type R = construct_R(func, y, t, dt, sc, Y, I_neq, M.mass);
 	fun_evals += Ns;
 	double step = 1.0;
 	double Rnorm2 = arma::dot(R, R);;
@@ -457,15 +806,20 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
 	for ( ; stats.iters < maxit; ++stats.iters) {
 		vec_type dY;
 		if (PLU_decomposition) {
-			vec_type tmp = arma::solve(arma::trimatl(-L), P*R);
-			dY  = arma::solve(arma::trimatu(U), tmp);
+			dY = -M.solve(R);
+			// A step from an unconverged linear solve can look like
+			// convergence, so fail the Newton solve instead:
+			if (M.solve_failed()) {
+				status = newton::GENERIC_ERROR;
+				break;
+			}
 		} else {
 			dY  = -arma::solve(J_Y, R);
 		}
 		xnorm2 = arma::dot(dY, dY);
 
 		Y += step*dY;
-		R = construct_R(func, y, t, dt, sc, Y, I_neq);
+		R = construct_R(func, y, t, dt, sc, Y, I_neq, M.mass);
 
 		fun_evals += Ns;
 		Rnorm2 = arma::dot(R,R);
@@ -481,8 +835,9 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
 			step = 1.0 / sqrt(1.0 + Rnorm2);
 		}
 
-		if (stats.iters % refresh_jac == 0) {
-			refresh_jacobi_matrix();
+		if (stats.iters % refresh_jac == 0 && !refresh_jacobi_matrix()) {
+			status = newton::GENERIC_ERROR;
+			break;
 		}
 	}
 	stats.res = Rnorm2;
@@ -492,10 +847,137 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
 }
 
 
+/**
+   \brief Performs simplified Newton iteration for IRKs to find stages
+
+   \overload newton_solve_stages
+*/
+template <typename functor_type,
+          bool adaptive_step=true,
+          bool PLU_decomposition=false,
+          typename jac_type> inline
+int newton_solve_stages(functor_type &func, const vec_type &y, double t,
+                        double dt, const solver_coeffs &sc,
+                        int maxit, int refresh_jac,
+                        double xtol, double Rtol, vec_type &Y, jac_type &J,
+                        newton::status &stats,
+                        std::size_t &fun_evals, std::size_t &jac_evals)
+{
+	typename linear_solvers<jac_type>::stage_type M;
+	return newton_solve_stages<functor_type, adaptive_step,
+	                           PLU_decomposition>(
+		                           func, y, t, dt, sc, maxit, refresh_jac,
+		                           xtol, Rtol, Y, J, stats,
+		                           fun_evals, jac_evals, M);
+}
+
+
+/**
+   \brief Solves the stage equations of the forward sensitivities.
+
+   With the stages Y already known, the sensitivity stages Sigma satisfy
+   the linear system
+     M*Sigma_i = dt*sum_j a_ij*( J_j*(S + Sigma_j) + dfdp_j ),
+   with dfdp_j evaluated at the stage points. J_j is the Jacobian J of
+   the Newton solve, unless sens_opts.stage_jacobians asks for the exact
+   stage Jacobians. It is solved with a staggered corrector that uses the
+   already factored stage matrix M, so with J_j = J it converges at once.
+
+   \param S         Sensitivities at the start of the step (Neq x P).
+   \param Y         Converged stages of the step.
+   \param J         Jacobian the stage matrix was formed with.
+   \param M         LU decomposition of the stage matrix.
+   \param sens_opts Options for the sensitivities.
+   \param Sigma     Will contain the sensitivity stages (Ns*Neq x P).
+
+   \returns the number of corrector iterations, or -1 if it did not converge.
+*/
+template <typename functor_type, typename jac_type,
+          typename stage_type> inline
+int sensitivity_stages(functor_type &func, const vec_type &y,
+                       const mat_type &S, double t, double dt,
+                       const solver_coeffs &sc, const vec_type &Y,
+                       const jac_type &J, const stage_type &M,
+                       const sensitivity_options &sens_opts,
+                       mat_type &Sigma, std::size_t &jac_evals)
+{
+	const std::size_t Neq = y.size();
+	const std::size_t Ns  = sc.b.size();
+	const std::size_t P   = S.n_cols;
+
+	std::vector<jac_type> J_stage;
+	if (sens_opts.stage_jacobians) J_stage.resize(Ns);
+	std::vector<mat_type> dfdp_stage(Ns);
+	for (std::size_t j = 0; j < Ns; ++j) {
+		std::size_t j0 = Neq*j;
+		double tj = t + sc.c(j)*dt;
+		vec_type yj = y + Y.subvec(j0, j0 + Neq - 1);
+		if (sens_opts.stage_jacobians) {
+			J_stage[j] = func.jac(tj, yj);
+			++jac_evals;
+		}
+		dfdp_stage[j] = arma::zeros(Neq, P);
+		add_dfdp(func, tj, yj, dfdp_stage[j], sens_opts.param_col);
+	}
+
+	Sigma = arma::zeros(Ns*Neq, P);
+	mat_type G(Ns*Neq, P);
+	mat_type R(Ns*Neq, P);
+	for (int iter = 0; iter < sens_opts.maxit; ++iter) {
+		for (std::size_t j = 0; j < Ns; ++j) {
+			std::size_t j0 = Neq*j, j1 = j0 + Neq - 1;
+			const jac_type &Jj = J_stage.empty() ? J : J_stage[j];
+			G.rows(j0, j1) = Jj*(S + Sigma.rows(j0, j1)) + dfdp_stage[j];
+		}
+		for (std::size_t i = 0; i < Ns; ++i) {
+			std::size_t i0 = Neq*i, i1 = i0 + Neq - 1;
+			if (M.mass) {
+				R.rows(i0, i1) = (*M.mass)*Sigma.rows(i0, i1);
+			} else {
+				R.rows(i0, i1) = Sigma.rows(i0, i1);
+			}
+			for (std::size_t j = 0; j < Ns; ++j) {
+				std::size_t j0 = Neq*j, j1 = j0 + Neq - 1;
+				R.rows(i0, i1) -= dt*sc.A(i,j)*G.rows(j0, j1);
+			}
+		}
+		mat_type dSigma = M.solve(R);
+		// A small increment from an unconverged solve means nothing:
+		if (M.solve_failed()) return -1;
+		Sigma -= dSigma;
+
+		double incr  = arma::norm(dSigma, "inf");
+		double scale = 1.0 + arma::norm(Sigma, "inf");
+		if (incr <= sens_opts.tol*scale) {
+			return iter + 1;
+		}
+	}
+	return -1;
+}
+
+
+/**
+   \brief Forms sum_j w_j*Sigma_j from the blocks of Sigma.
+*/
+inline mat_type combine_stage_blocks(const mat_type &Sigma,
+                                     const vec_type &w, std::size_t Neq)
+{
+	mat_type res = arma::zeros(Neq, Sigma.n_cols);
+	for (std::size_t j = 0; j < w.size(); ++j) {
+		res += w(j)*Sigma.rows(Neq*j, Neq*j + Neq - 1);
+	}
+	return res;
+}
+
+
 
 /**
    \brief Generic time integration function for IRK methods
 
+   The switches in policy (see \ref step_policy) replace the run-time
+   checks of the corresponding options, so disabled features cost
+   nothing in the step loop.
+
    \param func         Functor of the ODE to integrate
    \param t0           Starting time
    \param t1           Final time
@@ -505,24 +987,29 @@ int newton_solve_stages(functor_type &func, const vec_type &y, double t,
 
    \returns a struct that contains status, solution, etc. (see irk::rk_output).
 */
-template <typename functor_type> inline
-rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
-                   const solver_options &solver_opts, double dt,
-                   const solver_coeffs &sc, const output_options &output_opts)
+template <typename policy, typename functor_type> inline
+rk_output irk_guts_impl(functor_type &func, double t0, double t1,
+                        const vec_type &y0,
+                        const solver_options &solver_opts, double dt,
+                        const solver_coeffs &sc,
+                        const output_options &output_opts)
 {
+	alloc_tracking::phase_tracker alloc_phases;
+	log_sink *log = output_opts.log;
 	if (t0 + dt > t1) {
-		output_opts.log_out << "    Rehuel: Initial dt (" << dt;
+		REHUEL_LOG(log, REHUEL_LOG_WARNING)
+			<< "    Rehuel: Initial dt (" << dt
+			<< ") too large for interval! Reducing to "
+			<< t1 - t0 << "\n";
 		dt = t1 - t0;
-		output_opts.log_out << ") too large for interval! Reducing to "
-		          << dt << "\n";
-
 	}
 
-	output_opts.log_out << "    Rehuel: Integrating over interval [ "
-	                    << t0 << ", " << t1 << " ]...\n"
-	                    << "            Method = " << sc.name << "\n";
+	REHUEL_LOG(log, REHUEL_LOG_INFO)
+		<< "    Rehuel: Integrating over interval [ "
+		<< t0 << ", " << t1 << " ]...\n"
+		<< "            Method = " << sc.name << "\n";
 
-	const bool time_internals = solver_opts.time_internals;
+	const bool time_internals = policy::time_internals;
 	my_timer timer;
 	timeval irk_start = timer.get_tic();
 
@@ -572,7 +1059,8 @@ rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 	errs[0] = errs[1] = errs[2] = 0.9;
 
 	if( solver_opts.out_interval > 0 ){
-		output_opts.log_out  << "    Rehuel: step  t  dt   err   iters\n";
+		REHUEL_LOG(log, REHUEL_LOG_INFO)
+			<< "    Rehuel: step  t  dt   err   iters\n";
 	}
 
 	vec_type err_est = arma::zeros( y.size() );
@@ -582,14 +1070,35 @@ rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 	sol.stages.push_back(K_n);
 	sol.err_est.push_back( err_est );
 	sol.err.push_back( 0.0 );
+	if (output_opts.compressed) output_opts.compressed->push_back(t, y);
 	if (time_internals) timings[STORE_SOL] += timer.toc();
+	step_writer file_out(output_opts, Neq);
+
+	// Forward sensitivities, if requested:
+	const sensitivity_options *sens_opts = solver_opts.sens_opts;
+	mat_type S, S_n, Sigma;
+	if (sens_opts) {
+		assert(sens_opts->S0.n_rows == Neq &&
+		       "Initial sensitivities have wrong number of rows!");
+		S = sens_opts->S0;
+		sol.sens_vals.push_back(S);
+	}
+
 	bool alternative_error_formula = true;
 	std::size_t min_order = std::min( sc.order, sc.order2 );
 
 
 	// Variables/parameters for Newton iteration:
+	typedef typename jacobian_of<functor_type>::type jac_type;
+	typedef linear_solvers<jac_type> solvers;
 	vec_type Y; // Contains the stages.
-	mat_type J; // Contains Jacobi matrix
+	jac_type J; // Contains Jacobi matrix
+	// Contain the LU decompositions of the stage and error matrix:
+	typename solvers::stage_type M;
+	typename solvers::error_type E;
+	M.mass = E.mass = solver_opts.mass_matrix;
+	solvers::configure(M, E, solver_opts);
+	const mat_type *mass = solver_opts.mass_matrix;
 	double xtol = newton_opts.dx_delta;
 	double Rtol = newton_opts.tol;
 	newton::status newton_stats;
@@ -599,19 +1108,55 @@ rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 	vec_type d_weights  = (Ai.t())*sc.b;
 	vec_type d2_weights = (Ai.t())*sc.b2;
 
-
+	// Dense output needs the stages of every step:
+	const bool dense = policy::store_solution && sc.b_interp.n_elem > 0 &&
+		output_opts.output_interval == 1;
+	if (dense) sol.b_interp = sc.b_interp;
+
+	std::vector<double> tstops = active_tstops(solver_opts, t0, t1);
+	std::size_t next_stop = 0;
+	double dt_before_stop = dt;
+	steady_state_monitor steady(solver_opts);
+	budget_monitor budget(solver_opts);
+	// If the last stage is at (t + dt, y_n), the steady state check can
+	// take f(t + dt, y_n) from the stages instead of evaluating it:
+	const bool last_stage_is_end = is_method_stiffly_accurate(sc) &&
+		std::fabs(sc.c(Ns-1) - 1.0) < 1e-14;
+	const vec_type last_stage_weights = Ai.row(Ns-1).t();
+	publish_progress(solver_opts.progress, t0, t1, t, dt, 0, 0, 0, 0);
+
+	alloc_phases.end_setup();
 	while (t < t1) {
+		alloc_phases.begin_step();
 		// ****************  Calculate stages:   ************
 		// Make sure you stop exactly at t = t1.
 		if( t + dt > t1 ){
 			dt = t1 - t;
 		}
+		// Land exactly on the next stop point. Steps that would end
+		// just short of it are stretched a tiny bit instead.
+		bool at_stop = false, stop_reached = false;
+		if (next_stop < tstops.size() &&
+		    t + dt*(1.0 + 1e-10) >= tstops[next_stop]) {
+			dt_before_stop = dt;
+			dt = tstops[next_stop] - t;
+			at_stop = true;
+		}
 		sol.count.attempt++;
 
 		if (solver_opts.max_steps >= 0 && step > solver_opts.max_steps) {
-			output_opts.log_out << "    Rehuel: Maximum number of attempts exceeded.\n";
+			REHUEL_LOG(log, REHUEL_LOG_ERROR)
+				<< "    Rehuel: Maximum number of attempts exceeded.\n";
 			sol.status = ERROR_MAX_STEPS_EXCEEDED;
-			return sol;
+			break;
+		}
+
+		// Stop with partial results if the budget ran out:
+		int budget_status = budget.check(sol.count.fun_evals,
+		                                 sol.count.jac_evals);
+		if (budget_status != SUCCESS) {
+			sol.status = budget_status;
+			break;
 		}
 
 		int integrator_status = 0;
@@ -625,21 +1170,31 @@ rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 			xtol, Rtol, Y, J,
 			newton_stats,
 			sol.count.fun_evals,
-			sol.count.jac_evals);
-
-
+			sol.count.jac_evals, M);
+
+		// The sensitivity stages re-use the factored stage matrix.
+		// If they fail to converge, treat it as a failed Newton solve.
+		if (sens_opts && newton_status == newton::SUCCESS) {
+			int sens_iters = sensitivity_stages(
+				func, y, S, t, dt, sc, Y, J, M, *sens_opts,
+				Sigma, sol.count.jac_evals);
+			if (sens_iters < 0) {
+				newton_status = newton::MAXIT_EXCEEDED;
+			}
+		}
 
 		if (time_internals) timings[UPDATE_STAGES] += timer.toc();
 
 		// *********** Verify Newton iteration convergence ************
 		if (newton_status != newton::SUCCESS){
-			if (!solver_opts.adaptive_step_size) {
+			if (!policy::adaptive_step) {
 				// In this case, you can do nothing but error.
 				sol.status = GENERAL_ERROR;
-				output_opts.log_out << "   Rehuel: Newton iteration "
-				          << "failed for constant time step "
-				          << "size! Aborting!\n";
-				return sol;
+				REHUEL_LOG(log, REHUEL_LOG_ERROR)
+					<< "   Rehuel: Newton iteration "
+					<< "failed for constant time step "
+					<< "size! Aborting!\n";
+				break;
 			}
 
 			dt *= 0.7;
@@ -647,14 +1202,12 @@ rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 				newton_maxit += newton_maxit0;
 				last_maxit_relax_step = step;
 			}
-			/*
-			output_opts.log_out << "   Rehuel: step " << step
-			          << ", t = " << t
-			          << ": Newton iteration failed! Status: "
-			          << newton::status_message(newton_status)
-			          << ".\n        Retrying with dt = " << dt
-			          << " and maxit = " << newton_maxit << "\n";
-			*/
+			REHUEL_LOG(log, REHUEL_LOG_DEBUG)
+				<< "   Rehuel: step " << step << ", t = " << t
+				<< ": Newton iteration failed! Status: "
+				<< newton_status
+				<< ".\n        Retrying with dt = " << dt
+				<< " and maxit = " << newton_maxit << "\n";
 			sol.count.reject_newton++;
 			if (newton_status == newton::INCREMENT_DIVERGE){
 				sol.count.newton_incr_diverge++;
@@ -671,10 +1224,11 @@ rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 			// before. We should slowly relax them back...
 			/*
 			if (step - last_maxit_relax_step > 10) {
-				output_opts.log_out << "   Rehuel: step " << step
-				          << ": Resetting maxit from "
-				          << newton_maxit << " to "
-				          << newton_maxit0 << ".\n";
+				REHUEL_LOG(log, REHUEL_LOG_DEBUG)
+					<< "   Rehuel: step " << step
+					<< ": Resetting maxit from "
+					<< newton_maxit << " to "
+					<< newton_maxit0 << ".\n";
 				newton_maxit = newton_maxit0;
 			}
 			*/
@@ -689,134 +1243,189 @@ rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 		// The update to y is given by d := b*inv(A)*Y;
 
 
-		vec_type delta_y, delta_alt;
+		vec_type delta_y;
 		double gam = sc.gamma*dt;
 
 		// Vectorized version of the loop below:
 		mat_type YYs = arma::reshape(Y, Neq, Ns);
 		delta_y = YYs*d_weights;
 
-		if (solver_opts.adaptive_step_size) {
-			delta_alt = YYs*d2_weights;
-		}
-
-		vec_type dy_alt = gam * func.fun(t,y) + delta_alt;
-		++sol.count.fun_evals;
-
 		vec_type y_n    = y + delta_y;
-		vec_type yp     = y + dy_alt;
-		vec_type delta_delta = dy_alt - delta_y;
+		if (sens_opts) {
+			S_n = S + combine_stage_blocks(Sigma, d_weights, Neq);
+		}
 		if (time_internals) {
 			timings[UPDATE_Y] += timer.toc();
 			timer.tic();
 		}
 
-		// **************      Estimate error:    **********************
-		// Formula 8.19:
-		// J0 = func.jac( t, y );
-		// J was already calculated for us in newton_solve_stages:
-		mat_type solve_tmp = arma::eye(Neq,Neq) - gam*J;
-		vec_type err_8_19 = dt*arma::solve(solve_tmp, delta_delta);
-		err_est = err_8_19;
-
-		// Alternative formula 8.20:
-		if( alternative_error_formula ){
-			// Use the alternative formulation:
-			// vec_type dy_alt_alt = gamma*func.fun(t, y+err_est);
-			vec_type dy_alt_alt = gam*func.fun(t, y + err_est);
+		// A fixed time step needs neither the error estimate nor the
+		// controller, which saves a linear solve and up to two
+		// evaluations of f per step:
+		if (policy::adaptive_step) {
+			// **************      Estimate error:    **********************
+			vec_type delta_alt = YYs*d2_weights;
+			vec_type dy_alt = gam * func.fun(t,y) + delta_alt;
 			++sol.count.fun_evals;
 
-			dy_alt_alt += delta_alt;
-			vec_type err_alt = dy_alt_alt - delta_y;
-			err_est = dt*arma::solve(solve_tmp, err_alt);
-		}
+			vec_type delta_delta = dy_alt - delta_y;
+			if (mass) {
+				// With a mass matrix, only the stage part gets multiplied.
+				delta_delta = dy_alt - delta_alt
+					+ (*mass)*(delta_alt - delta_y);
+			}
 
-		double err_tot = 0.0;
-		double n = 0.0;
-		double atol = solver_opts.abs_tol;
-		double rtol = solver_opts.rel_tol;
-		for( std::size_t i = 0; i < err_est.size(); ++i ){
-			double erri = err_est[i];
-			double y0i  = std::fabs( y[i] );
-			double y1i  = std::fabs( y_n[i] );
-			double sci  = atol + rtol * std::max( y0i, y1i );
-
-			double add = erri / sci;
-			err_tot += add * add;
-			n += 1.0;
-		}
+			// Formula 8.19:
+			// J0 = func.jac( t, y );
+			// J was already calculated for us in newton_solve_stages.
+			// If M - gam*J is singular, treat it like a failed Newton
+			// solve and retry with a smaller time step:
+			if (!E.factorize(J, gam)) {
+				dt *= 0.7;
+				REHUEL_LOG(log, REHUEL_LOG_DEBUG)
+					<< "   Rehuel: step " << step << ", t = " << t
+					<< ": LU decomposition for the error estimate "
+					<< "failed.\n        Retrying with dt = " << dt << "\n";
+				sol.count.reject_newton++;
+				continue;
+			}
+			vec_type err_8_19 = dt*E.solve(delta_delta);
+			err_est = err_8_19;
+
+			// Alternative formula 8.20:
+			if( alternative_error_formula ){
+				// Use the alternative formulation:
+				// vec_type dy_alt_alt = gamma*func.fun(t, y+err_est);
+				vec_type dy_alt_alt = gam*func.fun(t, y + err_est);
+				++sol.count.fun_evals;
+
+				vec_type err_alt;
+				if (mass) {
+					err_alt = dy_alt_alt + (*mass)*(delta_alt - delta_y);
+				} else {
+					dy_alt_alt += delta_alt;
+					err_alt = dy_alt_alt - delta_y;
+				}
+				err_est = dt*E.solve(err_alt);
+			}
 
-		assert( err_tot >= 0.0 && "Error cannot be negative!" );
-		err = std::sqrt( err_tot / n );
+			double err_tot = 0.0;
+			double n = 0.0;
+			double atol = solver_opts.abs_tol;
+			double rtol = solver_opts.rel_tol;
+			for( std::size_t i = 0; i < err_est.size(); ++i ){
+				double erri = err_est[i];
+				double y0i  = std::fabs( y[i] );
+				double y1i  = std::fabs( y_n[i] );
+				double sci  = atol + rtol * std::max( y0i, y1i );
+
+				double add = erri / sci;
+				err_tot += add * add;
+				n += 1.0;
+			}
 
+			assert( err_tot >= 0.0 && "Error cannot be negative!" );
+			err = std::sqrt( err_tot / n );
+
+			if (sens_opts && sens_opts->error_control) {
+				mat_type dS_alt =
+					combine_stage_blocks(Sigma, d2_weights, Neq);
+				mat_type G = J*S;
+				add_dfdp(func, t, y, G, sens_opts->param_col);
+				mat_type dd = gam*G + dS_alt - (S_n - S);
+				if (mass) {
+					dd = gam*G + (*mass)*(dS_alt - (S_n - S));
+				}
+				mat_type err_S = dt*E.solve(dd);
+
+				double err_S_tot = 0.0;
+				for (std::size_t i = 0; i < err_S.n_elem; ++i) {
+					double sci = atol + rtol*std::max(
+						std::fabs(S(i)), std::fabs(S_n(i)));
+					double add = err_S(i) / sci;
+					err_S_tot += add*add;
+				}
+				err = std::max(err, std::sqrt(err_S_tot / err_S.n_elem));
+			}
 
-		if( err < machine_precision ){
-			err = machine_precision;
-		}
 
-		errs[2] = errs[1];
-		errs[1] = errs[0];
-		errs[0] = err;
-		if (time_internals) timings[ESTIMATE_ERROR] += timer.toc();
+			if( err < machine_precision ){
+				err = machine_precision;
+			}
 
-		if( solver_opts.adaptive_step_size && (err > 1.0) ){
-			// This is bad.
-			alternative_error_formula = true;
-			integrator_status = 1;
-			sol.count.reject_err++;
-		}
+			errs[2] = errs[1];
+			errs[1] = errs[0];
+			errs[0] = err;
+			if (time_internals) timings[ESTIMATE_ERROR] += timer.toc();
 
+			if( err > 1.0 ){
+				// This is bad.
+				alternative_error_formula = true;
+				integrator_status = 1;
+				sol.count.reject_err++;
+			}
 
-		// **************      Find new dt:    **********************
-		if (time_internals) timer.tic();
-		double fac = 0.9 * (newton_maxit + 1.0);
-		fac /= (newton_maxit + newton_stats.iters);
-
-		double expt = 1.0 / ( 1.0 + min_order );
-		double err_inv = 1.0 / err;
-		double scale_27 = std::pow( err_inv, expt );
-		double dt_rat = dts[0] / dts[1];
-		double err_frac = errs[1] / errs[0];
-		if( errs[1] == 0 || errs[0] == 0 ){
-			err_frac = 1.0;
-		}
-		double err_rat = std::pow( err_frac, expt );
-		double scale_28 = scale_27 * dt_rat * err_rat;
-
-		/*
-		output_opts.log_out << "    Rehuel: Time step controller:\n"
-		          << "            err      = " << err << "\n"
-		          << "            err_inv  = " << err_inv << "\n"
-		          << "            dt_rat   = " << dt_rat << "\n"
-		          << "            err_frac = " << err_frac << "\n"
-		          << "            err_rat  = " << err_rat << "\n"
-		          << "            scale_27 = " << scale_27 << "\n"
-		          << "            scale_28 = " << scale_28 << "\n\n";
-		*/
-
-		double min_scales = std::min( scale_27, scale_28 );
-		// When growing dt, don't grow more than a factor 4:
-		new_dt = fac * dt * std::min( 8.0, min_scales );
-		if( solver_opts.max_dt > 0 ){
-			new_dt = std::min( solver_opts.max_dt, new_dt );
+
+			// **************      Find new dt:    **********************
+			if (time_internals) timer.tic();
+			double fac = 0.9 * (newton_maxit + 1.0);
+			fac /= (newton_maxit + newton_stats.iters);
+
+			double expt = 1.0 / ( 1.0 + min_order );
+			double err_inv = 1.0 / err;
+			double scale_27 = std::pow( err_inv, expt );
+			double dt_rat = dts[0] / dts[1];
+			double err_frac = errs[1] / errs[0];
+			if( errs[1] == 0 || errs[0] == 0 ){
+				err_frac = 1.0;
+			}
+			double err_rat = std::pow( err_frac, expt );
+			double scale_28 = scale_27 * dt_rat * err_rat;
+
+			REHUEL_LOG(log, REHUEL_LOG_DEBUG)
+				<< "    Rehuel: Time step controller:\n"
+				<< "            err      = " << err << "\n"
+				<< "            err_inv  = " << err_inv << "\n"
+				<< "            dt_rat   = " << dt_rat << "\n"
+				<< "            err_frac = " << err_frac << "\n"
+				<< "            err_rat  = " << err_rat << "\n"
+				<< "            scale_27 = " << scale_27 << "\n"
+				<< "            scale_28 = " << scale_28 << "\n\n";
+
+			double min_scales = std::min( scale_27, scale_28 );
+			// When growing dt, don't grow more than a factor 4:
+			new_dt = fac * dt * std::min( 8.0, min_scales );
+			if( solver_opts.max_dt > 0 ){
+				new_dt = std::min( solver_opts.max_dt, new_dt );
+			}
+			if (time_internals) timings[ESTIMATE_DT] += timer.toc();
 		}
-		if (time_internals) timings[ESTIMATE_DT] += timer.toc();
 
 		// **************    Update y and time   ********************
 		if( solver_opts.out_interval > 0 &&
 		    (step % solver_opts.out_interval == 0) ){
-			output_opts.log_out  << "    Rehuel: " << step << " " << t
-			                     << " " <<  dt << " " << err << " "
-			                     << newton_stats.iters << "\n";
+			REHUEL_LOG(log, REHUEL_LOG_INFO)
+				<< "    Rehuel: " << step << " " << t
+				<< " " <<  dt << " " << err << " "
+				<< newton_stats.iters << "\n";
 		}
 
 
-		if (!solver_opts.adaptive_step_size || integrator_status == 0) {
+		if (!policy::adaptive_step || integrator_status == 0) {
 			if (time_internals) timer.tic();
 			yo = y;
 			y  = y_n;
 			t += dt;
 			++step;
+			if (at_stop) {
+				t = tstops[next_stop++];
+				stop_reached = true;
+			}
+			publish_progress(solver_opts.progress, t0, t1, t, dt, step,
+			                 sol.count.attempt,
+			                 sol.count.reject_newton + sol.count.reject_err,
+			                 sol.count.fun_evals);
+			if (sens_opts) S = S_n;
 
 			if (time_internals) {
 				timings[UPDATE_Y] += timer.toc();
@@ -824,42 +1433,99 @@ rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 			}
 
 			if (step % output_opts.output_interval == 0) {
-				if (output_opts.store_in_vectors()) {
+				if (policy::store_solution) {
+					alloc_phases.begin_output();
+					// Y = dt*kron(A, I)*k, so dt*k = Y*inv(A)^T:
+					if (dense) K_np = arma::vectorise(YYs*Ai.t());
 					sol.t_vals.push_back(t);
 					sol.y_vals.push_back(y_n);
 					sol.stages.push_back(K_np);
 					sol.err_est.push_back( err_est );
 					sol.err.push_back( err );
+					if (sens_opts) sol.sens_vals.push_back(S);
+					alloc_phases.end_output();
 
 					if (time_internals) {
 						timings[STORE_SOL] += timer.toc();
 					}
 				}
+				if (output_opts.compressed) {
+					alloc_phases.begin_output();
+					output_opts.compressed->push_back(t, y_n);
+					alloc_phases.end_output();
+				}
 				if (output_opts.write_to_file()) {
-					*output_opts.output_stream << t;
-					for (std::size_t y_idx = 0; y_idx < y_n.size(); ++y_idx) {
-						*output_opts.output_stream << " " << y_n[y_idx];
-					}
-					*output_opts.output_stream << "\n";
+					file_out.write(t, y_n);
 				}
 			}
 			alternative_error_formula = false;
+
+			if (steady.enabled()) {
+				vec_type f_n;
+				if (last_stage_is_end) {
+					// dt*k = Y*inv(A)^T, and M*k = f:
+					f_n = YYs*last_stage_weights / dt;
+					if (mass) f_n = (*mass)*f_n;
+				} else {
+					f_n = func.fun(t, y);
+					++sol.count.fun_evals;
+				}
+				if (steady.update(f_n, y, dt, new_dt)) {
+					if (solver_opts.steady_state_jump && t < t1 &&
+					    policy::store_solution) {
+						sol.t_vals.push_back(t1);
+						sol.y_vals.push_back(y);
+						// y is constant from here on:
+						sol.stages.push_back(K_n);
+						sol.err_est.push_back(err_est);
+						sol.err.push_back(err);
+						if (sens_opts) sol.sens_vals.push_back(S);
+					}
+					if (solver_opts.steady_state_jump && t < t1 &&
+					    output_opts.compressed) {
+						output_opts.compressed->push_back(t1, y);
+					}
+					sol.status = STEADY_STATE_REACHED;
+					break;
+				}
+			}
 		}
 
 		// **************      Actually set the new dt:    **********************
 
-		if( solver_opts.adaptive_step_size ) {
+		if( policy::adaptive_step ) {
 			dt = new_dt;
 		}
 		dts[2] = dts[1];
 		dts[1] = dts[0];
 		dts[0] = dt;
 
+		if (stop_reached) {
+			// Restart after the discontinuity with a fresh controller
+			// history. The stage guesses start from zero every step.
+			dt = solver_opts.tstop_dt > 0 ? solver_opts.tstop_dt
+			                              : dt_before_stop;
+			if (solver_opts.max_dt > 0) {
+				dt = std::min(solver_opts.max_dt, dt);
+			}
+			dts[0] = dts[1] = dts[2] = dt;
+			errs[0] = errs[1] = errs[2] = 0.9;
+			alternative_error_formula = true;
+		}
+
 		if (solver_opts.extrapolate_stage && (integrator_status == 0)) {
 			// TODO
 		}
 	}
 
+	std::size_t dropped = file_out.finish();
+	if (dropped > 0) {
+		REHUEL_LOG(log, REHUEL_LOG_WARNING)
+			<< "Rehuel: output writer dropped " << dropped
+			<< " records\n";
+	}
+
+	sol.allocs = alloc_phases.finish(trajectory_bytes(sol));
 	double elapsed = timer.get_elapsed(irk_start);
 	sol.elapsed_time = elapsed;
 	sol.accept_frac = static_cast<double>(step) / sol.count.attempt;
@@ -870,6 +1536,60 @@ rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
 }
 
 
+/**
+   \brief Generic time integration function for IRK methods
+
+   Picks the instantiation of irk_guts_impl that matches the options.
+
+   \param func         Functor of the ODE to integrate
+   \param t0           Starting time
+   \param t1           Final time
+   \param y0           Initial values
+   \param sc           Solver coefficients
+   \param solver_opts  Options for the internal solver.
+
+   \returns a struct that contains status, solution, etc. (see irk::rk_output).
+*/
+template <typename functor_type> inline
+rk_output irk_guts(functor_type &func, double t0, double t1, const vec_type &y0,
+                   const solver_options &solver_opts, double dt,
+                   const solver_coeffs &sc, const output_options &output_opts)
+{
+	int policy_bits = 0;
+	policy_bits += 1 * ( solver_opts.adaptive_step_size == true );
+	policy_bits += 2 * ( solver_opts.time_internals == true );
+	policy_bits += 4 * ( output_opts.store_in_vectors() == true );
+
+	switch(policy_bits){
+	default:
+	case 0:
+		return irk_guts_impl<step_policy<0, 0, 0> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 1:
+		return irk_guts_impl<step_policy<1, 0, 0> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 2:
+		return irk_guts_impl<step_policy<0, 1, 0> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 3:
+		return irk_guts_impl<step_policy<1, 1, 0> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 4:
+		return irk_guts_impl<step_policy<0, 0, 1> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 5:
+		return irk_guts_impl<step_policy<1, 0, 1> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 6:
+		return irk_guts_impl<step_policy<0, 1, 1> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	case 7:
+		return irk_guts_impl<step_policy<1, 1, 1> >(
+			func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	}
+}
+
+
 /**
    \brief Time-integrate a given ODE from t0 to t1, starting at y0
 
@@ -889,13 +1609,26 @@ rk_output odeint(functor_type &func, double t0, double t1, const vec_type &y0,
 {
 	solver_coeffs sc = get_coefficients( method );
 	if (solver_opts.adaptive_step_size && sc.b2.size() == 0) {
-		output_opts.log_out << "    Rehuel: WARNING: Cannot have adaptive time "
-		          << "step with non-embedding method! Disabling "
-		          << "adaptive time step size!\n";
+		REHUEL_LOG(output_opts.log, REHUEL_LOG_WARNING)
+			<< "    Rehuel: WARNING: Cannot have adaptive time "
+			<< "step with non-embedding method! Disabling "
+			<< "adaptive time step size!\n";
 		solver_opts.adaptive_step_size = false;
 	}
+	if (solver_opts.mass_matrix && !is_method_stiffly_accurate(sc)) {
+		REHUEL_LOG(output_opts.log, REHUEL_LOG_ERROR)
+			<< "    Rehuel: ERROR: Mass matrices are only "
+			<< "supported by stiffly accurate methods "
+			<< "(Radau IIA, Lobatto IIIC)!\n";
+		rk_output sol;
+		sol.status = GENERAL_ERROR;
+		return sol;
+	}
 	assert( verify_solver_coeffs( sc ) && "Invalid solver coefficients!" );
-	return irk_guts(func, t0, t1, y0, solver_opts, dt, sc, output_opts);
+	rk_output sol = irk_guts(func, t0, t1, y0, solver_opts, dt, sc,
+	                         output_opts);
+	if (solver_opts.progress) solver_opts.progress->mark_done();
+	return sol;
 }
 
 
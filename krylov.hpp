@@ -0,0 +1,762 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file krylov.hpp
+
+   \brief Preconditioned GMRES for the linear solves inside Newton iterations.
+
+   For large sparse systems, factoring the iteration matrix dominates the
+   cost of the implicit solvers. With krylov::options set in the
+   newton::options, the linear systems of newton::newton_iterate, the IRK
+   stage solve and the BDF Newton iteration are solved with restarted
+   GMRES instead. Without a good preconditioner GMRES converges far too
+   slowly for stiff problems, so this file also provides ILU(0), ILUT and
+   block-Jacobi preconditioners. User-supplied (e.g. physics-based)
+   preconditioners derive from krylov::preconditioner, or wrap two
+   callbacks in a callback_preconditioner. A linear solve that does not
+   reach its tolerance fails the Newton iteration it is part of, so the
+   time step is rejected instead of accepting an inaccurate solution.
+
+   A preconditioner is set up whenever the solver rebuilds its iteration
+   matrix, i.e., with the refresh policy of the Jacobi matrix. Setting
+   preconditioner::refresh_every to n > 1 re-uses it for n rebuilds,
+   which typically still works well since the iteration matrix changes
+   slowly from step to step.
+*/
+
+#ifndef KRYLOV_HPP
+#define KRYLOV_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "arma_include.hpp"
+
+
+/// \brief Iterative linear solvers and preconditioners.
+namespace krylov {
+
+typedef arma::vec vec_type;
+typedef arma::mat mat_type;
+
+
+/// \brief Return codes for gmres.
+enum krylov_ret_codes {
+	SUCCESS = 0,     ///< Converged to tolerance
+	MAXIT_EXCEEDED   ///< Did not converge within maxit iterations
+};
+
+
+/**
+   \brief A square sparse matrix in compressed sparse row format.
+
+   The diagonal is always stored, even if it is zero, so that the
+   incomplete factorizations have a slot for each pivot. Columns are
+   sorted within each row.
+*/
+struct csr_matrix
+{
+	csr_matrix() : n(0), row_ptr(1, 0) {}
+
+	/// Stores the entries of A with magnitude above drop_tol.
+	explicit csr_matrix(const mat_type &A, double drop_tol = 0.0) : n(A.n_rows)
+	{
+		assert(A.n_rows == A.n_cols && "Matrix must be square!");
+		row_ptr.assign(1, 0);
+		for (std::size_t i = 0; i < n; ++i) {
+			for (std::size_t j = 0; j < n; ++j) {
+				double a = A(i,j);
+				if (i == j || std::fabs(a) > drop_tol) {
+					col.push_back(j);
+					val.push_back(a);
+				}
+			}
+			row_ptr.push_back(col.size());
+		}
+	}
+
+	/// Converts a (column-major) arma::sp_mat.
+	explicit csr_matrix(const arma::sp_mat &A) : n(A.n_rows)
+	{
+		assert(A.n_rows == A.n_cols && "Matrix must be square!");
+		// Count the entries per row, including the diagonal:
+		std::vector<std::size_t> count(n, 1);
+		std::vector<double> diag(n, 0.0);
+		for (std::size_t j = 0; j < n; ++j) {
+			for (std::size_t p = A.col_ptrs[j]; p < A.col_ptrs[j+1]; ++p) {
+				std::size_t i = A.row_indices[p];
+				if (i == j) diag[i] = A.values[p];
+				else ++count[i];
+			}
+		}
+		row_ptr.assign(n + 1, 0);
+		for (std::size_t i = 0; i < n; ++i) {
+			row_ptr[i+1] = row_ptr[i] + count[i];
+		}
+		col.resize(row_ptr[n]);
+		val.resize(row_ptr[n]);
+
+		// Columns are visited in increasing order, so rows come out sorted.
+		std::vector<std::size_t> next(row_ptr.begin(), row_ptr.end() - 1);
+		for (std::size_t j = 0; j < n; ++j) {
+			col[next[j]] = j;
+			val[next[j]] = diag[j];
+			++next[j];
+			for (std::size_t p = A.col_ptrs[j]; p < A.col_ptrs[j+1]; ++p) {
+				std::size_t i = A.row_indices[p];
+				if (i == j) continue;
+				col[next[i]] = j;
+				val[next[i]] = A.values[p];
+				++next[i];
+			}
+		}
+	}
+
+	std::size_t n_rows() const { return n; }
+	std::size_t nnz() const { return val.size(); }
+
+	/// Matrix-vector product.
+	vec_type operator*(const vec_type &x) const
+	{
+		vec_type y(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			double s = 0.0;
+			for (std::size_t p = row_ptr[i]; p < row_ptr[i+1]; ++p) {
+				s += val[p]*x(col[p]);
+			}
+			y(i) = s;
+		}
+		return y;
+	}
+
+	std::size_t n;
+	std::vector<std::size_t> row_ptr;
+	std::vector<std::size_t> col;
+	std::vector<double> val;
+};
+
+
+/**
+   \brief Interface for preconditioners M ~ A.
+
+   Derived classes implement setup(), which builds M from A, and apply(),
+   which returns inv(M)*r. The solvers call refresh() whenever they
+   rebuild their iteration matrix, which forwards to setup() every
+   refresh_every-th time. A preconditioner keeps its state between
+   calls, so it should not be shared between solves that run in
+   parallel.
+*/
+class preconditioner
+{
+public:
+	preconditioner() : refresh_every(1), n_refresh_(0), n_setup_(0),
+	                   n_(0) {}
+
+	virtual ~preconditioner() {}
+
+	/// Builds the preconditioner for the matrix A.
+	virtual void setup(const csr_matrix &A) = 0;
+
+	/// Returns an approximation of inv(A)*r.
+	virtual vec_type apply(const vec_type &r) const = 0;
+
+	/**
+	   \brief Tells the preconditioner the iteration matrix changed.
+
+	   Calls setup() on the first call, if the size of A changed, and
+	   then every refresh_every-th call.
+	*/
+	void refresh(const csr_matrix &A)
+	{
+		int every = std::max(1, refresh_every);
+		if (n_setup_ == 0 || A.n_rows() != n_ || n_refresh_ % every == 0) {
+			setup(A);
+			n_ = A.n_rows();
+			++n_setup_;
+			n_refresh_ = 0;
+		}
+		++n_refresh_;
+	}
+
+	/// Number of times setup() was called.
+	std::size_t setups() const { return n_setup_; }
+
+	/// Re-use the preconditioner for this many matrix rebuilds.
+	int refresh_every;
+
+protected:
+	/// Zero pivots are replaced by this, like newton does for its
+	/// diagonal preconditioner.
+	static double safe_pivot(double d, double scale)
+	{
+		return d != 0.0 ? d : (scale > 0.0 ? scale : 1.0);
+	}
+
+private:
+	std::size_t n_refresh_, n_setup_, n_;
+};
+
+
+/**
+   \brief Shared part of the incomplete LU factorizations.
+
+   Stores the unit lower triangle L without its diagonal and the upper
+   triangle U with its diagonal as the first entry of each row.
+*/
+class incomplete_lu : public preconditioner
+{
+public:
+	virtual vec_type apply(const vec_type &r) const
+	{
+		vec_type x(r);
+		const std::size_t n = L.n;
+		for (std::size_t i = 0; i < n; ++i) {
+			double s = x(i);
+			for (std::size_t p = L.row_ptr[i]; p < L.row_ptr[i+1]; ++p) {
+				s -= L.val[p]*x(L.col[p]);
+			}
+			x(i) = s;
+		}
+		for (std::size_t i = n; i-- > 0; ) {
+			std::size_t d = U.row_ptr[i];
+			double s = x(i);
+			for (std::size_t p = d + 1; p < U.row_ptr[i+1]; ++p) {
+				s -= U.val[p]*x(U.col[p]);
+			}
+			x(i) = s / U.val[d];
+		}
+		return x;
+	}
+
+	/// Number of non-zeros in L and U together.
+	std::size_t nnz() const { return L.nnz() + U.nnz(); }
+
+protected:
+	void clear_factors(std::size_t n)
+	{
+		L.n = U.n = n;
+		L.row_ptr.assign(1, 0);
+		U.row_ptr.assign(1, 0);
+		L.col.clear(); L.val.clear();
+		U.col.clear(); U.val.clear();
+	}
+
+	csr_matrix L, U;
+};
+
+
+/**
+   \brief ILU(0): incomplete LU with the sparsity pattern of A.
+
+   Cheap to set up and apply, and exact for tridiagonal matrices.
+*/
+class ilu0 : public incomplete_lu
+{
+public:
+	virtual void setup(const csr_matrix &A)
+	{
+		const std::size_t n = A.n;
+		std::vector<double> a(A.val);
+		std::vector<std::size_t> diag(n);
+		std::vector<long> pos(n, -1);
+
+		for (std::size_t i = 0; i < n; ++i) {
+			for (std::size_t p = A.row_ptr[i]; p < A.row_ptr[i+1]; ++p) {
+				pos[A.col[p]] = p;
+			}
+			for (std::size_t p = A.row_ptr[i]; p < A.row_ptr[i+1]; ++p) {
+				std::size_t k = A.col[p];
+				if (k >= i) break;
+				a[p] /= a[diag[k]];
+				for (std::size_t q = diag[k] + 1; q < A.row_ptr[k+1]; ++q) {
+					long pj = pos[A.col[q]];
+					if (pj >= 0) a[pj] -= a[p]*a[q];
+				}
+			}
+			diag[i] = pos[i];
+			a[diag[i]] = safe_pivot(a[diag[i]], 1.0);
+			for (std::size_t p = A.row_ptr[i]; p < A.row_ptr[i+1]; ++p) {
+				pos[A.col[p]] = -1;
+			}
+		}
+
+		clear_factors(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			for (std::size_t p = A.row_ptr[i]; p < diag[i]; ++p) {
+				L.col.push_back(A.col[p]);
+				L.val.push_back(a[p]);
+			}
+			for (std::size_t p = diag[i]; p < A.row_ptr[i+1]; ++p) {
+				U.col.push_back(A.col[p]);
+				U.val.push_back(a[p]);
+			}
+			L.row_ptr.push_back(L.col.size());
+			U.row_ptr.push_back(U.col.size());
+		}
+	}
+};
+
+
+/**
+   \brief ILUT: incomplete LU with a drop tolerance and a fill limit.
+
+   Entries smaller than drop_tol times the norm of their row of A are
+   dropped, and of the rest at most fill entries per row are kept in
+   both L and U. More robust than ILU(0) for matrices that are far from
+   diagonally dominant, at a higher setup cost.
+*/
+class ilut : public incomplete_lu
+{
+public:
+	explicit ilut(double drop_tol = 1e-4, std::size_t fill = 10)
+		: drop_tol(drop_tol), fill(fill) {}
+
+	virtual void setup(const csr_matrix &A)
+	{
+		const std::size_t n = A.n;
+		std::vector<double> w(n, 0.0);
+		std::vector<bool> used(n, false);
+		std::vector<std::size_t> nz;
+
+		clear_factors(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			// Scatter row i of A into w:
+			double row_norm = 0.0;
+			std::set<std::size_t> lower;
+			nz.clear();
+			for (std::size_t p = A.row_ptr[i]; p < A.row_ptr[i+1]; ++p) {
+				std::size_t j = A.col[p];
+				w[j] = A.val[p];
+				used[j] = true;
+				nz.push_back(j);
+				if (j < i) lower.insert(j);
+				row_norm += A.val[p]*A.val[p];
+			}
+			if (!used[i]) {
+				w[i] = 0.0;
+				used[i] = true;
+				nz.push_back(i);
+			}
+			double tau = drop_tol*std::sqrt(row_norm);
+
+			// Eliminate the lower part, in increasing column order:
+			while (!lower.empty()) {
+				std::size_t k = *lower.begin();
+				lower.erase(lower.begin());
+				std::size_t d = U.row_ptr[k];
+				double wk = w[k] / U.val[d];
+				if (std::fabs(wk) < tau) {
+					w[k] = 0.0;
+					continue;
+				}
+				w[k] = wk;
+				for (std::size_t q = d + 1; q < U.row_ptr[k+1]; ++q) {
+					std::size_t j = U.col[q];
+					if (!used[j]) {
+						used[j] = true;
+						w[j] = 0.0;
+						nz.push_back(j);
+						if (j < i) lower.insert(j);
+					}
+					w[j] -= wk*U.val[q];
+				}
+			}
+
+			// Keep the largest entries of the L and U parts:
+			keep_largest(nz, w, tau, 0, i, L);
+			U.col.push_back(i);
+			U.val.push_back(safe_pivot(w[i], tau));
+			keep_largest(nz, w, tau, i + 1, n, U);
+			L.row_ptr.push_back(L.col.size());
+			U.row_ptr.push_back(U.col.size());
+
+			for (std::size_t j : nz) {
+				w[j] = 0.0;
+				used[j] = false;
+			}
+		}
+	}
+
+	double drop_tol;   ///< Relative drop tolerance
+	std::size_t fill;  ///< Maximum number of entries per row in L and U
+
+private:
+	/// Appends the at most fill largest entries of w with column
+	/// in [j0, j1) and magnitude of at least tau to F, sorted by column.
+	void keep_largest(const std::vector<std::size_t> &nz,
+	                  const std::vector<double> &w, double tau,
+	                  std::size_t j0, std::size_t j1, csr_matrix &F) const
+	{
+		std::vector<std::pair<double, std::size_t> > cand;
+		for (std::size_t j : nz) {
+			if (j >= j0 && j < j1 && w[j] != 0.0 && std::fabs(w[j]) >= tau) {
+				cand.push_back(std::make_pair(-std::fabs(w[j]), j));
+			}
+		}
+		if (cand.size() > fill) {
+			std::nth_element(cand.begin(), cand.begin() + fill, cand.end());
+			cand.resize(fill);
+		}
+		std::vector<std::size_t> cols;
+		for (const auto &c : cand) cols.push_back(c.second);
+		std::sort(cols.begin(), cols.end());
+		for (std::size_t j : cols) {
+			F.col.push_back(j);
+			F.val.push_back(w[j]);
+		}
+	}
+};
+
+
+/**
+   \brief Block-Jacobi: exact LU decompositions of the diagonal blocks.
+
+   Natural for systems of weakly coupled subsystems, with one block per
+   subsystem. For the IRK stage system, a block size of Neq gives one
+   block per stage.
+*/
+class block_jacobi : public preconditioner
+{
+public:
+	/// Uses blocks of block_size rows (the last one may be smaller).
+	explicit block_jacobi(std::size_t block_size) : block_size(block_size) {}
+
+	/// Uses blocks with the given sizes, which should add up to n.
+	explicit block_jacobi(const std::vector<std::size_t> &sizes)
+		: block_size(0), sizes(sizes) {}
+
+	virtual void setup(const csr_matrix &A)
+	{
+		const std::size_t n = A.n;
+		offsets.clear();
+		std::size_t o = 0;
+		for (std::size_t k = 0; o < n; ++k) {
+			std::size_t s = block_size;
+			if (block_size == 0) {
+				s = k < sizes.size() ? sizes[k] : n - o;
+			}
+			s = std::min(std::max<std::size_t>(s, 1), n - o);
+			offsets.push_back(o);
+			o += s;
+		}
+		offsets.push_back(n);
+
+		std::size_t n_blocks = offsets.size() - 1;
+		L.resize(n_blocks);
+		U.resize(n_blocks);
+		P.resize(n_blocks);
+		for (std::size_t k = 0; k < n_blocks; ++k) {
+			std::size_t b0 = offsets[k], b1 = offsets[k+1];
+			mat_type B = arma::zeros(b1 - b0, b1 - b0);
+			for (std::size_t i = b0; i < b1; ++i) {
+				for (std::size_t p = A.row_ptr[i]; p < A.row_ptr[i+1]; ++p) {
+					std::size_t j = A.col[p];
+					if (j >= b0 && j < b1) B(i - b0, j - b0) = A.val[p];
+				}
+			}
+			if (!arma::lu(L[k], U[k], P[k], B)) {
+				// Leave this block unpreconditioned:
+				L[k] = U[k] = P[k] = arma::eye(b1 - b0, b1 - b0);
+				continue;
+			}
+			// A singular block, e.g. the algebraic part of a DAE, leaves
+			// (nearly) zero pivots in U. Shift them like the incomplete
+			// factorizations do:
+			mat_type B_abs = arma::abs(B);
+			double scale = B_abs.max();
+			for (std::size_t i = 0; i < b1 - b0; ++i) {
+				if (std::fabs(U[k](i,i)) <= 1e-14*scale) {
+					U[k](i,i) = safe_pivot(0.0, scale);
+				}
+			}
+		}
+	}
+
+	virtual vec_type apply(const vec_type &r) const
+	{
+		vec_type x(r.n_elem);
+		for (std::size_t k = 0; k + 1 < offsets.size(); ++k) {
+			std::size_t b0 = offsets[k], b1 = offsets[k+1] - 1;
+			vec_type rk = r.subvec(b0, b1);
+			vec_type tmp = arma::solve(arma::trimatl(L[k]), P[k]*rk);
+			x.subvec(b0, b1) = arma::solve(arma::trimatu(U[k]), tmp);
+		}
+		return x;
+	}
+
+	std::size_t block_size;          ///< Uniform block size, or 0
+	std::vector<std::size_t> sizes;  ///< Block sizes if block_size is 0
+
+private:
+	std::vector<std::size_t> offsets;
+	std::vector<mat_type> L, U, P;
+};
+
+
+/**
+   \brief Hook for user-supplied preconditioners, e.g. ones built from a
+   simplified physical model instead of from A.
+*/
+class callback_preconditioner : public preconditioner
+{
+public:
+	typedef std::function<void(const csr_matrix &)> setup_function;
+	typedef std::function<vec_type(const vec_type &)> apply_function;
+
+	/// \param setup_func  Called with the iteration matrix on setup.
+	///                    May be empty if there is nothing to set up.
+	/// \param apply_func  Returns an approximation of inv(A)*r.
+	callback_preconditioner(setup_function setup_func,
+	                        apply_function apply_func)
+		: setup_func(std::move(setup_func)),
+		  apply_func(std::move(apply_func)) {}
+
+	virtual void setup(const csr_matrix &A)
+	{
+		if (setup_func) setup_func(A);
+	}
+
+	virtual vec_type apply(const vec_type &r) const
+	{
+		return apply_func(r);
+	}
+
+private:
+	setup_function setup_func;
+	apply_function apply_func;
+};
+
+
+/**
+   \brief Options for the iterative linear solves.
+*/
+struct options
+{
+	options() : tol(1e-8), restart(30), maxit(300), precond(nullptr) {}
+
+	/// Stop once the residual is below tol times the norm of the RHS.
+	double tol;
+
+	/// Number of iterations before GMRES restarts.
+	int restart;
+
+	/// Maximum total number of iterations per solve.
+	int maxit;
+
+	/// Right preconditioner, or nullptr for none.
+	preconditioner *precond;
+};
+
+
+/**
+   \brief Statistics of one linear solve.
+*/
+struct status
+{
+	status() : conv_status(SUCCESS), iters(0), res(0.0) {}
+
+	int conv_status;  ///< See \ref krylov_ret_codes
+	int iters;        ///< Number of iterations
+	double res;       ///< Final relative residual
+};
+
+
+/**
+   \brief Solves A*x = b with restarted GMRES.
+
+   Uses right preconditioning, so the residual that is monitored is the
+   true residual of the unpreconditioned system.
+
+   \param A       The matrix, anything that has operator* with a vector.
+   \param b       The right-hand side.
+   \param x       Initial guess on input, solution on output.
+   \param opts    Options (see \ref options).
+   \param stats   Will contain the statistics of the solve.
+
+   \returns the status code, see \ref krylov_ret_codes.
+*/
+template <typename matrix_type> inline
+int gmres(const matrix_type &A, const vec_type &b, vec_type &x,
+          const options &opts, status &stats)
+{
+	const std::size_t n = b.n_elem;
+	const int m = std::max(1, std::min<int>(opts.restart, n));
+	const preconditioner *M = opts.precond;
+	auto precond = [M](const vec_type &v) -> vec_type
+		{ return M ? M->apply(v) : v; };
+
+	stats.iters = 0;
+	stats.conv_status = MAXIT_EXCEEDED;
+	double b_norm = arma::norm(b);
+	if (b_norm == 0.0) {
+		x.zeros(n);
+		stats.res = 0.0;
+		stats.conv_status = SUCCESS;
+		return SUCCESS;
+	}
+	if (x.n_elem != n) x.zeros(n);
+	const double target = opts.tol*b_norm;
+
+	mat_type V(n, m + 1);
+	mat_type H(m + 1, m);
+	vec_type cs(m), sn(m), g(m + 1);
+
+	while (true) {
+		vec_type r = b - A*x;
+		double beta = arma::norm(r);
+		stats.res = beta / b_norm;
+		if (beta <= target) {
+			stats.conv_status = SUCCESS;
+			break;
+		}
+		if (stats.iters >= opts.maxit) break;
+
+		H.zeros();
+		g.zeros();
+		g(0) = beta;
+		V.col(0) = r / beta;
+
+		int k = 0;
+		while (k < m && stats.iters < opts.maxit) {
+			++stats.iters;
+			vec_type w = A*precond(V.col(k));
+
+			// Modified Gram-Schmidt:
+			for (int i = 0; i <= k; ++i) {
+				H(i,k) = arma::dot(w, V.col(i));
+				w -= H(i,k)*V.col(i);
+			}
+			H(k+1,k) = arma::norm(w);
+			bool breakdown = H(k+1,k) <= 1e-14*beta;
+			if (!breakdown) V.col(k+1) = w / H(k+1,k);
+
+			// Apply the earlier rotations and eliminate H(k+1,k):
+			for (int i = 0; i < k; ++i) {
+				double tmp = cs(i)*H(i,k) + sn(i)*H(i+1,k);
+				H(i+1,k) = -sn(i)*H(i,k) + cs(i)*H(i+1,k);
+				H(i,k) = tmp;
+			}
+			double rho = std::hypot(H(k,k), H(k+1,k));
+			cs(k) = H(k,k) / rho;
+			sn(k) = H(k+1,k) / rho;
+			H(k,k) = rho;
+			H(k+1,k) = 0.0;
+			g(k+1) = -sn(k)*g(k);
+			g(k) = cs(k)*g(k);
+			++k;
+
+			if (breakdown || std::fabs(g(k)) <= target) break;
+		}
+
+		// Back substitution for the update in the Krylov space:
+		vec_type y(k);
+		for (int i = k - 1; i >= 0; --i) {
+			double s = g(i);
+			for (int j = i + 1; j < k; ++j) {
+				s -= H(i,j)*y(j);
+			}
+			y(i) = s / H(i,i);
+		}
+		vec_type dx = V.cols(0, k - 1)*y;
+		x += precond(dx);
+	}
+	return stats.conv_status;
+}
+
+
+/**
+   \brief Drop-in replacement for a stored LU decomposition that uses
+   GMRES.
+
+   Call set_matrix() whenever the iteration matrix is rebuilt. It
+   refreshes the preconditioner, if any.
+*/
+class solver
+{
+public:
+	solver() : opts(nullptr), total_iters(0), failures(0),
+	           last_status(SUCCESS) {}
+
+	void set_matrix(const mat_type &A)
+	{
+		A_ = csr_matrix(A);
+		if (opts && opts->precond) opts->precond->refresh(A_);
+	}
+
+	void set_matrix(const arma::sp_mat &A)
+	{
+		A_ = csr_matrix(A);
+		if (opts && opts->precond) opts->precond->refresh(A_);
+	}
+
+	/// Returns the approximate solution of A*x = b.
+	/// Check last_status to see if it reached the tolerance.
+	vec_type solve(const vec_type &b) const
+	{
+		assert(opts && "Krylov options not set!");
+		vec_type x = arma::zeros(b.n_elem);
+		status stats;
+		last_status = gmres(A_, b, x, *opts, stats);
+		if (last_status != SUCCESS) ++failures;
+		total_iters += stats.iters;
+		return x;
+	}
+
+	/// Solves for each column of B.
+	mat_type solve(const mat_type &B) const
+	{
+		mat_type X(B.n_rows, B.n_cols);
+		int worst = SUCCESS;
+		for (std::size_t j = 0; j < B.n_cols; ++j) {
+			X.col(j) = solve(vec_type(B.col(j)));
+			if (last_status != SUCCESS) worst = last_status;
+		}
+		last_status = worst;
+		return X;
+	}
+
+	/// Options for the solves. Nothing is solved iteratively if null.
+	const options *opts;
+
+	/// Total number of GMRES iterations so far.
+	mutable std::size_t total_iters;
+
+	/// Number of solves that did not reach the tolerance.
+	mutable std::size_t failures;
+
+	/// Status of the last call to solve(), see \ref krylov_ret_codes.
+	/// For a matrix, it is not SUCCESS if any column failed.
+	mutable int last_status;
+
+private:
+	csr_matrix A_;
+};
+
+
+} // namespace krylov
+
+
+#endif // KRYLOV_HPP
@@ -0,0 +1,139 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file logging.hpp
+
+   \brief Leveled logging for the integrators.
+
+   Messages go to a log_sink, passed by pointer through the options. The
+   default is no sink at all, in which case nothing is formatted. Messages
+   below REHUEL_MIN_LOG_LEVEL are removed at compile time. Use as
+   \code{
+     REHUEL_LOG(sink, REHUEL_LOG_INFO) << "t = " << t;
+   \code}
+*/
+
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+
+/// \brief Log levels, from most to least verbose.
+enum log_levels {
+	REHUEL_LOG_DEBUG   = 0,  ///< Per-step details
+	REHUEL_LOG_INFO    = 1,  ///< Banners and progress
+	REHUEL_LOG_WARNING = 2,  ///< Something was adjusted automatically
+	REHUEL_LOG_ERROR   = 3,  ///< The solve failed
+	REHUEL_LOG_NONE    = 4   ///< Disables everything
+};
+
+
+/// Messages below this level are compiled out.
+#ifndef REHUEL_MIN_LOG_LEVEL
+#define REHUEL_MIN_LOG_LEVEL REHUEL_LOG_DEBUG
+#endif
+
+
+/**
+   \brief Interface for log sinks.
+*/
+class log_sink
+{
+public:
+	explicit log_sink(int level = REHUEL_LOG_INFO) : level(level) {}
+	virtual ~log_sink() {}
+
+	/// Receives one complete message.
+	virtual void write(int msg_level, const std::string &msg) = 0;
+
+	/// Messages below this level are not even formatted.
+	int level;
+};
+
+
+/**
+   \brief Writes messages to an std::ostream, one at a time.
+*/
+class stream_sink : public log_sink
+{
+public:
+	explicit stream_sink(std::ostream &out, int level = REHUEL_LOG_INFO)
+		: log_sink(level), out(out) {}
+
+	virtual void write(int msg_level, const std::string &msg)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		out << msg;
+	}
+
+private:
+	std::ostream &out;
+	std::mutex mtx;
+};
+
+
+/**
+   \brief Returns true if a message of given level should be formatted.
+*/
+inline bool log_enabled(const log_sink *sink, int msg_level)
+{
+	return msg_level >= REHUEL_MIN_LOG_LEVEL && sink &&
+		msg_level >= sink->level;
+}
+
+
+/**
+   \brief Collects one message and hands it to the sink when destroyed.
+*/
+class log_line
+{
+public:
+	log_line(log_sink *sink, int msg_level)
+		: sink(sink), msg_level(msg_level) {}
+
+	~log_line()
+	{
+		sink->write(msg_level, ss.str());
+	}
+
+	std::ostream &stream()
+	{
+		return ss;
+	}
+
+private:
+	log_sink *sink;
+	int msg_level;
+	std::ostringstream ss;
+};
+
+
+/// Logs a message, but only formats it if it passes both level checks.
+#define REHUEL_LOG(sink, msg_level)                       \
+	if (!log_enabled((sink), (msg_level))) {}          \
+	else log_line((sink), (msg_level)).stream()
+
+
+#endif // LOGGING_HPP
@@ -31,6 +31,8 @@
 #include <cassert>
 #include <limits>
 #include <iomanip>
+#include <iterator>
+#include <utility>
 
 #include "cyclic_buffer.hpp"
 #include "enums.hpp"
@@ -39,6 +41,9 @@
 #include "newton.hpp"
 #include "options.hpp"
 #include "output.hpp"
+#include "progress.hpp"
+#include "logging.hpp"
+#include "sensitivity.hpp"
 
 
 /**
@@ -50,11 +55,74 @@ typedef arma::vec vec_type;
 typedef arma::mat mat_type;
 
 struct solver_options {
+	solver_options() : order(1), sens_opts(nullptr), progress(nullptr),
+	                   log(nullptr), krylov(nullptr) {}
+
 	int order;
+
+	/// If set, also integrate forward sensitivities (BDF only).
+	const sensitivity_options *sens_opts;
+
+	/// If set, publish progress after every step (see progress.hpp).
+	progress_handle *progress;
+
+	/// Where log messages go (see logging.hpp). No logging if null.
+	log_sink *log;
+
+	/// If set, the BDF Newton iteration solves its linear systems with
+	/// preconditioned GMRES (see krylov.hpp).
+	const krylov::options *krylov;
 };
 
 struct multistep_output : basic_output
-{};
+{
+	/// Forward sensitivities at t_vals, only if sens_opts is set.
+	std::vector<mat_type> sens_vals;
+};
+
+
+/**
+   \brief Appends sol2 to sol1 without copying the stored vectors.
+
+   sol2 is left empty.
+*/
+inline void append_multistep_output(multistep_output &sol1,
+                                    multistep_output &&sol2)
+{
+	sol1.sens_vals.insert(sol1.sens_vals.end(),
+	                      std::make_move_iterator(sol2.sens_vals.begin()),
+	                      std::make_move_iterator(sol2.sens_vals.end()));
+	sol2.sens_vals.clear();
+	append_basic_output(sol1, std::move(sol2));
+}
+
+
+/**
+   \brief Merges two multistep_output structs.
+
+   \returns a solution struct that contains the merged contents of both.
+*/
+inline multistep_output merge_multistep_output(const multistep_output &sol1,
+                                               const multistep_output &sol2)
+{
+	multistep_output merger(sol1);
+	multistep_output tail(sol2);
+	append_multistep_output(merger, std::move(tail));
+	return merger;
+}
+
+
+/**
+   \brief Merges two multistep_output structs, re-using their storage.
+
+   \overload merge_multistep_output
+*/
+inline multistep_output merge_multistep_output(multistep_output &&sol1,
+                                               multistep_output &&sol2)
+{
+	append_multistep_output(sol1, std::move(sol2));
+	return std::move(sol1);
+}
 
 
 /**
@@ -113,15 +181,18 @@ void adams_bashforth_step(functor_type &func, int order,
 
 
 template <typename functor_type> inline
-basic_output bootstrap_history(functor_type &func, int order, const vec_type &y,
-                               double t, double dt)
+multistep_output bootstrap_history(functor_type &func, int order,
+                                   const vec_type &y, double t, double dt,
+                                   const sensitivity_options *sens_opts = nullptr)
 {
+	// The legs need to store their solution, since the last stored
+	// point is what ends up in the history:
 	output_options output_opts;
-	output_opts.output_mode = output_options::NO_OUTPUT;
 
-	basic_output start;
+	multistep_output start;
 	start.t_vals.push_back(t);
 	start.y_vals.push_back(y);
+	if (sens_opts) start.sens_vals.push_back(sens_opts->S0);
 
 	// For bootstrapping, just use a high-order RK method:
 	int method = irk::LOBATTO_IIIC_85;
@@ -131,6 +202,14 @@ basic_output bootstrap_history(functor_type &func, int order, const vec_type &y,
 	opts.rel_tol = 1e-10;
 	opts.abs_tol = 1e-9;
 
+	// The sensitivities are bootstrapped along, each leg starting
+	// from where the previous one ended:
+	sensitivity_options leg_sens;
+	if (sens_opts) {
+		leg_sens = *sens_opts;
+		opts.sens_opts = &leg_sens;
+	}
+
 	for (int i = 1; i < order; ++i) {
 		auto tmp_sol = irk::odeint(func,  t, t+dt, start.y_vals[i-1],
 		                           opts, output_opts, method);
@@ -138,6 +217,10 @@ basic_output bootstrap_history(functor_type &func, int order, const vec_type &y,
 		t += dt;
 		start.t_vals.push_back(t);
 		start.y_vals.push_back(tmp_sol.y_vals[Nt-1]);
+		if (sens_opts) {
+			leg_sens.S0 = tmp_sol.sens_vals.back();
+			start.sens_vals.push_back(leg_sens.S0);
+		}
 	}
 
 	return start;
@@ -149,15 +232,18 @@ basic_output adams_bashforth(functor_type &func, double t0, double t1,
                              const vec_type &y0,
                              const solver_options &solver_opts, double dt)
 {
+	log_sink *log = solver_opts.log;
 	if (t0 + dt > t1) {
-		std::cerr << "    Rehuel: Initial dt (" << dt;
+		REHUEL_LOG(log, REHUEL_LOG_WARNING)
+			<< "    Rehuel: Initial dt (" << dt
+			<< ") too large for interval! Reducing to "
+			<< t1 - t0 << "\n";
 		dt = t1 - t0;
-		std::cerr << ") too large for interval! Reducing to "
-		          << dt << "\n";
 	}
-	std::cerr << "    Rehuel: Integrating over interval [ "
-	          << t0 << ", " << t1 << " ]...\n"
-	          << "            Method = Adams-Bashforth\n";
+	REHUEL_LOG(log, REHUEL_LOG_INFO)
+		<< "    Rehuel: Integrating over interval [ "
+		<< t0 << ", " << t1 << " ]...\n"
+		<< "            Method = Adams-Bashforth\n";
 
 
 	double t = t0;
@@ -191,7 +277,10 @@ basic_output adams_bashforth(functor_type &func, double t0, double t1,
 		++step;
 		sol.t_vals.push_back(t);
 		sol.y_vals.push_back(y);
+		publish_progress(solver_opts.progress, t0, t1, t, dt, step,
+		                 step, 0, 0);
 	}
+	if (solver_opts.progress) solver_opts.progress->mark_done();
 	timer.toc("    Solving with Adams-Bashforth method");
 	return sol;
 }
@@ -206,27 +295,32 @@ multistep::multistep_output bdf(functor_type &func, double t0, double t1,
 	double t = t0;
 	multistep_output sol;
 	sol.status = SUCCESS;
+	log_sink *log = solver_opts.log;
 
 	if (solver_opts.order > 6) {
-		std::cerr << "BDF methods over order 6 do not exist!\n";
+		REHUEL_LOG(log, REHUEL_LOG_ERROR)
+			<< "BDF methods over order 6 do not exist!\n";
 		sol.status = GENERAL_ERROR;
 		return sol;
 	}
 	if (solver_opts.order <= 0) {
-		std::cerr << "BDF method of order <= 0 does not make sense!\n";
+		REHUEL_LOG(log, REHUEL_LOG_ERROR)
+			<< "BDF method of order <= 0 does not make sense!\n";
 		sol.status = GENERAL_ERROR;
 		return sol;
 	}
 
 	if (t0 + dt > t1) {
-		std::cerr << "    Rehuel: Initial dt (" << dt;
+		REHUEL_LOG(log, REHUEL_LOG_WARNING)
+			<< "    Rehuel: Initial dt (" << dt
+			<< ") too large for interval! Reducing to "
+			<< t1 - t0 << "\n";
 		dt = t1 - t0;
-		std::cerr << ") too large for interval! Reducing to "
-		          << dt << "\n";
 	}
-	std::cerr << "    Rehuel: Integrating over interval [ "
-	          << t0 << ", " << t1 << " ]...\n"
-	          << "            Method = BDF-" << solver_opts.order << "\n";
+	REHUEL_LOG(log, REHUEL_LOG_INFO)
+		<< "    Rehuel: Integrating over interval [ "
+		<< t0 << ", " << t1 << " ]...\n"
+		<< "            Method = BDF-" << solver_opts.order << "\n";
 
 	assert(dt > 0 && "Cannot use time step size <= 0!");
 
@@ -256,33 +350,45 @@ multistep::multistep_output bdf(functor_type &func, double t0, double t1,
 	vec_type y = y0;
 	long long int step = 0;
 
+	const sensitivity_options *sens_opts = solver_opts.sens_opts;
+
 	cyclic_buffer<vec_type> history(solver_opts.order+1);
+	cyclic_buffer<mat_type> sens_history(solver_opts.order+1);
 	// For multistep methods we need to do some bootstrapping:
-	basic_output hist = bootstrap_history(func, solver_opts.order+1, y, t, dt);
+	multistep_output hist = bootstrap_history(func, solver_opts.order+1,
+	                                          y, t, dt, sens_opts);
 
 	for (std::size_t i = 0; i < hist.t_vals.size(); ++i) {
 		sol.t_vals.push_back(hist.t_vals[i]);
 		sol.y_vals.push_back(hist.y_vals[i]);
 		history.push_back(hist.y_vals[i]);
+		if (sens_opts) {
+			sol.sens_vals.push_back(hist.sens_vals[i]);
+			sens_history.push_back(hist.sens_vals[i]);
+		}
 	}
 	std::size_t hist_size = sol.t_vals.size();
 	t = sol.t_vals[hist_size-1];
 	y = sol.y_vals[hist_size-1];
 
-	std::cerr << "  Bootstrapping done. Time grid:\n   ";
-	for (double tn : sol.t_vals) {
-		std::cerr << " " << tn;
+	if (log_enabled(log, REHUEL_LOG_DEBUG)) {
+		log_line line(log, REHUEL_LOG_DEBUG);
+		line.stream() << "  Bootstrapping done. Time grid:\n   ";
+		for (double tn : sol.t_vals) {
+			line.stream() << " " << tn;
+		}
+		line.stream() << "\n";
 	}
-	std::cerr << "\n";
 	timer.toc("    Solving with BDF method");
-	std::cout << "Starting with position " << y << " at time " << t << "\n";
+	REHUEL_LOG(log, REHUEL_LOG_DEBUG)
+		<< "Starting with position " << y << " at time " << t << "\n";
 
 	newton::options newton_opts;
 	newton::status newton_status;
 	newton_opts.tol = 1e-4;
 	newton_opts.dx_delta = 1e-10;
 	newton_opts.maxit = 500;
-	newton_opts.time_internals = true;
+	newton_opts.krylov = solver_opts.krylov;
 
 	struct newton_multistep_helper {
 		typedef arma::vec vec_type;
@@ -299,7 +405,10 @@ multistep::multistep_output bdf(functor_type &func, double t0, double t1,
 		{ return y + const_part - func_weight*func.fun(t_nplus, y); }
 
 		jac_type jac(const arma::vec &y)
-		{ return I - func_weight*func.jac(t_nplus, y); }
+		{
+			J_last = I - func_weight*func.jac(t_nplus, y);
+			return J_last;
+		}
 
 	        functor_type func;
 		double t_nplus;
@@ -307,6 +416,9 @@ multistep::multistep_output bdf(functor_type &func, double t0, double t1,
 		double func_weight;
 
 		jac_type I;
+
+		/// The last iteration matrix the Newton solver asked for.
+		jac_type J_last;
 	};
 
 
@@ -328,20 +440,58 @@ multistep::multistep_output bdf(functor_type &func, double t0, double t1,
 			newton_functor, y, newton_opts, newton_status);
 
 		if (newton_status.conv_status != newton::SUCCESS) {
-			std::cerr << "Newton iteration failed on BDF system!\n";
+			REHUEL_LOG(log, REHUEL_LOG_ERROR)
+				<< "Newton iteration failed on BDF system!\n";
 			sol.status = INTERNAL_SOLVE_FAILURE;
+			if (solver_opts.progress) solver_opts.progress->mark_done();
 			return sol;
 		}
 
+		if (sens_opts) {
+			// Differentiating the BDF formula to p gives
+			// (I - w*J)*S_{n+1} = w*dfdp - sum_i C_i*S_{n-i},
+			// with I - w*J the Newton iteration matrix at y_{n+1}.
+			// The Newton solve refreshes it at every iterate, so the
+			// last one it used is re-used instead of evaluating J again.
+			double w = newton_functor.func_weight;
+			mat_type rhs = arma::zeros(y.size(), sens_opts->S0.n_cols);
+			add_dfdp(func, t + dt, yn_plus, rhs, sens_opts->param_col);
+			rhs *= w;
+			for (std::size_t i = 0; i < solver_opts.order; ++i) {
+				rhs -= bdf_params[i]*sens_history[i];
+			}
+			mat_type S_n;
+			if (solver_opts.krylov) {
+				krylov::solver linear;
+				linear.opts = solver_opts.krylov;
+				linear.set_matrix(newton_functor.J_last);
+				S_n = linear.solve(rhs);
+				if (linear.last_status != krylov::SUCCESS) {
+					REHUEL_LOG(log, REHUEL_LOG_ERROR)
+						<< "Linear solve for the sensitivities failed!\n";
+					sol.status = INTERNAL_SOLVE_FAILURE;
+					if (solver_opts.progress) {
+						solver_opts.progress->mark_done();
+					}
+					return sol;
+				}
+			} else {
+				S_n = arma::solve(newton_functor.J_last, rhs);
+			}
+			sol.sens_vals.push_back(S_n);
+			sens_history.push_back(S_n);
+		}
+
 		t += dt;
 		++step;
 		y = yn_plus;
 		sol.t_vals.push_back(t);
 		sol.y_vals.push_back(y);
 		history.push_back(y);
+		publish_progress(solver_opts.progress, t0, t1, t, dt, step,
+		                 step, 0, 0);
 	}
-
-
+	if (solver_opts.progress) solver_opts.progress->mark_done();
 
 	return sol;
 }
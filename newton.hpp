@@ -30,17 +30,16 @@
 #include "my_timer.hpp"
 
 #include "arma_include.hpp"
+#include "krylov.hpp"
 #include <iomanip>
 #include <fstream>
 
-typedef arma::vec vec_type;
-typedef arma::mat mat_type;
-
-
-
 /// \brief A namespace with solvers for non-linear systems of equations.
 namespace newton {
 
+typedef arma::vec vec_type;
+typedef arma::mat mat_type;
+
 /// \brief Return codes for newton_solve.
 enum newton_solve_ret_codes {
 	SUCCESS = 0,                ///< Converged to tolerance
@@ -57,7 +56,7 @@ enum newton_solve_ret_codes {
 struct options {
 	options() : tol(1e-4), dx_delta(1e-4), maxit(5000),
 	            time_internals(false), max_step(-1), refresh_jac(10),
-	            precondition(false), limit_step(false) {}
+	            precondition(false), limit_step(false), krylov(nullptr) {}
 
 	double tol;           ///< Desired tolerance.
 	double dx_delta;      ///< Terminate if the increment is below this.
@@ -75,19 +74,26 @@ struct options {
 
 	/// If true, tries to limit the step to two extremes.
 	bool limit_step;
+
+	/// If set, solve the linear systems with preconditioned GMRES
+	/// instead of an LU decomposition (see krylov.hpp). The
+	/// preconditioner is refreshed whenever the Jacobi matrix is.
+	const krylov::options *krylov;
 };
 
 /**
    \brief contains status for the solver.
 */
 struct status {
-	status() : conv_status(SUCCESS), res(0.0), iters(0), eta_final(0.0){}
+	status() : conv_status(SUCCESS), res(0.0), iters(0), eta_final(0.0),
+	           linear_iters(0) {}
 
 
 	int conv_status;  ///< Status code, see \ref newton_solve_ret_codes
 	double res;       ///< Final residual (F(x_root)^2)
 	int iters;        ///< Number of iterations actually used
 	double eta_final; ///< Last value of eta_k
+	int linear_iters; ///< GMRES iterations, if opts.krylov was set
 };
 
 
@@ -383,8 +389,12 @@ vec_type newton_iterate_impl(functor_type &func, vec_type x,
 	else max_step2 = -1;
 
 	auto J = func.jac(x);
-	bool store_LU = (refresh_jac > 3);
-	if (store_LU) {
+	krylov::solver linear;
+	linear.opts = opts.krylov;
+	bool store_LU = (refresh_jac > 3) && !linear.opts;
+	if (linear.opts) {
+		linear.set_matrix(J);
+	} else if (store_LU) {
 		// Save LU decomposition and use it for solving.
 		// Decomp is such that
 		// P.t() * L * U = J;
@@ -428,7 +438,19 @@ vec_type newton_iterate_impl(functor_type &func, vec_type x,
 		}
 
 		try{
-			if( precondition ){
+			if( linear.opts ){
+				direction = -linear.solve(r);
+				// An unconverged direction could still make the
+				// increments small, so do not accept it:
+				if( linear.last_status != krylov::SUCCESS ){
+					stats.conv_status = GENERIC_ERROR;
+					stats.linear_iters = linear.total_iters;
+					if( !quiet ){
+						std::cerr << "Newton: GMRES did not converge!\n";
+					}
+					return x;
+				}
+			}else if( precondition ){
 				for( std::size_t i = 0; i < N; ++i ){
 					if( J(i,i) != 0.0 ){
 						P(i,i) = 1.0 / J(i,i);
@@ -457,7 +479,8 @@ vec_type newton_iterate_impl(functor_type &func, vec_type x,
 			}
 		}catch( std::exception &e ){
 			stats.conv_status = GENERIC_ERROR;
-			std::cerr << "Newton caught generic error!\n";
+			stats.linear_iters = linear.total_iters;
+			if( !quiet ) std::cerr << "Newton caught generic error!\n";
 			return x;
 		}
 		//std::cerr << "Step direction: " << direction << "\n";
@@ -472,7 +495,9 @@ vec_type newton_iterate_impl(functor_type &func, vec_type x,
 		xn = x0 + lambda*direction;
 		if( refresh_jac ){
 			J = func.jac(xn);
-			if (store_LU)  {
+			if (linear.opts) {
+				linear.set_matrix(J);
+			} else if (store_LU)  {
 				// Save LU decomposition and use it for solving.
 				// Decomp is such that
 				// P.t() * L * U = J;
@@ -526,6 +551,7 @@ vec_type newton_iterate_impl(functor_type &func, vec_type x,
 	}
 	stats.res = std::sqrt( res2 );
 	stats.eta_final = eta_k;
+	stats.linear_iters = linear.total_iters;
 	// Check whether or not res is NaN or inf or somesuch.
 	if( !std::isfinite( stats.res ) ){
 		stats.conv_status = GENERIC_ERROR;
@@ -678,4 +704,12 @@ const char *status_message(int status);
 } // namespace newton
 
 
+// Older code uses the vector and matrix types without a namespace.
+// Define REHUEL_NO_GLOBAL_TYPEDEFS to keep them out of the global namespace.
+#ifndef REHUEL_NO_GLOBAL_TYPEDEFS
+using newton::vec_type;
+using newton::mat_type;
+#endif // REHUEL_NO_GLOBAL_TYPEDEFS
+
+
 #endif // NEWTON
@@ -27,13 +27,25 @@
 #ifndef OPTIONS_HPP
 #define OPTIONS_HPP
 
-#include <iosfwd>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "logging.hpp"
 
 
 namespace newton {
 struct options;
 } // namespace newton
 
+struct sensitivity_options;
+class cancel_token;
+class progress_handle;
+class compressed_trajectory;
+struct async_writer_options;
+struct blas_thread_policy;
+
 /**
    \brief struct for common solver options.
 */
@@ -53,8 +65,19 @@ struct common_solver_options
 		  max_dt(0.0),
 		  max_steps(-1),
 		  newton_opts(nullptr),
+		  sens_opts(nullptr),
 		  out_interval(0),
-		  time_internals(false)
+		  time_internals(false),
+		  tstop_dt(0.0),
+		  steady_state_tol(0.0),
+		  steady_state_steps(3),
+		  steady_state_jump(true),
+		  max_wall_time(0.0),
+		  max_fun_evals(-1),
+		  max_jac_evals(-1),
+		  cancel(nullptr),
+		  progress(nullptr),
+		  blas_policy(nullptr)
 	{ }
 
 	~common_solver_options()
@@ -77,14 +100,83 @@ struct common_solver_options
 	/// Options for the internal solver.
 	const newton::options *newton_opts;
 
+	/// If set, also integrate forward sensitivities (implicit solvers only).
+	const sensitivity_options *sens_opts;
+
 	/// Output interval for error and step:
 	int out_interval;
 
 	/// Keep track of the timings of various parts in solver?
 	bool time_internals;
+
+	/// Times at which the ODE is known to be discontinuous, such as
+	/// switches in a forcing function. The integrator steps exactly onto
+	/// each of them and restarts the step size controller there.
+	std::vector<double> tstops;
+
+	/// If positive, the step size to restart with after a stop. Otherwise,
+	/// the step size that was in use before landing on the stop is used.
+	double tstop_dt;
+
+	/// If positive, terminate once the weighted norm of f(t,y) is below
+	/// this tolerance (see steady_state.hpp). The status is then
+	/// STEADY_STATE_REACHED.
+	double steady_state_tol;
+
+	/// Number of consecutive accepted steps the steady state criterion
+	/// has to hold.
+	int steady_state_steps;
+
+	/// If true, the converged state is stored once more at t1. Otherwise
+	/// the output ends at the time the steady state was detected.
+	bool steady_state_jump;
+
+	/// Maximum wall time of one solve in seconds (0 or less is unlimited).
+	double max_wall_time;
+
+	/// Maximum number of function evaluations (negative is unlimited).
+	long long int max_fun_evals;
+
+	/// Maximum number of Jacobi matrix evaluations (negative is unlimited).
+	long long int max_jac_evals;
+
+	/// If set, the solve stops with status CANCELLED once this token is
+	/// triggered. It is checked once per step (see budget.hpp).
+	const cancel_token *cancel;
+
+	/// If set, the integrator publishes its progress here after every
+	/// accepted step (see progress.hpp).
+	progress_handle *progress;
+
+	/// BLAS thread policy for the parallel parts of this solve (see
+	/// blas_threads.hpp). Only read by bvp::solve, from its ivp_opts,
+	/// for the shooting workers, and by the block-diagonal Jacobian
+	/// backend of irk for its factorization threads. ensemble::reduce
+	/// takes its policy as an argument instead. The BLAS thread count
+	/// is global to the process, so a plain solve never changes it; to
+	/// size BLAS for one large solve, wrap it in a blas_thread_scope
+	/// with the count from choose_blas_threads(). If null, the global
+	/// default policy is used.
+	const blas_thread_policy *blas_policy;
 };
 
 
+/**
+   \brief Returns the sorted stop points that lie strictly inside (t0, t1).
+*/
+inline std::vector<double> active_tstops(const common_solver_options &opts,
+                                         double t0, double t1)
+{
+	std::vector<double> stops;
+	for (double ts : opts.tstops) {
+		if (ts > t0 && ts < t1) stops.push_back(ts);
+	}
+	std::sort(stops.begin(), stops.end());
+	stops.erase(std::unique(stops.begin(), stops.end()), stops.end());
+	return stops;
+}
+
+
 /**
    \brief Specifies how the user wants output. Default is
    for the solver to populate the t_vals and y_vals vectors in a basic_output
@@ -102,9 +194,30 @@ struct output_options {
 
 	std::size_t output_mode = STORE_IN_VECTORS;
 	std::size_t output_interval = 1;
-	std::ostream &log_out = std::cout;
+	/// Where log messages go (see logging.hpp). No logging if null.
+	log_sink *log = nullptr;
 	std::ostream *output_stream;
 
+	/// \deprecated Use log instead. Messages only go here after a call
+	/// to use_log_out(), which wraps it into a stream_sink.
+	std::ostream &log_out = std::cout;
+
+	/// Sends the log messages to log_out, as before log sinks existed.
+	void use_log_out(int level = REHUEL_LOG_INFO)
+	{
+		log_out_sink = std::make_shared<stream_sink>(log_out, level);
+		log = log_out_sink.get();
+	}
+
+	/// If set, the output points are also appended to this compressed
+	/// store (see compressed_trajectory.hpp). Combine with
+	/// disable_store_in_vectors() to keep only the compressed copy.
+	compressed_trajectory *compressed = nullptr;
+
+	/// If set, the file output is formatted and written by a background
+	/// thread (see async_writer.hpp).
+	const async_writer_options *async_write = nullptr;
+
 	bool store_in_vectors() const
 	{
 		return output_mode & (1 << (STORE_IN_VECTORS - 1));
@@ -130,9 +243,33 @@ struct output_options {
 		output_mode &= ~(1 << (STORE_IN_VECTORS - 1));
 	}
 
+private:
+	/// Owns the sink made by use_log_out(), shared between copies.
+	std::shared_ptr<log_sink> log_out_sink;
 };
 
 
+/**
+   \brief Compile-time switches for the step loop of the integrators.
+
+   The integrators pick the instantiation that matches the run-time
+   options once, before the first step, in the way newton_iterate does.
+   Inside the step loop the switches are constants, so disabled features
+   are compiled out.
+
+   \tparam adaptive  Estimate the error and adapt the time step. If
+                     false, the step size is fixed and the integrator
+                     skips the error estimate and the controller.
+   \tparam timed     Keep track of the timings of the solver internals.
+   \tparam store     Store the solution in the output struct.
+*/
+template <bool adaptive, bool timed, bool store>
+struct step_policy
+{
+	static constexpr bool adaptive_step = adaptive;
+	static constexpr bool time_internals = timed;
+	static constexpr bool store_solution = store;
+};
 
 
 
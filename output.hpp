@@ -27,11 +27,66 @@
 #ifndef OUTPUT_HPP
 #define OUTPUT_HPP
 
-struct basic_output {
+#include <utility>
+
+#include "trajectory.hpp"
+
+/**
+   \brief Time points and states of a solution with scalar type eT.
+
+   Time is always stored in double precision.
+*/
+template <typename eT>
+struct scalar_output {
 	int status;
-	
+
 	std::vector<double> t_vals;
-	std::vector<vec_type> y_vals;
+	basic_trajectory<eT> y_vals;
 };
 
+typedef scalar_output<double> basic_output;
+
+
+/**
+   \brief Appends the time points and states of sol2 to sol1.
+
+   The states are moved, not copied. sol2 is left empty.
+*/
+template <typename eT> inline
+void append_basic_output( scalar_output<eT> &sol1, scalar_output<eT> &&sol2 )
+{
+	sol1.status |= sol2.status;
+	sol1.t_vals.insert( sol1.t_vals.end(),
+	                    sol2.t_vals.begin(), sol2.t_vals.end() );
+	sol1.y_vals.append( std::move(sol2.y_vals) );
+	sol2.t_vals.clear();
+}
+
+
+/**
+   \brief Merges everything but the stored trajectory of sol2 into merger.
+
+   Shared by the outputs of the Runge-Kutta solvers, whose counters
+   provide an operator+=.
+
+   \param steps1  Number of time points of the first part of merger.
+   \param steps2  Number of time points of sol2.
+*/
+template <typename rk_output_type> inline
+void merge_rk_counters( rk_output_type &merger, const rk_output_type &sol2,
+                        double steps1, double steps2 )
+{
+	merger.status |= sol2.status;
+	merger.elapsed_time += sol2.elapsed_time;
+	double total_steps = steps1 + steps2;
+	if( total_steps > 0 ){
+		merger.accept_frac = steps1*merger.accept_frac
+			+ steps2*sol2.accept_frac;
+		merger.accept_frac /= total_steps;
+	}
+
+	merger.count += sol2.count;
+	merger.allocs.merge( sol2.allocs );
+}
+
 #endif // OUTPUT_HPP
@@ -0,0 +1,173 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file progress.hpp
+
+   \brief Live progress of a running solve, readable from other threads.
+
+   The integrator is the only writer. It publishes a snapshot after each
+   accepted step through a sequence lock: the sequence number is odd
+   while a snapshot is being written, and readers retry until they see
+   the same even number before and after reading. Readers never block
+   the writer, and the writer never waits for readers. All fields are
+   atomics, so there are no data races in the C++ sense.
+
+   If no handle is set in the solver options, the integrators skip all
+   of this, so there is no cost when unused.
+*/
+
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
+#include <atomic>
+#include <cstddef>
+
+
+/**
+   \brief A consistent copy of the progress of a solve.
+*/
+struct progress_snapshot
+{
+	progress_snapshot() : t0(0.0), t1(0.0), t(0.0), dt(0.0), steps(0),
+	                      attempts(0), rejections(0), fun_evals(0),
+	                      done(false) {}
+
+	double t0, t1;          ///< Integration interval
+	double t;               ///< Current time
+	double dt;              ///< Current time step size
+	long long int steps;    ///< Accepted steps
+	long long int attempts; ///< Attempted steps
+	long long int rejections; ///< Rejected steps
+	long long int fun_evals;  ///< Function evaluations
+	bool done;              ///< True once the solve has returned
+
+	/// Fraction of [t0, t1] that has been covered.
+	double fraction_done() const
+	{
+		return t1 > t0 ? (t - t0) / (t1 - t0) : 1.0;
+	}
+
+	/// Fraction of the attempted steps that was rejected.
+	double rejection_rate() const
+	{
+		return attempts > 0 ? static_cast<double>(rejections) / attempts
+		                    : 0.0;
+	}
+};
+
+
+/**
+   \brief Single-writer, multi-reader handle for progress snapshots.
+
+   Set a pointer to it in the solver options (progress), start the solve
+   and call read() from any thread. A handle should only be used by one
+   solve at a time.
+*/
+class progress_handle
+{
+public:
+	progress_handle() : seq(0), t0(0.0), t1(0.0), t(0.0), dt(0.0),
+	                    steps(0), attempts(0), rejections(0),
+	                    fun_evals(0), done(false) {}
+
+	/// Publishes a new snapshot. Only the integrator should call this.
+	void publish(const progress_snapshot &s)
+	{
+		unsigned s0 = seq.load(std::memory_order_relaxed);
+		seq.store(s0 + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		t0.store(s.t0, std::memory_order_relaxed);
+		t1.store(s.t1, std::memory_order_relaxed);
+		t.store(s.t, std::memory_order_relaxed);
+		dt.store(s.dt, std::memory_order_relaxed);
+		steps.store(s.steps, std::memory_order_relaxed);
+		attempts.store(s.attempts, std::memory_order_relaxed);
+		rejections.store(s.rejections, std::memory_order_relaxed);
+		fun_evals.store(s.fun_evals, std::memory_order_relaxed);
+		done.store(s.done, std::memory_order_relaxed);
+
+		seq.store(s0 + 2, std::memory_order_release);
+	}
+
+	/// Marks the last published snapshot as final.
+	void mark_done()
+	{
+		progress_snapshot s = read();
+		s.done = true;
+		publish(s);
+	}
+
+	/// Returns a consistent snapshot. Safe to call from any thread.
+	progress_snapshot read() const
+	{
+		progress_snapshot s;
+		unsigned s0, s1;
+		do {
+			s0 = seq.load(std::memory_order_acquire);
+			s.t0 = t0.load(std::memory_order_relaxed);
+			s.t1 = t1.load(std::memory_order_relaxed);
+			s.t = t.load(std::memory_order_relaxed);
+			s.dt = dt.load(std::memory_order_relaxed);
+			s.steps = steps.load(std::memory_order_relaxed);
+			s.attempts = attempts.load(std::memory_order_relaxed);
+			s.rejections = rejections.load(std::memory_order_relaxed);
+			s.fun_evals = fun_evals.load(std::memory_order_relaxed);
+			s.done = done.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			s1 = seq.load(std::memory_order_relaxed);
+		} while ((s0 & 1u) || s0 != s1);
+		return s;
+	}
+
+private:
+	std::atomic<unsigned> seq;
+
+	std::atomic<double> t0, t1, t, dt;
+	std::atomic<long long int> steps, attempts, rejections, fun_evals;
+	std::atomic<bool> done;
+};
+
+
+/**
+   \brief Publishes a snapshot if a handle is set, otherwise does nothing.
+*/
+inline void publish_progress(progress_handle *progress, double t0, double t1,
+                             double t, double dt, long long int steps,
+                             long long int attempts, long long int rejections,
+                             long long int fun_evals, bool done = false)
+{
+	if (!progress) return;
+	progress_snapshot s;
+	s.t0 = t0;
+	s.t1 = t1;
+	s.t = t;
+	s.dt = dt;
+	s.steps = steps;
+	s.attempts = attempts;
+	s.rejections = rejections;
+	s.fun_evals = fun_evals;
+	s.done = done;
+	progress->publish(s);
+}
+
+
+#endif // PROGRESS_HPP
@@ -0,0 +1,402 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file reaction_network.hpp
+
+   \brief Builds ODE functors for mass-action reaction networks.
+
+   A reaction sum_j m_j S_j -> sum_i n_i S_i with rate constant k
+   proceeds at the rate
+   \f[ w = k \prod_j y_j^{m_j}, \f]
+   and changes species i by (n_i - m_i) w. The builder collects species
+   and reactions, and mass_action_functor evaluates the right-hand side
+   and the exact Jacobi matrix from flat arrays:
+
+   - the reactants and their orders per reaction,
+   - the net stoichiometry per reaction,
+   - the sparsity pattern of the Jacobi matrix in compressed column
+     form, with for each (reaction, reactant) pair the positions in it
+     that its derivative contributes to.
+
+   Evaluations are plain loops over these arrays, without any lookups.
+   The functor has a dense jac_type, so it works with all implicit
+   solvers. jac_sparse() gives the same matrix as an arma::sp_mat.
+*/
+
+#ifndef REACTION_NETWORK_HPP
+#define REACTION_NETWORK_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arma_include.hpp"
+
+
+/**
+   \brief The ODE functor of a mass-action network. Made by
+   reaction_network::build().
+*/
+class mass_action_functor
+{
+public:
+	typedef arma::mat jac_type;
+
+	/// Number of species (equations).
+	std::size_t n_species() const { return n_species_; }
+
+	/// Number of reactions.
+	std::size_t n_reactions() const { return k_.size(); }
+
+	/// Number of structural non-zeros of the Jacobi matrix.
+	std::size_t n_nonzero() const { return jac_rows_.size(); }
+
+	/// Rate constant of reaction r.
+	double rate_constant( std::size_t r ) const { return k_[r]; }
+
+	/// Changes the rate constant of reaction r.
+	void set_rate_constant( std::size_t r, double k ) { k_[r] = k; }
+
+	/// Computes the rates of all reactions into w.
+	void reaction_rates( const arma::vec &y, arma::vec &w ) const
+	{
+		w.set_size(k_.size());
+		for (std::size_t r = 0; r < k_.size(); ++r) {
+			double wr = k_[r];
+			for (std::size_t p = reac_start_[r]; p < reac_start_[r+1]; ++p) {
+				wr *= ipow(y[reac_species_[p]], reac_order_[p]);
+			}
+			w[r] = wr;
+		}
+	}
+
+	arma::vec fun( double t, const arma::vec &y )
+	{
+		reaction_rates(y, w_);
+		arma::vec f = arma::zeros(n_species_);
+		for (std::size_t r = 0; r < k_.size(); ++r) {
+			double wr = w_[r];
+			for (std::size_t q = net_start_[r]; q < net_start_[r+1]; ++q) {
+				f[net_species_[q]] += net_coeff_[q] * wr;
+			}
+		}
+		return f;
+	}
+
+	/// The non-zero values of the Jacobi matrix, in compressed column order.
+	void jac_values( const arma::vec &y, std::vector<double> &vals ) const
+	{
+		vals.assign(jac_rows_.size(), 0.0);
+		for (std::size_t r = 0; r < k_.size(); ++r) {
+			std::size_t p0 = reac_start_[r], p1 = reac_start_[r+1];
+			for (std::size_t p = p0; p < p1; ++p) {
+				// d w_r / d y_j, with j the p-th reactant:
+				int m = reac_order_[p];
+				double dw = k_[r] * m * ipow(y[reac_species_[p]], m - 1);
+				for (std::size_t pp = p0; pp < p1; ++pp) {
+					if (pp == p) continue;
+					dw *= ipow(y[reac_species_[pp]], reac_order_[pp]);
+				}
+				for (std::size_t c = contrib_start_[p];
+				     c < contrib_start_[p+1]; ++c) {
+					vals[contrib_pos_[c]] += contrib_coeff_[c] * dw;
+				}
+			}
+		}
+	}
+
+	jac_type jac( double t, const arma::vec &y )
+	{
+		jac_values(y, vals_);
+		jac_type J = arma::zeros(n_species_, n_species_);
+		for (std::size_t j = 0; j < n_species_; ++j) {
+			for (std::size_t c = jac_colptr_[j]; c < jac_colptr_[j+1]; ++c) {
+				J(jac_rows_[c], j) = vals_[c];
+			}
+		}
+		return J;
+	}
+
+	/// The Jacobi matrix as a sparse matrix with the precomputed pattern.
+	arma::sp_mat jac_sparse( double t, const arma::vec &y )
+	{
+		jac_values(y, vals_);
+		arma::uvec rows(jac_rows_.size()), cols(jac_colptr_.size());
+		arma::vec vals(vals_.size());
+		for (std::size_t c = 0; c < jac_rows_.size(); ++c) {
+			rows[c] = jac_rows_[c];
+			vals[c] = vals_[c];
+		}
+		for (std::size_t j = 0; j < jac_colptr_.size(); ++j) {
+			cols[j] = jac_colptr_[j];
+		}
+		return arma::sp_mat(rows, cols, vals, n_species_, n_species_);
+	}
+
+private:
+	friend class reaction_network;
+
+	mass_action_functor() : n_species_(0) {}
+
+	static double ipow( double x, int m )
+	{
+		double p = 1.0;
+		for (int i = 0; i < m; ++i) p *= x;
+		return p;
+	}
+
+	std::size_t n_species_;
+	std::vector<double> k_;
+
+	// Reactants (species, order) of reaction r at
+	// reac_start_[r] ... reac_start_[r+1]-1:
+	std::vector<std::size_t> reac_start_, reac_species_;
+	std::vector<int> reac_order_;
+
+	// Net stoichiometry of reaction r, same layout:
+	std::vector<std::size_t> net_start_, net_species_;
+	std::vector<double> net_coeff_;
+
+	// Jacobi matrix pattern in compressed column form:
+	std::vector<std::size_t> jac_colptr_, jac_rows_;
+
+	// For reactant entry p, the derivative of its reaction rate adds
+	// contrib_coeff_[c] times itself to the non-zero contrib_pos_[c]:
+	std::vector<std::size_t> contrib_start_, contrib_pos_;
+	std::vector<double> contrib_coeff_;
+
+	// Work space:
+	arma::vec w_;
+	std::vector<double> vals_;
+};
+
+
+/**
+   \brief Collects species and mass-action reactions and builds the
+   functor for them.
+
+   \code{
+     reaction_network net;
+     net.add_reaction("A -> B", 0.04);
+     net.add_reaction("B + C -> A + C", 1e4);
+     net.add_reaction("2 B -> B + C", 3e7);
+     mass_action_functor func = net.build();
+   \code}
+*/
+class reaction_network
+{
+public:
+	/// A species with its stoichiometric coefficient.
+	typedef std::pair<std::size_t, int> term;
+
+	/// Returned by add_reaction for malformed equations.
+	static constexpr const std::size_t invalid = static_cast<std::size_t>(-1);
+
+	/// Adds a species, or returns the index if it already exists.
+	std::size_t add_species( const std::string &name )
+	{
+		auto it = index_.find(name);
+		if (it != index_.end()) return it->second;
+		std::size_t i = names_.size();
+		names_.push_back(name);
+		index_[name] = i;
+		return i;
+	}
+
+	/// Index of a species, or invalid if there is none by that name.
+	std::size_t species_index( const std::string &name ) const
+	{
+		auto it = index_.find(name);
+		if (it == index_.end()) return invalid;
+		return it->second;
+	}
+
+	const std::vector<std::string> &species() const { return names_; }
+
+	std::size_t n_species() const { return names_.size(); }
+	std::size_t n_reactions() const { return k_.size(); }
+
+	/// Adds a reaction from lists of (species index, coefficient).
+	std::size_t add_reaction( const std::vector<term> &reactants,
+	                          const std::vector<term> &products, double k )
+	{
+		reactants_.push_back(merge_terms(reactants));
+		products_.push_back(merge_terms(products));
+		k_.push_back(k);
+		return k_.size() - 1;
+	}
+
+	/**
+	   \brief Adds a reaction written as e.g. "2 A + B -> C".
+
+	   Unknown species are added in order of appearance. Use "0" or
+	   nothing for an empty side.
+
+	   \returns the index of the reaction, or invalid if the equation
+	            could not be parsed (nothing is added then).
+	*/
+	std::size_t add_reaction( const std::string &equation, double k )
+	{
+		std::size_t arrow = equation.find("->");
+		if (arrow == std::string::npos) return invalid;
+
+		std::vector<std::pair<std::string, int> > lhs, rhs;
+		if (!parse_side(equation.substr(0, arrow), lhs) ||
+		    !parse_side(equation.substr(arrow + 2), rhs)) {
+			return invalid;
+		}
+		std::vector<term> reactants, products;
+		for (const auto &t : lhs) {
+			reactants.push_back(term(add_species(t.first), t.second));
+		}
+		for (const auto &t : rhs) {
+			products.push_back(term(add_species(t.first), t.second));
+		}
+		return add_reaction(reactants, products, k);
+	}
+
+	/// Builds the functor with the flat arrays and the Jacobi pattern.
+	mass_action_functor build() const
+	{
+		mass_action_functor f;
+		std::size_t N = names_.size();
+		std::size_t R = k_.size();
+		f.n_species_ = N;
+		f.k_ = k_;
+
+		f.reac_start_.push_back(0);
+		f.net_start_.push_back(0);
+		for (std::size_t r = 0; r < R; ++r) {
+			for (const term &t : reactants_[r]) {
+				f.reac_species_.push_back(t.first);
+				f.reac_order_.push_back(t.second);
+			}
+			f.reac_start_.push_back(f.reac_species_.size());
+
+			std::map<std::size_t, int> net;
+			for (const term &t : products_[r])  net[t.first] += t.second;
+			for (const term &t : reactants_[r]) net[t.first] -= t.second;
+			for (const auto &n : net) {
+				if (n.second == 0) continue;
+				f.net_species_.push_back(n.first);
+				f.net_coeff_.push_back(n.second);
+			}
+			f.net_start_.push_back(f.net_species_.size());
+		}
+
+		// Pattern: species i depends on species j if j is a reactant
+		// of a reaction that changes i.
+		std::vector<std::vector<std::size_t> > col_rows(N);
+		for (std::size_t r = 0; r < R; ++r) {
+			for (std::size_t p = f.reac_start_[r]; p < f.reac_start_[r+1]; ++p) {
+				std::size_t j = f.reac_species_[p];
+				for (std::size_t q = f.net_start_[r]; q < f.net_start_[r+1]; ++q) {
+					col_rows[j].push_back(f.net_species_[q]);
+				}
+			}
+		}
+		f.jac_colptr_.push_back(0);
+		for (std::size_t j = 0; j < N; ++j) {
+			std::vector<std::size_t> &rows = col_rows[j];
+			std::sort(rows.begin(), rows.end());
+			rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+			f.jac_rows_.insert(f.jac_rows_.end(), rows.begin(), rows.end());
+			f.jac_colptr_.push_back(f.jac_rows_.size());
+		}
+
+		// Where each (reaction, reactant) derivative goes:
+		f.contrib_start_.push_back(0);
+		for (std::size_t r = 0; r < R; ++r) {
+			for (std::size_t p = f.reac_start_[r]; p < f.reac_start_[r+1]; ++p) {
+				std::size_t j = f.reac_species_[p];
+				auto first = f.jac_rows_.begin() + f.jac_colptr_[j];
+				auto last  = f.jac_rows_.begin() + f.jac_colptr_[j+1];
+				for (std::size_t q = f.net_start_[r]; q < f.net_start_[r+1]; ++q) {
+					auto it = std::lower_bound(first, last, f.net_species_[q]);
+					f.contrib_pos_.push_back(it - f.jac_rows_.begin());
+					f.contrib_coeff_.push_back(f.net_coeff_[q]);
+				}
+				f.contrib_start_.push_back(f.contrib_pos_.size());
+			}
+		}
+
+		f.w_.set_size(R);
+		return f;
+	}
+
+private:
+	/// Sums the coefficients of repeated species.
+	static std::vector<term> merge_terms( const std::vector<term> &terms )
+	{
+		std::map<std::size_t, int> m;
+		for (const term &t : terms) m[t.first] += t.second;
+		std::vector<term> merged;
+		for (const auto &t : m) {
+			if (t.second > 0) merged.push_back(t);
+		}
+		return merged;
+	}
+
+	static std::string trim( const std::string &s )
+	{
+		std::size_t b = 0, e = s.size();
+		while (b < e && std::isspace(static_cast<unsigned char>(s[b]))) ++b;
+		while (e > b && std::isspace(static_cast<unsigned char>(s[e-1]))) --e;
+		return s.substr(b, e - b);
+	}
+
+	static bool parse_side( const std::string &side,
+	                        std::vector<std::pair<std::string, int> > &terms )
+	{
+		std::string s = trim(side);
+		if (s.empty() || s == "0") return true;
+
+		std::size_t start = 0;
+		while (start <= s.size()) {
+			std::size_t plus = s.find('+', start);
+			if (plus == std::string::npos) plus = s.size();
+			std::string tok = trim(s.substr(start, plus - start));
+			if (tok.empty()) return false;
+
+			std::size_t d = 0;
+			while (d < tok.size() && std::isdigit(static_cast<unsigned char>(tok[d]))) ++d;
+			int coeff = d > 0 ? std::atoi(tok.substr(0, d).c_str()) : 1;
+			std::string name = trim(tok.substr(d));
+			if (name.empty() || coeff <= 0) return false;
+			terms.push_back(std::make_pair(name, coeff));
+			start = plus + 1;
+		}
+		return true;
+	}
+
+	std::vector<std::string> names_;
+	std::map<std::string, std::size_t> index_;
+	std::vector<std::vector<term> > reactants_, products_;
+	std::vector<double> k_;
+};
+
+
+#endif // REACTION_NETWORK_HPP
@@ -0,0 +1,394 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file realtime.hpp
+
+   \brief A fixed-step IRK stepper with bounded work per step.
+
+   irk::odeint is built for throughput: the Newton iteration limit relaxes
+   when it struggles, rejected steps cascade and armadillo temporaries are
+   allocated all over. None of that is acceptable inside a control loop
+   that has to finish each step in a bounded time. The realtime_stepper
+   instead allocates all its work space on construction and then caps the
+   work per step:
+   - At most max_newton_iters simplified Newton iterations per attempt.
+   - At most max_rejections retries, each with a fresh factorization.
+   - After that, one attempt with implicit Euler, which needs a much
+     smaller linear solve. If that fails too, the step reports failure
+     and leaves y untouched.
+
+   The factorizations are done in place on the pre-allocated matrices.
+   The stepper itself does not allocate after construction. The functor
+   is called as usual, so to be allocation-free as a whole, its fun and
+   jac should not allocate either. With armadillo this holds for vectors
+   of at most 16 elements and matrices of at most 16 elements.
+*/
+
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+
+#include <cmath>
+#include <vector>
+
+#include "irk.hpp"
+
+
+namespace irk {
+
+
+/**
+   \brief Options for the real-time stepper.
+*/
+struct realtime_options
+{
+	realtime_options() : max_newton_iters(4), max_rejections(1),
+	                     reuse_factorization(false),
+	                     fallback_implicit_euler(true),
+	                     newton_tol(1e-2), abs_tol(1e-6), rel_tol(1e-6)
+	{ }
+
+	/// Hard cap on simplified Newton iterations per attempt.
+	int max_newton_iters;
+
+	/// Number of retries, each with a Jacobi matrix evaluated at the last
+	/// iterate, before falling back to implicit Euler.
+	int max_rejections;
+
+	/// If true, keep the factorization of the stage matrix across steps
+	/// and only refresh it when Newton fails. This makes the typical step
+	/// much cheaper at the cost of a larger worst case.
+	bool reuse_factorization;
+
+	/// If true, fall back to implicit Euler when the budget runs out.
+	bool fallback_implicit_euler;
+
+	/// Newton converges if the weighted RMS norm of the increment is
+	/// below this value.
+	double newton_tol;
+
+	double abs_tol;  ///< Absolute tolerance for the weights.
+	double rel_tol;  ///< Relative tolerance for the weights.
+
+	/// Number of attempts a step may take, including the fallback.
+	int max_attempts() const
+	{
+		return max_rejections + 1 + (fallback_implicit_euler ? 1 : 0);
+	}
+
+	/// Upper bound on the Newton iterations of a single step.
+	int max_step_newton_iters() const
+	{
+		return max_attempts()*max_newton_iters;
+	}
+
+	/// Upper bound on the LU factorizations of a single step.
+	int max_step_factorizations() const
+	{
+		return max_attempts();
+	}
+};
+
+
+/**
+   \brief Statistics of the last step of a realtime_stepper.
+*/
+struct realtime_step_stats
+{
+	realtime_step_stats() : status(SUCCESS), newton_iters(0),
+	                        rejections(0), factorizations(0),
+	                        used_fallback(false) {}
+
+	int status;          ///< SUCCESS or INTERNAL_SOLVE_FAILURE
+	int newton_iters;    ///< Total Newton iterations in this step
+	int rejections;      ///< Failed attempts in this step
+	int factorizations;  ///< LU factorizations in this step
+	bool used_fallback;  ///< True if implicit Euler was used
+};
+
+
+/**
+   \brief Fixed-step implicit RK stepper with bounded latency.
+*/
+template <typename functor_type>
+class realtime_stepper
+{
+public:
+	/**
+	   \param func     Functor of the ODE.
+	   \param Neq      Number of equations.
+	   \param method   The IRK method to use.
+	   \param rt_opts  Options (see \ref realtime_options).
+	*/
+	realtime_stepper(functor_type &func, std::size_t Neq,
+	                 int method = RADAU_IIA_53,
+	                 const realtime_options &rt_opts = realtime_options())
+		: func(func), opts(rt_opts), sc(get_coefficients(method)),
+		  Neq(Neq), Ns(sc.b.size()), NN(Ns*Neq),
+		  LU(NN, NN), piv(NN), Y(NN), R(NN), F(NN), d(Ns),
+		  LU_e(Neq, Neq), piv_e(Neq), z(Neq), r_e(Neq),
+		  J(Neq, Neq), y_tmp(Neq), y_old(Neq),
+		  have_factorization(false), factored_dt(0.0)
+	{
+		mat_type Ai = arma::inv(sc.A);
+		d = Ai.t()*sc.b;
+	}
+
+	/**
+	   \brief Advances y from t to t + dt in place.
+
+	   \returns SUCCESS, or INTERNAL_SOLVE_FAILURE if all attempts failed,
+	            in which case t and y are unchanged.
+	*/
+	int step(double &t, vec_type &y, double dt)
+	{
+		stats = realtime_step_stats();
+		for (std::size_t i = 0; i < Neq; ++i) y_old(i) = y(i);
+
+		if (!opts.reuse_factorization || !have_factorization ||
+		    factored_dt != dt) {
+			factorize_stages(t, y, dt);
+		}
+
+		for (int attempt = 0; attempt <= opts.max_rejections; ++attempt) {
+			if (attempt > 0) {
+				// Retry with the Jacobi matrix at the end point of
+				// the last iterate, which is closer to the solution.
+				++stats.rejections;
+				for (std::size_t k = 0; k < Neq; ++k) {
+					y_tmp(k) = y(k) + Y((Ns-1)*Neq + k);
+				}
+				factorize_stages(t + dt, y_tmp, dt);
+			}
+			if (solve_stages(t, y, dt)) {
+				for (std::size_t i = 0; i < Ns; ++i) {
+					for (std::size_t k = 0; k < Neq; ++k) {
+						y(k) += d(i)*Y(i*Neq + k);
+					}
+				}
+				t += dt;
+				return stats.status;
+			}
+		}
+
+		if (opts.fallback_implicit_euler) {
+			stats.used_fallback = true;
+			if (implicit_euler(t, y, dt)) {
+				t += dt;
+				return stats.status;
+			}
+			++stats.rejections;
+		}
+
+		for (std::size_t i = 0; i < Neq; ++i) y(i) = y_old(i);
+		stats.status = INTERNAL_SOLVE_FAILURE;
+		return stats.status;
+	}
+
+	/// Statistics of the last call to step.
+	const realtime_step_stats &last_stats() const
+	{
+		return stats;
+	}
+
+private:
+	/// Weighted RMS norm of an increment in the stage vector v.
+	double weighted_norm(const vec_type &v, const vec_type &y,
+	                     std::size_t Nblocks) const
+	{
+		double sum = 0.0;
+		for (std::size_t i = 0; i < Nblocks; ++i) {
+			for (std::size_t k = 0; k < Neq; ++k) {
+				double sk = opts.abs_tol + opts.rel_tol*std::fabs(y(k));
+				double vk = v(i*Neq + k) / sk;
+				sum += vk*vk;
+			}
+		}
+		return std::sqrt(sum / (Nblocks*Neq));
+	}
+
+	/// Builds I - dt*kron(A, J(t,y)) in place and factorizes it.
+	void factorize_stages(double t, const vec_type &y, double dt)
+	{
+		J = func.jac(t, y);
+		for (std::size_t i = 0; i < Ns; ++i) {
+			for (std::size_t j = 0; j < Ns; ++j) {
+				double a = dt*sc.A(i,j);
+				for (std::size_t k = 0; k < Neq; ++k) {
+					for (std::size_t l = 0; l < Neq; ++l) {
+						double delta = (i == j && k == l) ? 1.0 : 0.0;
+						LU(i*Neq + k, j*Neq + l) = delta - a*J(k,l);
+					}
+				}
+			}
+		}
+		lu_in_place(LU, piv, NN);
+		have_factorization = true;
+		factored_dt = dt;
+		++stats.factorizations;
+	}
+
+	/// Simplified Newton iteration on the stages. Y is overwritten.
+	bool solve_stages(double t, const vec_type &y, double dt)
+	{
+		for (std::size_t i = 0; i < NN; ++i) Y(i) = 0.0;
+
+		for (int it = 0; it < opts.max_newton_iters; ++it) {
+			++stats.newton_iters;
+			for (std::size_t j = 0; j < Ns; ++j) {
+				for (std::size_t k = 0; k < Neq; ++k) {
+					y_tmp(k) = y(k) + Y(j*Neq + k);
+				}
+				const vec_type &fj = func.fun(t + sc.c(j)*dt, y_tmp);
+				for (std::size_t k = 0; k < Neq; ++k) {
+					F(j*Neq + k) = fj(k);
+				}
+			}
+			for (std::size_t i = 0; i < Ns; ++i) {
+				for (std::size_t k = 0; k < Neq; ++k) {
+					double sum = 0.0;
+					for (std::size_t j = 0; j < Ns; ++j) {
+						sum += sc.A(i,j)*F(j*Neq + k);
+					}
+					R(i*Neq + k) = dt*sum - Y(i*Neq + k);
+				}
+			}
+			lu_solve_in_place(LU, piv, NN, R);
+			for (std::size_t i = 0; i < NN; ++i) Y(i) += R(i);
+
+			double incr = weighted_norm(R, y, Ns);
+			if (!std::isfinite(incr)) return false;
+			if (incr < opts.newton_tol) return true;
+		}
+		return false;
+	}
+
+	/// One implicit Euler step with a freshly factored I - dt*J.
+	bool implicit_euler(double t, vec_type &y, double dt)
+	{
+		J = func.jac(t + dt, y);
+		for (std::size_t k = 0; k < Neq; ++k) {
+			for (std::size_t l = 0; l < Neq; ++l) {
+				LU_e(k,l) = (k == l ? 1.0 : 0.0) - dt*J(k,l);
+			}
+		}
+		lu_in_place(LU_e, piv_e, Neq);
+		++stats.factorizations;
+
+		for (std::size_t k = 0; k < Neq; ++k) z(k) = 0.0;
+		for (int it = 0; it < opts.max_newton_iters; ++it) {
+			++stats.newton_iters;
+			for (std::size_t k = 0; k < Neq; ++k) y_tmp(k) = y(k) + z(k);
+			const vec_type &f = func.fun(t + dt, y_tmp);
+			for (std::size_t k = 0; k < Neq; ++k) {
+				r_e(k) = dt*f(k) - z(k);
+			}
+			lu_solve_in_place(LU_e, piv_e, Neq, r_e);
+			for (std::size_t k = 0; k < Neq; ++k) z(k) += r_e(k);
+
+			double incr = weighted_norm(r_e, y, 1);
+			if (!std::isfinite(incr)) return false;
+			if (incr < opts.newton_tol) {
+				for (std::size_t k = 0; k < Neq; ++k) y(k) += z(k);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// LU decomposition with partial pivoting, overwriting M.
+	static void lu_in_place(mat_type &M, std::vector<std::size_t> &p,
+	                        std::size_t N)
+	{
+		for (std::size_t i = 0; i < N; ++i) p[i] = i;
+		for (std::size_t k = 0; k < N; ++k) {
+			std::size_t imax = k;
+			double vmax = std::fabs(M(k,k));
+			for (std::size_t i = k+1; i < N; ++i) {
+				if (std::fabs(M(i,k)) > vmax) {
+					vmax = std::fabs(M(i,k));
+					imax = i;
+				}
+			}
+			if (imax != k) {
+				std::swap(p[k], p[imax]);
+				for (std::size_t j = 0; j < N; ++j) {
+					std::swap(M(k,j), M(imax,j));
+				}
+			}
+			double pivot = M(k,k);
+			if (pivot == 0.0) continue;
+			for (std::size_t i = k+1; i < N; ++i) {
+				double l = M(i,k) / pivot;
+				M(i,k) = l;
+				for (std::size_t j = k+1; j < N; ++j) {
+					M(i,j) -= l*M(k,j);
+				}
+			}
+		}
+	}
+
+	/// Solves M x = b with the factors from lu_in_place, overwriting b.
+	/// F (or y_tmp for the Euler system) is free at this point and is
+	/// used as scratch space.
+	void lu_solve_in_place(const mat_type &M,
+	                       const std::vector<std::size_t> &p,
+	                       std::size_t N, vec_type &b)
+	{
+		vec_type &x = (N == NN) ? F : y_tmp;
+		for (std::size_t i = 0; i < N; ++i) x(i) = b(p[i]);
+		for (std::size_t i = 0; i < N; ++i) {
+			double sum = x(i);
+			for (std::size_t j = 0; j < i; ++j) sum -= M(i,j)*x(j);
+			x(i) = sum;
+		}
+		for (std::size_t ii = N; ii-- > 0; ) {
+			double sum = x(ii);
+			for (std::size_t j = ii+1; j < N; ++j) sum -= M(ii,j)*x(j);
+			x(ii) = sum / M(ii,ii);
+		}
+		for (std::size_t i = 0; i < N; ++i) b(i) = x(i);
+	}
+
+	functor_type &func;
+	realtime_options opts;
+	solver_coeffs sc;
+	std::size_t Neq, Ns, NN;
+
+	// Work space, allocated once:
+	mat_type LU;
+	std::vector<std::size_t> piv;
+	vec_type Y, R, F, d;
+	mat_type LU_e;
+	std::vector<std::size_t> piv_e;
+	vec_type z, r_e;
+	mat_type J;
+	vec_type y_tmp, y_old;
+
+	bool have_factorization;
+	double factored_dt;
+	realtime_step_stats stats;
+};
+
+
+} // namespace irk
+
+
+#endif // REALTIME_HPP
@@ -31,6 +31,11 @@
 #include "irk.hpp"
 #include "erk.hpp"
 #include "multistep.hpp"
+#include "ensemble.hpp"
+#include "autotune.hpp"
+#include "adjoint.hpp"
+#include "bvp.hpp"
+#include "reaction_network.hpp"
 
 
 #endif // REHUEL_HPP
@@ -0,0 +1,169 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file sensitivity.hpp
+
+   \brief Options and helpers for forward sensitivity analysis.
+
+   The forward sensitivities S = dy/dp satisfy
+   \f[ S' = J(t,y) S + \partial f / \partial p, \f]
+   with J the Jacobi matrix of the ODE. The integrators solve this
+   alongside the ODE itself, re-using the iteration matrix of the
+   non-linear solve.
+*/
+
+#ifndef SENSITIVITY_HPP
+#define SENSITIVITY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+#include "arma_include.hpp"
+
+
+/**
+   \brief Options for forward sensitivity analysis.
+
+   The columns of S0 are the initial values of the sensitivities. If the
+   functor has a member
+   \code{
+     arma::mat dfdp(double t, const arma::vec &y);
+   \code}
+   its columns are added as forcing terms to the columns of S starting at
+   param_col. This allows to mix sensitivities to initial values and
+   parameters, e.g. with S0 = [ I, 0 ] and param_col = Neq.
+*/
+struct sensitivity_options
+{
+	sensitivity_options() : param_col(0), error_control(false),
+	                        stage_jacobians(false), maxit(10), tol(1e-10) {}
+
+	/// Initial values of the sensitivities (Neq x P).
+	arma::mat S0;
+
+	/// First column of S that dfdp is added to. If this is equal to
+	/// the number of columns of S0, dfdp is never evaluated.
+	std::size_t param_col;
+
+	/// If true, include the sensitivities in the error estimate.
+	bool error_control;
+
+	/// If true, evaluate the Jacobian at every stage instead of re-using
+	/// the one of the Newton solve. This costs Ns Jacobian evaluations
+	/// per step but makes the sensitivities exact for the discrete scheme.
+	bool stage_jacobians;
+
+	/// Maximum number of staggered corrector iterations per step.
+	int maxit;
+
+	/// Relative tolerance for the staggered corrector.
+	double tol;
+};
+
+
+/**
+   \brief Checks whether the functor provides dfdp(t, y).
+*/
+template <typename functor_type>
+struct has_dfdp
+{
+	template <typename T>
+	static auto test(int)
+		-> decltype(std::declval<T&>().dfdp(0.0,
+		                                    std::declval<const arma::vec&>()),
+		            std::true_type());
+
+	template <typename T>
+	static std::false_type test(...);
+
+	static constexpr bool value = decltype(test<functor_type>(0))::value;
+};
+
+
+namespace sensitivity_impl {
+
+template <typename functor_type> inline
+void add_dfdp(functor_type &func, double t, const arma::vec &y,
+              arma::mat &G, std::size_t param_col, std::true_type)
+{
+	if (param_col >= G.n_cols) return;
+	G.cols(param_col, G.n_cols - 1) += func.dfdp(t, y);
+}
+
+template <typename functor_type> inline
+void add_dfdp(functor_type &, double, const arma::vec &,
+              arma::mat &, std::size_t, std::false_type)
+{ }
+
+} // namespace sensitivity_impl
+
+
+/**
+   \brief Adds func.dfdp(t,y) to the columns of G starting at param_col,
+   if the functor provides dfdp. Otherwise does nothing.
+*/
+template <typename functor_type> inline
+void add_dfdp(functor_type &func, double t, const arma::vec &y,
+              arma::mat &G, std::size_t param_col)
+{
+	sensitivity_impl::add_dfdp(
+		func, t, y, G, param_col,
+		std::integral_constant<bool, has_dfdp<functor_type>::value>());
+}
+
+
+/**
+   \brief Approximates df/dp with central finite differences.
+
+   Useful for implementing dfdp in functors that have no analytic
+   derivative to their parameters.
+
+   \param func  The ODE functor.
+   \param t     Current time.
+   \param y     Current y-vector.
+   \param p     The parameter vector that func.fun reads from. It is
+                perturbed during the call and restored afterwards.
+   \param h     Relative finite difference step size.
+
+   \returns the Neq x P matrix df/dp.
+*/
+template <typename functor_type> inline
+arma::mat approx_dfdp(functor_type &func, double t, const arma::vec &y,
+                      arma::vec &p, double h = 1e-7)
+{
+	arma::mat dfdp(y.size(), p.size());
+	for (std::size_t j = 0; j < p.size(); ++j) {
+		double pj = p(j);
+		double hj = h*std::max(1.0, std::fabs(pj));
+		p(j) = pj + hj;
+		arma::vec fp = func.fun(t, y);
+		p(j) = pj - hj;
+		arma::vec fm = func.fun(t, y);
+		p(j) = pj;
+		dfdp.col(j) = (fp - fm) / (2.0*hj);
+	}
+	return dfdp;
+}
+
+
+#endif // SENSITIVITY_HPP
@@ -0,0 +1,110 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file stage_eval.hpp
+
+   \brief Evaluation of the right-hand side at several stages at once.
+
+   Functors may provide a member
+   \code{
+     void fun_stages(const arma::vec &ts, const arma::mat &Ys, arma::mat &Fs);
+   \code}
+   that sets column i of Fs to f(ts(i), Ys.col(i)). Ys and Fs are
+   Neq x Ns, and Fs is already of the right size, possibly a view into
+   solver memory, so it should be written to and not re-assigned. The
+   Runge-Kutta solvers use it for all stages that are independent of
+   each other, which lets the functor vectorize over stages and share
+   setup work between them. Functors without it are called once per
+   stage through fun.
+
+   Solvers running in single precision look for the same member with
+   arma::fmat in place of arma::mat; the times stay double.
+*/
+
+#ifndef STAGE_EVAL_HPP
+#define STAGE_EVAL_HPP
+
+#include <type_traits>
+#include <utility>
+
+#include "arma_include.hpp"
+
+
+/**
+   \brief Checks whether the functor provides fun_stages(ts, Ys, Fs) for
+   stages of scalar type eT.
+*/
+template <typename functor_type, typename eT = double>
+struct has_fun_stages
+{
+	template <typename T>
+	static auto test(int)
+		-> decltype(std::declval<T&>().fun_stages(
+			            std::declval<const arma::vec&>(),
+			            std::declval<const arma::Mat<eT>&>(),
+			            std::declval<arma::Mat<eT>&>()),
+		            std::true_type());
+
+	template <typename T>
+	static std::false_type test(...);
+
+	static constexpr bool value = decltype(test<functor_type>(0))::value;
+};
+
+
+namespace stage_eval_impl {
+
+template <typename functor_type, typename eT> inline
+void eval_stages(functor_type &func, const arma::vec &ts,
+                 const arma::Mat<eT> &Ys, arma::Mat<eT> &Fs, std::true_type)
+{
+	func.fun_stages(ts, Ys, Fs);
+}
+
+template <typename functor_type, typename eT> inline
+void eval_stages(functor_type &func, const arma::vec &ts,
+                 const arma::Mat<eT> &Ys, arma::Mat<eT> &Fs, std::false_type)
+{
+	for (std::size_t i = 0; i < Ys.n_cols; ++i) {
+		Fs.col(i) = func.fun(ts(i), Ys.col(i));
+	}
+}
+
+} // namespace stage_eval_impl
+
+
+/**
+   \brief Sets column i of Fs to f(ts(i), Ys.col(i)), with one call to
+   func.fun_stages if the functor has it, or one call to func.fun per
+   column otherwise.
+*/
+template <typename functor_type, typename eT> inline
+void eval_stages(functor_type &func, const arma::vec &ts,
+                 const arma::Mat<eT> &Ys, arma::Mat<eT> &Fs)
+{
+	stage_eval_impl::eval_stages(
+		func, ts, Ys, Fs,
+		std::integral_constant<bool,
+		                       has_fun_stages<functor_type, eT>::value>());
+}
+
+
+#endif // STAGE_EVAL_HPP
@@ -0,0 +1,99 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file steady_state.hpp
+
+   \brief Detection of a steady state during time integration.
+
+   A steady state is declared once the weighted RMS norm of f(t,y),
+   \f[ \sqrt{ \frac{1}{N} \sum_i \left( \frac{f_i}{a + r |y_i|} \right)^2 }, \f]
+   has stayed below common_solver_options::steady_state_tol for a number
+   of consecutive accepted steps, while the step size controller was no
+   longer limited by the error, i.e., dt sits at max_dt or keeps growing.
+*/
+
+#ifndef STEADY_STATE_HPP
+#define STEADY_STATE_HPP
+
+#include <cmath>
+
+#include "arma_include.hpp"
+#include "options.hpp"
+
+
+/**
+   \brief Keeps track of the steady state criterion over accepted steps.
+*/
+class steady_state_monitor
+{
+public:
+	explicit steady_state_monitor(const common_solver_options &opts)
+		: opts(opts), count(0) {}
+
+	/// Returns true if steady state detection was requested.
+	bool enabled() const
+	{
+		return opts.steady_state_tol > 0;
+	}
+
+	/**
+	   \brief Updates the monitor after an accepted step.
+
+	   \param f       f(t,y) at the new state.
+	   \param y       The new state.
+	   \param dt      The step size of the accepted step.
+	   \param new_dt  The step size the controller proposes next.
+
+	   \returns true if the criterion held for enough steps in a row.
+	*/
+	template <typename eT>
+	bool update(const arma::Col<eT> &f, const arma::Col<eT> &y,
+	            double dt, double new_dt)
+	{
+		double atol = opts.abs_tol, rtol = opts.rel_tol;
+		double sum = 0.0;
+		for (std::size_t i = 0; i < y.size(); ++i) {
+			double sci = atol + rtol * std::fabs(y(i));
+			double fi  = f(i) / sci;
+			sum += fi*fi;
+		}
+		double f_norm = std::sqrt(sum / y.size());
+
+		bool dt_free = (new_dt >= dt);
+		if (opts.max_dt > 0 && dt >= opts.max_dt) {
+			dt_free = true;
+		}
+
+		if (f_norm < opts.steady_state_tol && dt_free) {
+			++count;
+		} else {
+			count = 0;
+		}
+		return count >= opts.steady_state_steps;
+	}
+
+private:
+	const common_solver_options &opts;
+	int count;
+};
+
+
+#endif // STEADY_STATE_HPP
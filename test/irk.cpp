@@ -4,6 +4,7 @@
 
 #include <catch2/catch_all.hpp>
 #include "irk.hpp"
+#include "erk.hpp"
 #include "test_equations.hpp"
 
 
@@ -247,6 +248,74 @@ TEST_CASE( "Test if merging two solution objects works.", "[sol_merge]" )
 }
 
 
+TEST_CASE( "Merging by moving keeps storage and merges counters.", "[sol_merge]" )
+{
+	output_options output_opts;
+	auto so = irk::default_solver_options();
+	vec_type Y0 = { 1.0 };
+	test_equations::exponential func( -0.4 );
+
+	irk::rk_output sol1 = irk::odeint( func, 0.0, 2.0, Y0, so, output_opts );
+	vec_type Y1 = sol1.y_vals.back();
+	irk::rk_output sol2 = irk::odeint( func, 2.0, 4.0, Y1, so, output_opts );
+
+	std::size_t n1 = sol1.t_vals.size();
+	std::size_t n2 = sol2.t_vals.size();
+	std::size_t fevals = sol1.count.fun_evals + sol2.count.fun_evals;
+	std::size_t jevals = sol1.count.jac_evals + sol2.count.jac_evals;
+	irk::rk_output copied = irk::merge_rk_output( sol1, sol2 );
+
+	irk::rk_output merged = irk::merge_rk_output( std::move(sol1),
+	                                              std::move(sol2) );
+	REQUIRE( merged.t_vals.size() == n1 + n2 );
+	REQUIRE( merged.y_vals.size() == n1 + n2 );
+	REQUIRE( merged.stages.size() == n1 + n2 );
+	REQUIRE( merged.err_est.size() == n1 + n2 );
+	REQUIRE( merged.count.fun_evals == fevals );
+	REQUIRE( merged.count.jac_evals == jevals );
+	REQUIRE( copied.count.fun_evals == fevals );
+	REQUIRE( copied.count.jac_evals == jevals );
+	REQUIRE( sol2.y_vals.empty() );
+
+	for( std::size_t i = 0; i < n1 + n2; ++i ){
+		REQUIRE( merged.t_vals[i] == copied.t_vals[i] );
+		REQUIRE( merged.y_vals[i](0) == copied.y_vals[i](0) );
+	}
+}
+
+
+TEST_CASE( "Merging drops dense output of different methods.", "[sol_merge]" )
+{
+	output_options output_opts;
+	auto so = irk::default_solver_options();
+	newton::options opts;
+	opts.tol = 0.1*so.rel_tol;
+	so.newton_opts = &opts;
+	vec_type Y0 = { 1.0 };
+	test_equations::exponential func( -0.4 );
+
+	// Both methods have five stages, so only their coefficients differ:
+	irk::rk_output radau = irk::odeint( func, 0.0, 1.0, Y0, so, output_opts,
+	                                    irk::RADAU_IIA_95 );
+	vec_type Y1 = radau.y_vals.back();
+	irk::rk_output lobatto = irk::odeint( func, 1.0, 2.0, Y1, so,
+	                                      output_opts, irk::LOBATTO_IIIC_85 );
+	irk::rk_output radau2 = irk::odeint( func, 1.0, 2.0, Y1, so,
+	                                     output_opts, irk::RADAU_IIA_95 );
+	REQUIRE( radau.b_interp.n_rows == 5 );
+	REQUIRE( lobatto.b_interp.n_rows == 5 );
+
+	irk::rk_output mixed = irk::merge_rk_output( radau, lobatto );
+	REQUIRE( mixed.b_interp.n_elem == 0 );
+	irk::rk_output same = irk::merge_rk_output( radau, radau2 );
+	REQUIRE( same.b_interp.n_elem == radau.b_interp.n_elem );
+
+	irk::rk_output moved = irk::merge_rk_output( std::move(radau),
+	                                             std::move(lobatto) );
+	REQUIRE( moved.b_interp.n_elem == 0 );
+}
+
+
 TEST_CASE("Calculate stages for the robertson problem.", "[irk_calc_stages]")
 {
 	test_equations::rober r;
@@ -294,3 +363,98 @@ TEST_CASE("Calculate stages for the robertson problem.", "[irk_calc_stages]")
 
 
 }
+
+
+// Index-1 DAE y1' = -y1, 0 = y1^2 - y2, so y1 = exp(-t), y2 = y1^2.
+struct simple_dae
+{
+	typedef arma::mat jac_type;
+
+	arma::vec fun(double t, const arma::vec &y)
+	{
+		return { -y(0), y(0)*y(0) - y(1) };
+	}
+
+	jac_type jac(double t, const arma::vec &y)
+	{
+		return { { -1.0,     0.0 },
+		         { 2.0*y(0), -1.0 } };
+	}
+};
+
+
+TEST_CASE("Solve an index-1 DAE with a singular mass matrix.", "[irk_dae]")
+{
+	using namespace irk;
+	output_options output_opts;
+	auto so = default_solver_options();
+	newton::options opts;
+	opts.tol = 0.1*so.rel_tol;
+	so.newton_opts = &opts;
+
+	arma::mat M = { { 1.0, 0.0 },
+	                { 0.0, 0.0 } };
+	so.mass_matrix = &M;
+	simple_dae func;
+	vec_type Y0 = { 1.0, 1.0 };
+
+	for (int method : { RADAU_IIA_53, LOBATTO_IIIC_43 }) {
+		rk_output sol = odeint(func, 0.0, 2.0, Y0, so, output_opts,
+		                       method, 1e-3);
+		REQUIRE(sol.status == SUCCESS);
+		std::size_t Nt = sol.t_vals.size();
+		for (std::size_t i = 0; i < Nt; ++i) {
+			double y1 = std::exp(-sol.t_vals[i]);
+			REQUIRE(sol.y_vals[i](0) == Catch::Approx(y1).epsilon(1e-3));
+			REQUIRE(sol.y_vals[i](1) == Catch::Approx(y1*y1).epsilon(1e-3));
+		}
+	}
+
+	SECTION("Methods that are not stiffly accurate are rejected."){
+		rk_output sol = odeint(func, 0.0, 2.0, Y0, so, output_opts,
+		                       GAUSS_LEGENDRE_63, 1e-3);
+		REQUIRE(sol.status == GENERAL_ERROR);
+	}
+}
+
+
+TEST_CASE("Fixed time steps skip the error estimate.", "[fixed_step]")
+{
+	test_equations::exponential func(-1.0);
+	vec_type Y0 = { 1.0 };
+	output_options output_opts;
+
+	SECTION("IRK") {
+		irk::solver_options so = irk::default_solver_options();
+		newton::options opts;
+		opts.tol = 1e-10;
+		so.newton_opts = &opts;
+		so.adaptive_step_size = false;
+		irk::rk_output sol = irk::odeint(func, 0.0, 1.0, Y0, so, output_opts,
+		                                 irk::RADAU_IIA_53, 0.01);
+		REQUIRE(sol.status == SUCCESS);
+		REQUIRE(sol.t_vals.back() == 1.0);
+		REQUIRE(sol.count.reject_err == 0);
+		for (double e : sol.err) REQUIRE(e == 0.0);
+		REQUIRE(sol.y_vals.back()(0) ==
+		        Catch::Approx(std::exp(-1.0)).epsilon(1e-8));
+	}
+
+	SECTION("ERK") {
+		erk::solver_options so = erk::default_solver_options();
+		so.adaptive_step_size = false;
+		erk::rk_output sol = erk::odeint(func, 0.0, 1.0, Y0, so, output_opts,
+		                                 erk::DORMAND_PRINCE_54, 0.01);
+		REQUIRE(sol.status == SUCCESS);
+		REQUIRE(sol.t_vals.back() == 1.0);
+		// One evaluation per stage and step, the first stage is FSAL:
+		std::size_t steps = sol.t_vals.size() - 1;
+		REQUIRE(sol.count.fun_evals == 1 + 6*steps);
+
+		output_opts.disable_store_in_vectors();
+		sol = erk::odeint(func, 0.0, 1.0, Y0, so, output_opts,
+		                  erk::DORMAND_PRINCE_54, 0.01);
+		REQUIRE(sol.status == SUCCESS);
+		REQUIRE(sol.t_vals.size() == 1);
+	}
+}
@@ -0,0 +1,97 @@
+#include <catch2/catch_all.hpp>
+
+#include <cstring>
+#include <sstream>
+
+#include "../irk.hpp"
+#include "../erk.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Asynchronous writer keeps all records in order", "[async_writer]")
+{
+	async_writer_options opts;
+	opts.capacity = 8;
+	opts.block_bytes = 256;
+
+	SECTION("Text") {
+		std::ostringstream out, expect;
+		out.precision(12);
+		expect.precision(12);
+		{
+			async_writer writer(out, 2, opts);
+			for (int i = 0; i < 5000; ++i) {
+				double y[2] = { 0.5*i, -i / 3.0 };
+				REQUIRE(writer.push(1e-3*i, y));
+				expect << 1e-3*i << " " << y[0] << " " << y[1] << "\n";
+			}
+			writer.finish();
+			REQUIRE(writer.written() == 5000);
+			REQUIRE(writer.dropped() == 0);
+		}
+		REQUIRE(out.str() == expect.str());
+	}
+
+	SECTION("Binary") {
+		opts.format = async_writer_options::BINARY;
+		std::ostringstream out;
+		{
+			async_writer writer(out, 1, opts);
+			for (int i = 0; i < 1000; ++i) {
+				double y = 2.0*i;
+				writer.push(double(i), &y);
+			}
+		}
+		std::string s = out.str();
+		REQUIRE(s.size() == 1000*2*sizeof(double));
+		for (int i = 0; i < 1000; ++i) {
+			double rec[2];
+			std::memcpy(rec, s.data() + 2*i*sizeof(double), sizeof(rec));
+			REQUIRE(rec[0] == double(i));
+			REQUIRE(rec[1] == 2.0*i);
+		}
+	}
+
+	SECTION("Dropping") {
+		opts.backpressure = async_writer_options::DROP;
+		opts.capacity = 2;
+		std::ostringstream out;
+		async_writer writer(out, 1, opts);
+		for (int i = 0; i < 1000; ++i) {
+			double y = i;
+			writer.push(double(i), &y);
+		}
+		writer.finish();
+		REQUIRE(writer.pushed() == 1000);
+		REQUIRE(writer.written() + writer.dropped() == 1000);
+	}
+}
+
+
+TEST_CASE("Solvers write the same output asynchronously", "[async_writer]")
+{
+	test_equations::vdpol func(1.0);
+	vec_type y0 = { 2.0, 0.0 };
+	async_writer_options async_opts;
+
+	std::ostringstream sync_out, async_out;
+	output_options sync_opts, async_out_opts;
+	sync_opts.set_output_stream(sync_out);
+	async_out_opts.set_output_stream(async_out);
+	async_out_opts.async_write = &async_opts;
+
+	irk::solver_options so = irk::default_solver_options();
+	newton::options n_opts;
+	so.newton_opts = &n_opts;
+	irk::odeint(func, 0.0, 5.0, y0, so, sync_opts);
+	irk::odeint(func, 0.0, 5.0, y0, so, async_out_opts);
+	REQUIRE(!sync_out.str().empty());
+	REQUIRE(sync_out.str() == async_out.str());
+
+	sync_out.str("");
+	async_out.str("");
+	erk::solver_options eo = erk::default_solver_options();
+	erk::odeint(func, 0.0, 5.0, y0, eo, sync_opts);
+	erk::odeint(func, 0.0, 5.0, y0, eo, async_out_opts);
+	REQUIRE(sync_out.str() == async_out.str());
+}
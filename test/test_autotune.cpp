@@ -0,0 +1,74 @@
+#include <catch2/catch_all.hpp>
+
+#include <cstdio>
+#include <fstream>
+
+#include "../autotune.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Pilot runs pick a stiff solver for a stiff problem", "[autotune]")
+{
+	test_equations::vdpol func(1e-5);
+	vec_type y0 = { 2.0, 0.0 };
+	irk::solver_options so = irk::default_solver_options();
+	so.rel_tol = so.abs_tol = 1e-5;
+
+	std::vector<autotune::candidate> cands = {
+		autotune::candidate(autotune::candidate::IRK, irk::RADAU_IIA_53),
+		autotune::candidate(autotune::candidate::ERK, erk::DORMAND_PRINCE_54)
+	};
+	autotune::tuner_options opts;
+	opts.pilot_fraction = 0.1;
+	opts.pilot_wall_time = 0.5;
+
+	autotune::tuning_result res = autotune::tune(func, 0.0, 10.0, y0, so,
+	                                             cands, opts);
+	REQUIRE(res.status == SUCCESS);
+	REQUIRE(res.pilots.size() == 2);
+	REQUIRE(res.best.family == autotune::candidate::IRK);
+	REQUIRE(res.best.method == irk::RADAU_IIA_53);
+	REQUIRE(res.pilots[0].cost < res.pilots[1].cost);
+	REQUIRE(res.pilots[0].jac_evals > 0);
+}
+
+
+TEST_CASE("Tuning profiles are saved and loaded", "[autotune]")
+{
+	std::string file = "test_autotune.profiles";
+	std::remove(file.c_str());
+
+	autotune::candidate c, loaded;
+	REQUIRE(!autotune::load_profile(file, "vdpol", loaded));
+	REQUIRE(!autotune::save_profile(file, "with space", c));
+
+	c = autotune::candidate(autotune::candidate::IRK, irk::RADAU_IIA_95, 10, 5);
+	REQUIRE(autotune::save_profile(file, "vdpol", c));
+	REQUIRE(autotune::save_profile(file, "lorenz",
+	                               autotune::candidate(autotune::candidate::ERK,
+	                                                   erk::CASH_KARP_54)));
+
+	// Overwrites the earlier entry:
+	c.refresh_jac = 3;
+	REQUIRE(autotune::save_profile(file, "vdpol", c));
+
+	REQUIRE(autotune::load_profile(file, "vdpol", loaded));
+	REQUIRE(loaded.family == autotune::candidate::IRK);
+	REQUIRE(loaded.method == irk::RADAU_IIA_95);
+	REQUIRE(loaded.refresh_jac == 3);
+	REQUIRE(loaded.maxit == 5);
+
+	REQUIRE(autotune::load_profile(file, "lorenz", loaded));
+	REQUIRE(loaded.family == autotune::candidate::ERK);
+	REQUIRE(loaded.method == erk::CASH_KARP_54);
+
+	std::ifstream in(file);
+	std::string line;
+	int n_vdpol = 0;
+	while (std::getline(in, line)) {
+		if (line.compare(0, 6, "vdpol ") == 0) ++n_vdpol;
+	}
+	REQUIRE(n_vdpol == 1);
+
+	std::remove(file.c_str());
+}
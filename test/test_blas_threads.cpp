@@ -0,0 +1,64 @@
+#include <catch2/catch_all.hpp>
+
+#include <thread>
+
+#include "../blas_threads.hpp"
+
+
+TEST_CASE("BLAS thread counts follow the policy", "[blas_threads]")
+{
+	using namespace blas_threads;
+
+	blas_thread_policy p;
+	// Nothing changes the global thread count unless asked to:
+	REQUIRE(p.mode == blas_thread_policy::LEAVE);
+	REQUIRE(default_policy().mode == blas_thread_policy::LEAVE);
+	REQUIRE(choose_blas_threads(10000) == 0);
+	REQUIRE(choose_region_threads(8) == 0);
+
+	p.mode = blas_thread_policy::AUTO;
+	p.max_threads = 4;
+	p.min_parallel_size = 100;
+	REQUIRE(choose_blas_threads(10, &p) == 1);
+	REQUIRE(choose_blas_threads(100, &p) == 4);
+
+	p.mode = blas_thread_policy::SERIAL;
+	REQUIRE(choose_blas_threads(10000, &p) == 1);
+	p.mode = blas_thread_policy::FIXED;
+	REQUIRE(choose_blas_threads(10, &p) == 4);
+	p.mode = blas_thread_policy::LEAVE;
+	REQUIRE(choose_blas_threads(10000, &p) == 0);
+
+	SECTION("Parallel drivers limit BLAS per worker") {
+		REQUIRE(choose_region_threads(8, &p) == 1);
+		REQUIRE(choose_region_threads(1, &p) == 0);
+		p.mode = blas_thread_policy::FIXED;
+		REQUIRE(choose_region_threads(8, &p) == 4);
+		p.mode = blas_thread_policy::LEAVE;
+		REQUIRE(choose_region_threads(8, &p) == 0);
+	}
+
+	SECTION("Workers leave BLAS to the driver") {
+		p.mode = blas_thread_policy::FIXED;
+		int in_worker_threads = -1;
+		std::thread th([&p, &in_worker_threads]()
+		{
+			worker_scope scope;
+			in_worker_threads = choose_blas_threads(10000, &p)
+				+ choose_region_threads(8, &p);
+		});
+		th.join();
+		REQUIRE(in_worker_threads == 0);
+		REQUIRE(!in_worker());
+	}
+
+	SECTION("The default policy can be replaced") {
+		blas_thread_policy old = default_policy();
+		blas_thread_policy serial;
+		serial.mode = blas_thread_policy::SERIAL;
+		set_default_policy(serial);
+		REQUIRE(choose_blas_threads(100000) == 1);
+		set_default_policy(old);
+		REQUIRE(default_policy().mode == old.mode);
+	}
+}
@@ -0,0 +1,128 @@
+#include <catch2/catch_all.hpp>
+
+#include "../irk.hpp"
+#include "test_equations.hpp"
+
+
+namespace {
+
+// Independent Van der Pol oscillators with different stiffness.
+struct vdpol_cells
+{
+	typedef block_diag_mat jac_type;
+
+	explicit vdpol_cells(std::size_t n_cells)
+	{
+		for (std::size_t k = 0; k < n_cells; ++k) {
+			cells.push_back(test_equations::vdpol(0.01 + 0.1*k));
+		}
+	}
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		vec_type f(y.size());
+		for (std::size_t k = 0; k < cells.size(); ++k) {
+			f.subvec(2*k, 2*k+1) = cells[k].fun(t, y.subvec(2*k, 2*k+1));
+		}
+		return f;
+	}
+
+	jac_type jac(double t, const vec_type &y)
+	{
+		jac_type J;
+		for (std::size_t k = 0; k < cells.size(); ++k) {
+			J.add_block(cells[k].jac(t, y.subvec(2*k, 2*k+1)));
+		}
+		return J;
+	}
+
+	std::vector<test_equations::vdpol> cells;
+};
+
+
+// The same system with a dense Jacobi matrix.
+struct vdpol_cells_dense : vdpol_cells
+{
+	typedef mat_type jac_type;
+
+	explicit vdpol_cells_dense(std::size_t n_cells) : vdpol_cells(n_cells) {}
+
+	jac_type jac(double t, const vec_type &y)
+	{
+		return vdpol_cells::jac(t, y).to_dense();
+	}
+};
+
+} // namespace
+
+
+TEST_CASE("Block-diagonal factorization matches the dense one", "[block_jac]")
+{
+	irk::solver_coeffs sc = irk::get_coefficients(irk::RADAU_IIA_53);
+	block_diag_mat J(std::vector<std::size_t>{ 2, 1, 3 });
+	J.block(0) = { { -2.0, 1.0 }, { 0.5, -3.0 } };
+	J.block(1)(0,0) = -10.0;
+	J.block(2) = { { -1.0, 0.2, 0.0 }, { 0.0, -4.0, 1.0 },
+	               { 0.3, 0.0, -0.5 } };
+	const std::size_t Neq = J.n_rows(), Ns = sc.b.size();
+	REQUIRE(Neq == 6);
+	mat_type mass = arma::eye(Neq, Neq);
+	mass(2,2) = 0.0;
+
+	vec_type x = arma::linspace(1.0, 2.0, Ns*Neq);
+	mat_type X = arma::reshape(arma::linspace(-1.0, 1.0, 2*Ns*Neq),
+	                           Ns*Neq, 2);
+
+	for (const mat_type *m : { static_cast<const mat_type*>(nullptr),
+	                           static_cast<const mat_type*>(&mass) }) {
+		irk::stage_matrix dense;
+		irk::block_stage_matrix blocks;
+		dense.mass = blocks.mass = m;
+		blocks.n_threads = 2;
+		// The blocks are tiny, so threads are only used if forced to:
+		blocks.lu.min_parallel_work = 0;
+		REQUIRE(dense.factorize(J.to_dense(), 0.1, sc));
+		REQUIRE(blocks.factorize(J, 0.1, sc));
+
+		vec_type dx = dense.solve(x) - blocks.solve(x);
+		mat_type dX = dense.solve(X) - blocks.solve(X);
+		REQUIRE(arma::norm(dx, "inf") < 1e-12);
+		REQUIRE(arma::norm(dX, "inf") < 1e-12);
+	}
+
+	vec_type y = arma::linspace(0.0, 1.0, Neq);
+	vec_type Jy = J*y;
+	vec_type Jy_dense = J.to_dense()*y;
+	REQUIRE(arma::norm(Jy - Jy_dense, "inf") < 1e-14);
+}
+
+
+TEST_CASE("Solves with block-diagonal Jacobians", "[block_jac]")
+{
+	const std::size_t n_cells = 8;
+	vdpol_cells func_block(n_cells);
+	vdpol_cells_dense func_dense(n_cells);
+	vec_type y0(2*n_cells);
+	for (std::size_t k = 0; k < n_cells; ++k) {
+		y0(2*k) = 2.0;
+		y0(2*k+1) = 0.0;
+	}
+
+	irk::solver_options so = irk::default_solver_options();
+	newton::options n_opts;
+	n_opts.tol = 0.1*so.rel_tol;
+	so.newton_opts = &n_opts;
+	output_options output_opts;
+
+	irk::rk_output sol_dense = irk::odeint(func_dense, 0.0, 5.0, y0, so,
+	                                       output_opts);
+	for (unsigned n_threads : { 1u, 4u }) {
+		so.block_threads = n_threads;
+		irk::rk_output sol_block = irk::odeint(func_block, 0.0, 5.0, y0, so,
+		                                       output_opts);
+		REQUIRE(sol_block.status == SUCCESS);
+		REQUIRE(sol_block.t_vals.size() == sol_dense.t_vals.size());
+		vec_type diff = sol_block.y_vals.back() - sol_dense.y_vals.back();
+		REQUIRE(arma::norm(diff, "inf") < 1e-8);
+	}
+}
@@ -0,0 +1,89 @@
+#include <catch2/catch_all.hpp>
+
+#include <thread>
+
+#include "../erk.hpp"
+#include "../irk.hpp"
+#include "test_equations.hpp"
+
+
+// Cancels the token from another thread after a number of evaluations.
+struct cancelling_vdpol : public test_equations::vdpol
+{
+	cancelling_vdpol(cancel_token &token, std::size_t after)
+		: vdpol(0.5), token(token), after(after), calls(0) {}
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		if (++calls == after) {
+			std::thread([this](){ token.cancel(); }).join();
+		}
+		return vdpol::fun(t, y);
+	}
+
+	cancel_token &token;
+	std::size_t after, calls;
+};
+
+
+TEST_CASE("Budgets and cancellation", "[budget]")
+{
+	vec_type y0 = { 2.0, 0.0 };
+	double t1 = 100.0;
+	output_options output_opts;
+	irk::solver_options so = irk::default_solver_options();
+	newton::options n_opts;
+	n_opts.tol = 0.1*so.rel_tol;
+	so.newton_opts = &n_opts;
+
+	SECTION("Function evaluation budget") {
+		test_equations::vdpol func(0.5);
+		so.max_fun_evals = 200;
+		irk::rk_output sol = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+		REQUIRE(sol.status == ERROR_BUDGET_EXCEEDED);
+		REQUIRE(sol.t_vals.back() < t1);
+		REQUIRE(sol.t_vals.size() == sol.y_vals.size());
+	}
+
+	SECTION("Jacobian evaluation budget") {
+		test_equations::vdpol func(0.5);
+		so.max_jac_evals = 3;
+		irk::rk_output sol = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+		REQUIRE(sol.status == ERROR_BUDGET_EXCEEDED);
+		REQUIRE(sol.t_vals.back() < t1);
+	}
+
+	SECTION("Step limit") {
+		// Stopping early still fills in the statistics of the solve:
+		test_equations::vdpol func(0.5);
+		so.max_steps = 10;
+		irk::rk_output sol = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+		REQUIRE(sol.status == ERROR_MAX_STEPS_EXCEEDED);
+		REQUIRE(sol.accept_frac > 0.0);
+		REQUIRE(sol.allocs.trajectory_bytes > 0);
+
+		erk::solver_options eso;
+		eso.max_steps = 10;
+		erk::rk_output esol = erk::odeint(func, 0.0, t1, y0, eso, output_opts);
+		REQUIRE(esol.status == ERROR_MAX_STEPS_EXCEEDED);
+		REQUIRE(esol.accept_frac > 0.0);
+		REQUIRE(esol.allocs.trajectory_bytes > 0);
+	}
+
+	SECTION("Cancellation from another thread") {
+		cancel_token token;
+		cancelling_vdpol func(token, 100);
+		so.cancel = &token;
+		irk::rk_output sol = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+		REQUIRE(sol.status == CANCELLED);
+		REQUIRE(sol.t_vals.back() < t1);
+
+		token.reset();
+		erk::solver_options eso;
+		eso.cancel = &token;
+		token.cancel();
+		erk::rk_output esol = erk::odeint(func, 0.0, t1, y0, eso, output_opts);
+		REQUIRE(esol.status == CANCELLED);
+		REQUIRE(esol.t_vals.size() == 1);
+	}
+}
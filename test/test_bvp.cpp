@@ -0,0 +1,85 @@
+#include <catch2/catch_all.hpp>
+
+#include "../bvp.hpp"
+
+
+// y'' = -y as a first order system.
+struct harmonic
+{
+	typedef mat_type jac_type;
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		return { y(1), -y(0) };
+	}
+
+	jac_type jac(double t, const vec_type &y)
+	{
+		return { { 0.0, 1.0 },
+		         { -1.0, 0.0 } };
+	}
+};
+
+
+// y(0) = 0, y(b) = 1, so y = sin(t) / sin(b).
+struct dirichlet_bc
+{
+	vec_type fun(const vec_type &ya, const vec_type &yb)
+	{
+		return { ya(0), yb(0) - 1.0 };
+	}
+
+	mat_type jac_a(const vec_type &ya, const vec_type &yb)
+	{
+		return { { 1.0, 0.0 },
+		         { 0.0, 0.0 } };
+	}
+
+	mat_type jac_b(const vec_type &ya, const vec_type &yb)
+	{
+		return { { 0.0, 0.0 },
+		         { 1.0, 0.0 } };
+	}
+};
+
+
+TEST_CASE("Multiple shooting for a linear BVP", "[bvp]")
+{
+	harmonic func;
+	dirichlet_bc bc;
+	double b = 1.5;
+	double exact_slope = 1.0 / std::sin(b);
+
+	for (std::size_t m : { 1, 4 }) {
+		std::vector<double> t_nodes;
+		std::vector<vec_type> y_guess;
+		for (std::size_t k = 0; k <= m; ++k) {
+			t_nodes.push_back(b*k / m);
+			if (k < m) y_guess.push_back({ 0.0, 0.0 });
+		}
+
+		bvp::solver_options opts;
+		opts.n_threads = 2;
+		// Copies must not refer to the Newton options of the original:
+		bvp::solver_options opts_copy = opts;
+		bvp::bvp_output out = bvp::solve(func, bc, t_nodes, y_guess,
+		                                 opts_copy);
+
+		REQUIRE(out.status == SUCCESS);
+		// The problem is linear, so one Newton step solves it:
+		REQUIRE(out.newton_stats.iters <= 2);
+		REQUIRE(out.y_nodes.size() == m + 1);
+		REQUIRE(out.y_nodes[0](1) == Catch::Approx(exact_slope).epsilon(1e-4));
+		for (std::size_t k = 0; k <= m; ++k) {
+			double yk = std::sin(t_nodes[k]) * exact_slope;
+			REQUIRE(out.y_nodes[k](0) == Catch::Approx(yk).margin(1e-4));
+		}
+
+		const irk::rk_output &sol = out.sol;
+		REQUIRE(sol.t_vals.front() == 0.0);
+		REQUIRE(sol.t_vals.back() == Catch::Approx(b));
+		for (std::size_t i = 1; i < sol.t_vals.size(); ++i) {
+			REQUIRE(sol.t_vals[i] > sol.t_vals[i-1]);
+		}
+	}
+}
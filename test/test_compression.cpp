@@ -0,0 +1,88 @@
+#include <catch2/catch_all.hpp>
+
+#include "../irk.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Compressed trajectory round trip", "[compression]")
+{
+	compression_options lossless;
+	lossless.chunk_records = 100;
+	compression_options lossy = lossless;
+	lossy.lossy = true;
+	lossy.abs_tol = 1e-6;
+	lossy.rel_tol = 1e-5;
+
+	compressed_trajectory exact(lossless), rounded(lossy);
+	std::vector<double> ts;
+	std::vector<vec_type> ys;
+	for (std::size_t i = 0; i < 5000; ++i) {
+		double t = 1e-3*i;
+		vec_type y = { std::cos(t), std::exp(-t) };
+		exact.push_back(t, y);
+		rounded.push_back(t, y);
+		ts.push_back(t);
+		ys.push_back(y);
+	}
+	REQUIRE(exact.size() == 5000);
+	REQUIRE(exact.n_chunks() == 50);
+
+	std::vector<double> t_exact = exact.t_vals();
+	std::vector<double> t_rounded = rounded.t_vals();
+	mat_type Y_exact = exact.to_mat();
+	mat_type Y_rounded = rounded.to_mat();
+	for (std::size_t i = 0; i < ts.size(); ++i) {
+		// Times are always exact:
+		REQUIRE(t_exact[i] == ts[i]);
+		REQUIRE(t_rounded[i] == ts[i]);
+		for (std::size_t j = 0; j < 2; ++j) {
+			REQUIRE(Y_exact(j, i) == ys[i](j));
+			double bound = lossy.abs_tol + lossy.rel_tol*std::fabs(ys[i](j));
+			REQUIRE(std::fabs(Y_rounded(j, i) - ys[i](j)) <= bound);
+		}
+	}
+
+	// Random access decodes a single chunk:
+	REQUIRE(exact.t(4321) == ts[4321]);
+	REQUIRE(exact.y(4321)(1) == ys[4321](1));
+
+	REQUIRE(exact.compressed_bytes() < exact.raw_bytes());
+	REQUIRE(4*rounded.compressed_bytes() < rounded.raw_bytes());
+}
+
+
+TEST_CASE("Solvers can store a compressed trajectory", "[compression]")
+{
+	test_equations::vdpol func(1.0);
+	irk::solver_options opts = irk::default_solver_options();
+	newton::options n_opts;
+	opts.newton_opts = &n_opts;
+	vec_type y0 = { 2.0, 0.0 };
+
+	compressed_trajectory store;
+	output_options output_opts;
+	output_opts.compressed = &store;
+
+	irk::rk_output sol = irk::odeint(func, 0.0, 10.0, y0, opts,
+	                                 output_opts, irk::RADAU_IIA_53, 1e-3);
+	REQUIRE(sol.status == SUCCESS);
+	REQUIRE(store.size() == sol.t_vals.size());
+
+	mat_type Y = store.to_mat();
+	std::vector<double> t = store.t_vals();
+	for (std::size_t i = 0; i < store.size(); ++i) {
+		REQUIRE(t[i] == sol.t_vals[i]);
+		REQUIRE(Y(0, i) == sol.y_vals[i](0));
+		REQUIRE(Y(1, i) == sol.y_vals[i](1));
+	}
+
+	// Keep only the lossy copy:
+	compressed_trajectory lossy(lossy_compression(opts));
+	output_opts.compressed = &lossy;
+	output_opts.disable_store_in_vectors();
+	irk::rk_output sol2 = irk::odeint(func, 0.0, 10.0, y0, opts,
+	                                  output_opts, irk::RADAU_IIA_53, 1e-3);
+	REQUIRE(sol2.status == SUCCESS);
+	REQUIRE(lossy.size() == store.size());
+	REQUIRE(lossy.compressed_bytes() < store.compressed_bytes());
+}
@@ -0,0 +1,119 @@
+#include <catch2/catch_all.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../erk.hpp"
+#include "../irk.hpp"
+#include "../multistep.hpp"
+#include "test_equations.hpp"
+
+
+// These are meant to be run under ThreadSanitizer as well, see
+// REHUEL_TSAN in CMakeLists.txt.
+
+namespace {
+
+struct solve_result
+{
+	int status;
+	std::size_t steps;
+	vec_type y1;
+};
+
+solve_result solve_irk(double mu)
+{
+	test_equations::vdpol func(mu);
+	irk::solver_options so = irk::default_solver_options();
+	newton::options n_opts;
+	n_opts.tol = 0.1*so.rel_tol;
+	so.newton_opts = &n_opts;
+	output_options output_opts;
+	vec_type y0 = { 2.0, 0.0 };
+	irk::rk_output sol = irk::odeint(func, 0.0, 2.0, y0, so, output_opts,
+	                                 irk::name_to_method("RADAU_IIA_53"));
+	return { sol.status, sol.t_vals.size(), sol.y_vals.back() };
+}
+
+solve_result solve_erk(double mu)
+{
+	test_equations::vdpol func(mu);
+	erk::solver_options so = erk::default_solver_options();
+	output_options output_opts;
+	vec_type y0 = { 2.0, 0.0 };
+	erk::rk_output sol = erk::odeint(func, 0.0, 2.0, y0, so, output_opts,
+	                                 erk::name_to_method("DORMAND_PRINCE_54"));
+	return { sol.status, sol.t_vals.size(), sol.y_vals.back() };
+}
+
+solve_result solve_bdf(double mu)
+{
+	test_equations::vdpol func(mu);
+	multistep::solver_options so;
+	so.order = 2;
+	vec_type y0 = { 2.0, 0.0 };
+	multistep::multistep_output sol = multistep::bdf(func, 0.0, 0.5, y0,
+	                                                 so, 1e-3);
+	return { sol.status, sol.t_vals.size(), sol.y_vals.back() };
+}
+
+} // namespace
+
+
+TEST_CASE("Concurrent solves match serial solves", "[concurrency]")
+{
+	const unsigned n_threads = 8;
+	const std::size_t n_rounds = 4;
+	std::vector<double> mus = { 0.5, 1.0, 2.0, 5.0 };
+
+	auto run = [&mus](std::vector<solve_result> &res)
+	{
+		for (double mu : mus) {
+			res.push_back(solve_irk(mu));
+			res.push_back(solve_erk(mu));
+			res.push_back(solve_bdf(mu));
+		}
+	};
+
+	std::vector<solve_result> ref;
+	run(ref);
+
+	std::vector<std::vector<solve_result> > results(n_threads*n_rounds);
+	std::vector<std::thread> threads;
+	for (unsigned w = 0; w < n_threads; ++w) {
+		threads.emplace_back([&results, &run, w, n_threads, n_rounds]()
+		{
+			for (std::size_t r = 0; r < n_rounds; ++r) {
+				run(results[r*n_threads + w]);
+				// Also hammer the method tables:
+				for (const std::string &name : irk::all_method_names()) {
+					irk::method_to_name(irk::name_to_method(name));
+				}
+				erk::method_to_name(erk::name_to_method("no such method"));
+			}
+		});
+	}
+	for (std::thread &th : threads) {
+		th.join();
+	}
+
+	for (const std::vector<solve_result> &res : results) {
+		REQUIRE(res.size() == ref.size());
+		for (std::size_t i = 0; i < ref.size(); ++i) {
+			REQUIRE(res[i].status == ref[i].status);
+			REQUIRE(res[i].steps == ref[i].steps);
+			REQUIRE(res[i].y1(0) == Catch::Approx(ref[i].y1(0)));
+			REQUIRE(res[i].y1(1) == Catch::Approx(ref[i].y1(1)));
+		}
+	}
+}
+
+
+TEST_CASE("Unknown method names do not modify the tables", "[concurrency]")
+{
+	std::size_t n = irk::all_method_names().size();
+	REQUIRE(irk::name_to_method("no such method") == 0);
+	REQUIRE(std::string(irk::method_to_name(-12345)) == "");
+	REQUIRE(irk::all_method_names().size() == n);
+}
@@ -0,0 +1,126 @@
+#include <catch2/catch_all.hpp>
+#include <stdexcept>
+
+#include "../ensemble.hpp"
+#include "../irk.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Streaming ensemble statistics", "[ensemble]")
+{
+	std::vector<double> t_eval = { 0.0, 0.5, 1.0 };
+	std::vector<double> quantiles = { 0.5 };
+
+	// Trajectories y(t) = a*(1 + t) for a = 0, 1, ..., 99, sampled on
+	// a coarser grid than the output grid to exercise interpolation.
+	auto make_sol = [](double a)
+	{
+		basic_output sol;
+		sol.status = SUCCESS;
+		sol.t_vals = { 0.0, 0.25, 0.75, 1.0 };
+		for (double t : sol.t_vals) {
+			sol.y_vals.push_back(vec_type{a*(1.0 + t)});
+		}
+		return sol;
+	};
+
+	// Feed them in a scrambled order since sorted input is the worst
+	// case for the quantile sketch:
+	ensemble::reducer serial(t_eval, 1, quantiles);
+	for (std::size_t i = 0; i < 100; ++i) {
+		serial.add_trajectory(make_sol((37*i) % 100));
+	}
+	REQUIRE(serial.n_trajectories() == 100);
+
+	// mean of 0..99 is 49.5, sample variance is 100*101/12 = 841.666...
+	for (std::size_t k = 0; k < t_eval.size(); ++k) {
+		double s = 1.0 + t_eval[k];
+		REQUIRE(serial.count(k) == 100);
+		REQUIRE(serial.mean()(0,k) == Catch::Approx(49.5*s));
+		REQUIRE(serial.variance()(0,k) == Catch::Approx(100*101/12.0*s*s));
+		REQUIRE(serial.min()(0,k) == Catch::Approx(0.0));
+		REQUIRE(serial.max()(0,k) == Catch::Approx(99.0*s));
+		REQUIRE(serial.quantile(0)(0,k) == Catch::Approx(49.5*s).epsilon(0.05));
+	}
+
+	SECTION("Parallel reduction matches serial reduction") {
+		ensemble::reducer proto(t_eval, 1, quantiles);
+		auto par = ensemble::reduce(proto, 100, [&make_sol](std::size_t i)
+		                            { return make_sol(i); }, 4);
+		REQUIRE(par.n_trajectories() == 100);
+		for (std::size_t k = 0; k < t_eval.size(); ++k) {
+			REQUIRE(par.mean()(0,k) == Catch::Approx(serial.mean()(0,k)));
+			REQUIRE(par.variance()(0,k) ==
+			        Catch::Approx(serial.variance()(0,k)));
+			REQUIRE(par.min()(0,k) == serial.min()(0,k));
+			REQUIRE(par.max()(0,k) == serial.max()(0,k));
+			REQUIRE(par.quantile(0)(0,k) ==
+			        Catch::Approx(serial.quantile(0)(0,k)).epsilon(0.1));
+		}
+	}
+
+	SECTION("Ensemble of ODE solves") {
+		std::vector<double> t_grid = { 0.0, 1.0, 2.0 };
+		ensemble::reducer proto(t_grid, 1);
+		auto solve_one = [](std::size_t i)
+		{
+			test_equations::exponential func(-0.1*(i+1));
+			output_options output_opts;
+			newton::options n_opts;
+			auto so = irk::default_solver_options();
+			so.newton_opts = &n_opts;
+			vec_type y0 = { 1.0 };
+			return irk::odeint(func, 0.0, 2.0, y0, so, output_opts);
+		};
+		auto stats = ensemble::reduce(proto, 8, solve_one, 2);
+
+		double mean_t2 = 0.0;
+		for (std::size_t i = 0; i < 8; ++i) {
+			mean_t2 += std::exp(-0.2*(i+1)) / 8.0;
+		}
+		REQUIRE(stats.count(2) == 8);
+		REQUIRE(stats.mean()(0,0) == Catch::Approx(1.0));
+		REQUIRE(stats.mean()(0,2) == Catch::Approx(mean_t2).epsilon(1e-2));
+	}
+
+	SECTION("Samples between steps come from the dense output") {
+		std::vector<double> t_grid;
+		for (int k = 0; k <= 40; ++k) t_grid.push_back(0.05*k);
+		ensemble::reducer proto(t_grid, 1);
+		auto solve_one = [](std::size_t)
+		{
+			test_equations::exponential func(-1.0);
+			output_options output_opts;
+			newton::options n_opts;
+			auto so = irk::default_solver_options();
+			so.newton_opts = &n_opts;
+			so.rel_tol = so.abs_tol = 1e-7;
+			vec_type y0 = { 1.0 };
+			return irk::odeint(func, 0.0, 2.0, y0, so, output_opts);
+		};
+		auto stats = ensemble::reduce(proto, 1, solve_one, 1);
+
+		// Linear interpolation between the coarse steps would be off
+		// by far more than this:
+		for (std::size_t k = 0; k < t_grid.size(); ++k) {
+			REQUIRE(stats.count(k) == 1);
+			REQUIRE(stats.mean()(0,k) ==
+			        Catch::Approx(std::exp(-t_grid[k])).epsilon(1e-5));
+		}
+	}
+
+	SECTION("Exceptions in workers reach the caller") {
+		std::vector<double> t_grid = { 0.0, 1.0 };
+		ensemble::reducer proto(t_grid, 1);
+		auto solve_one = [](std::size_t i)
+		{
+			if (i == 3) throw std::runtime_error("solve failed");
+			irk::rk_output sol;
+			sol.t_vals = { 0.0, 1.0 };
+			sol.y_vals = { vec_type{ 1.0 }, vec_type{ 1.0 } };
+			return sol;
+		};
+		REQUIRE_THROWS_AS(ensemble::reduce(proto, 8, solve_one, 2),
+		                  std::runtime_error);
+	}
+}
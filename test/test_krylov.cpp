@@ -0,0 +1,280 @@
+#include <catch2/catch_all.hpp>
+
+#include "../irk.hpp"
+#include "../multistep.hpp"
+#include "../newton.hpp"
+
+
+namespace {
+
+// A non-symmetric sparse matrix: convection-diffusion plus a few
+// long-range couplings.
+mat_type test_matrix(std::size_t n)
+{
+	mat_type A = arma::zeros(n, n);
+	for (std::size_t i = 0; i < n; ++i) {
+		A(i,i) = 4.0 + 0.01*i;
+		if (i > 0)     A(i,i-1) = -1.5;
+		if (i + 1 < n) A(i,i+1) = -0.8;
+		if (i + 7 < n) A(i,i+7) = 0.3;
+		if (i >= 11)   A(i,i-11) = -0.2;
+	}
+	return A;
+}
+
+
+// Reaction-diffusion on a 1D grid: stiff, with a banded Jacobi matrix.
+struct reaction_diffusion
+{
+	typedef mat_type jac_type;
+
+	explicit reaction_diffusion(std::size_t n) : n(n), D(n*n) {}
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		vec_type f(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			double l = i > 0 ? y(i-1) : 0.0;
+			double r = i + 1 < n ? y(i+1) : 0.0;
+			f(i) = D*(l - 2*y(i) + r) - y(i)*y(i);
+		}
+		return f;
+	}
+
+	jac_type jac(double t, const vec_type &y)
+	{
+		mat_type J = arma::zeros(n, n);
+		for (std::size_t i = 0; i < n; ++i) {
+			J(i,i) = -2*D - 2*y(i);
+			if (i > 0)     J(i,i-1) = D;
+			if (i + 1 < n) J(i,i+1) = D;
+		}
+		return J;
+	}
+
+	std::size_t n;
+	double D;
+};
+
+} // namespace
+
+
+TEST_CASE("GMRES with preconditioners", "[krylov]")
+{
+	const std::size_t n = 60;
+	mat_type A = test_matrix(n);
+	vec_type b = arma::linspace(-1.0, 1.0, n);
+	vec_type x_ref = arma::solve(A, b);
+	krylov::csr_matrix C(A);
+
+	krylov::options opts;
+	opts.tol = 1e-10;
+	opts.restart = 20;
+
+	krylov::status plain;
+	vec_type x;
+	REQUIRE(krylov::gmres(C, b, x, opts, plain) == krylov::SUCCESS);
+	REQUIRE(arma::norm(x - x_ref, "inf") < 1e-8);
+
+	krylov::ilu0 p_ilu0;
+	krylov::ilut p_ilut(1e-3, 8);
+	krylov::block_jacobi p_block(10);
+	for (krylov::preconditioner *p :
+		     std::vector<krylov::preconditioner*>{ &p_ilu0, &p_ilut, &p_block }) {
+		opts.precond = p;
+		p->refresh(C);
+		krylov::status stats;
+		x.reset();
+		REQUIRE(krylov::gmres(C, b, x, opts, stats) == krylov::SUCCESS);
+		REQUIRE(arma::norm(x - x_ref, "inf") < 1e-8);
+		REQUIRE(stats.iters < plain.iters);
+	}
+
+	// Without dropping, ILUT is the full LU decomposition:
+	krylov::ilut exact(0.0, n);
+	exact.refresh(C);
+	REQUIRE(arma::norm(exact.apply(b) - x_ref, "inf") < 1e-10);
+}
+
+
+TEST_CASE("Block-Jacobi with a singular diagonal block", "[krylov]")
+{
+	// Saddle point system like an index-1 DAE: the algebraic block on
+	// the diagonal is zero, the full matrix is not singular.
+	const std::size_t m = 10;
+	mat_type A = arma::zeros(2*m, 2*m);
+	A.submat(0, 0, m - 1, m - 1) = test_matrix(m);
+	A.submat(0, m, m - 1, 2*m - 1) = arma::eye(m, m);
+	A.submat(m, 0, 2*m - 1, m - 1) = arma::eye(m, m);
+	vec_type b = arma::linspace(-1.0, 1.0, 2*m);
+	krylov::csr_matrix C(A);
+
+	krylov::block_jacobi p(m);
+	p.refresh(C);
+	REQUIRE(p.apply(b).is_finite());
+
+	krylov::options opts;
+	opts.tol = 1e-10;
+	opts.precond = &p;
+	krylov::status stats;
+	vec_type x;
+	REQUIRE(krylov::gmres(C, b, x, opts, stats) == krylov::SUCCESS);
+	REQUIRE(arma::norm(x - arma::solve(A, b), "inf") < 1e-8);
+}
+
+
+TEST_CASE("Preconditioners are re-used between refreshes", "[krylov]")
+{
+	krylov::csr_matrix C(test_matrix(20));
+	krylov::ilu0 p;
+	p.refresh_every = 3;
+	for (int i = 0; i < 7; ++i) p.refresh(C);
+	REQUIRE(p.setups() == 3);
+
+	// A change in size always triggers a new setup:
+	p.refresh(krylov::csr_matrix(test_matrix(10)));
+	REQUIRE(p.setups() == 4);
+}
+
+
+TEST_CASE("Krylov solves in the implicit solvers", "[krylov]")
+{
+	const std::size_t n = 30;
+	reaction_diffusion func(n);
+	vec_type y0(n);
+	for (std::size_t i = 0; i < n; ++i) {
+		y0(i) = std::sin(std::acos(-1.0)*(i + 1.0)/(n + 1.0));
+	}
+
+	krylov::ilu0 precond;
+	krylov::options k_opts;
+	k_opts.tol = 1e-10;
+	k_opts.precond = &precond;
+
+	SECTION("IRK stage solves") {
+		irk::solver_options so = irk::default_solver_options();
+		newton::options n_opts;
+		n_opts.tol = 0.1*so.rel_tol;
+		so.newton_opts = &n_opts;
+		output_options output_opts;
+		irk::rk_output direct = irk::odeint(func, 0.0, 0.5, y0, so,
+		                                    output_opts);
+
+		n_opts.krylov = &k_opts;
+		irk::rk_output iterative = irk::odeint(func, 0.0, 0.5, y0, so,
+		                                       output_opts);
+		REQUIRE(iterative.status == SUCCESS);
+		vec_type diff = iterative.y_vals.back() - direct.y_vals.back();
+		REQUIRE(arma::norm(diff, "inf") < 1e-6);
+		// One setup per Jacobi matrix update:
+		REQUIRE(precond.setups() == iterative.count.jac_evals);
+	}
+
+	SECTION("BDF with a user-supplied preconditioner") {
+		// Diagonal scaling as a stand-in for a physics-based one:
+		vec_type inv_diag;
+		krylov::callback_preconditioner user(
+			[&inv_diag](const krylov::csr_matrix &A) {
+				inv_diag.set_size(A.n_rows());
+				for (std::size_t i = 0; i < A.n_rows(); ++i) {
+					for (std::size_t p = A.row_ptr[i];
+					     p < A.row_ptr[i+1]; ++p) {
+						if (A.col[p] == i) inv_diag(i) = 1.0 / A.val[p];
+					}
+				}
+			},
+			[&inv_diag](const vec_type &r) -> vec_type {
+				return inv_diag % r;
+			});
+		k_opts.precond = &user;
+
+		multistep::solver_options so;
+		so.order = 2;
+		multistep::multistep_output direct =
+			multistep::bdf(func, 0.0, 0.1, y0, so, 1e-3);
+		so.krylov = &k_opts;
+		multistep::multistep_output iterative =
+			multistep::bdf(func, 0.0, 0.1, y0, so, 1e-3);
+		REQUIRE(iterative.status == SUCCESS);
+		vec_type diff = iterative.y_vals.back() - direct.y_vals.back();
+		REQUIRE(arma::norm(diff, "inf") < 1e-6);
+		REQUIRE(user.setups() > 0);
+	}
+}
+
+
+TEST_CASE("Unconverged GMRES solves fail the Newton iterations", "[krylov]")
+{
+	const std::size_t n = 60;
+	mat_type A = test_matrix(n);
+	vec_type b = arma::linspace(-1.0, 1.0, n);
+
+	// Far too few iterations to reach the tolerance:
+	krylov::options k_opts;
+	k_opts.tol = 1e-10;
+	k_opts.maxit = 1;
+
+	krylov::solver linear;
+	linear.opts = &k_opts;
+	linear.set_matrix(A);
+	linear.solve(b);
+	REQUIRE(linear.last_status == krylov::MAXIT_EXCEEDED);
+	REQUIRE(linear.failures == 1);
+
+	SECTION("newton_iterate") {
+		struct linear_system
+		{
+			typedef mat_type jac_type;
+			vec_type fun(const vec_type &x) { return A*x - b; }
+			jac_type jac(const vec_type &) { return A; }
+			mat_type A;
+			vec_type b;
+		} func{ A, b };
+
+		newton::options n_opts;
+		n_opts.krylov = &k_opts;
+		newton::status stats;
+		newton::newton_iterate(func, vec_type(arma::zeros(n)), n_opts, stats);
+		REQUIRE(stats.conv_status == newton::GENERIC_ERROR);
+	}
+
+	SECTION("IRK stage matrix") {
+		irk::solver_coeffs sc = irk::get_coefficients(irk::RADAU_IIA_53);
+		irk::stage_matrix M;
+		M.iterative.opts = &k_opts;
+		REQUIRE(M.factorize(A, 0.1, sc));
+		M.solve(vec_type(arma::ones(sc.b.size()*n)));
+		REQUIRE(M.solve_failed());
+
+		k_opts.maxit = 300;
+		M.solve(vec_type(arma::ones(sc.b.size()*n)));
+		REQUIRE(!M.solve_failed());
+	}
+
+	SECTION("IRK sensitivity stages") {
+		reaction_diffusion func(30);
+		const std::size_t Neq = func.n;
+		irk::solver_coeffs sc = irk::get_coefficients(irk::RADAU_IIA_53);
+		const std::size_t Ns = sc.b.size();
+		vec_type y = arma::linspace(0.1, 1.0, Neq);
+		mat_type J = func.jac(0.0, y);
+		vec_type Y = arma::zeros(Ns*Neq);
+		mat_type S = arma::eye(Neq, 2);
+
+		// Only sensitivities to y0, so dfdp is never needed:
+		sensitivity_options sens_opts;
+		sens_opts.param_col = S.n_cols;
+
+		irk::stage_matrix M;
+		M.iterative.opts = &k_opts;
+		REQUIRE(M.factorize(J, 0.1, sc));
+		mat_type Sigma;
+		std::size_t jac_evals = 0;
+		REQUIRE(irk::sensitivity_stages(func, y, S, 0.0, 0.1, sc, Y, J, M,
+		                                sens_opts, Sigma, jac_evals) == -1);
+
+		k_opts.maxit = 300;
+		REQUIRE(irk::sensitivity_stages(func, y, S, 0.0, 0.1, sc, Y, J, M,
+		                                sens_opts, Sigma, jac_evals) > 0);
+	}
+}
@@ -0,0 +1,67 @@
+#include <catch2/catch_all.hpp>
+
+#include <thread>
+
+#include "../erk.hpp"
+#include "../irk.hpp"
+#include "../multistep.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Progress snapshots", "[progress]")
+{
+	test_equations::vdpol func(0.5);
+	vec_type y0 = { 2.0, 0.0 };
+	double t1 = 20.0;
+	output_options output_opts;
+	progress_handle progress;
+
+	SECTION("Read from a monitoring thread during an IRK solve") {
+		irk::solver_options so = irk::default_solver_options();
+		newton::options n_opts;
+		n_opts.tol = 0.1*so.rel_tol;
+		so.newton_opts = &n_opts;
+		so.progress = &progress;
+
+		std::atomic<bool> monotone(true);
+		std::thread monitor([&progress, &monotone]()
+		{
+			progress_snapshot last;
+			while (!last.done) {
+				progress_snapshot s = progress.read();
+				if (s.t < last.t || s.steps < last.steps ||
+				    s.attempts < s.steps) {
+					monotone = false;
+				}
+				last = s;
+			}
+		});
+		irk::rk_output sol = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+		monitor.join();
+
+		progress_snapshot s = progress.read();
+		REQUIRE(monotone);
+		REQUIRE(s.done);
+		REQUIRE(s.t == t1);
+		REQUIRE(s.fraction_done() == Catch::Approx(1.0));
+		REQUIRE(s.steps + 1 == static_cast<long long>(sol.t_vals.size()));
+		REQUIRE(s.fun_evals == static_cast<long long>(sol.count.fun_evals));
+	}
+
+	SECTION("ERK and multistep publish too") {
+		erk::solver_options eso;
+		eso.progress = &progress;
+		erk::odeint(func, 0.0, t1, y0, eso, output_opts);
+		REQUIRE(progress.read().done);
+		REQUIRE(progress.read().t == t1);
+
+		progress_handle ms_progress;
+		multistep::solver_options mso;
+		mso.order = 2;
+		mso.progress = &ms_progress;
+		multistep::multistep_output sol =
+			multistep::bdf(func, 0.0, 1.0, y0, mso, 1e-2);
+		REQUIRE(ms_progress.read().done);
+		REQUIRE(ms_progress.read().t == sol.t_vals.back());
+	}
+}
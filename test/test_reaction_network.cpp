@@ -0,0 +1,123 @@
+#include <catch2/catch_all.hpp>
+
+#include "../irk.hpp"
+#include "../multistep.hpp"
+#include "../reaction_network.hpp"
+#include "test_equations.hpp"
+
+
+static void check_same(mass_action_functor &net, functor &ref,
+                       const vec_type &y)
+{
+	vec_type f = net.fun(0.0, y);
+	vec_type f_ref = ref.fun(0.0, y);
+	mat_type J = net.jac(0.0, y);
+	mat_type J_ref = ref.jac(0.0, y);
+	mat_type Js(net.jac_sparse(0.0, y));
+	for (std::size_t i = 0; i < y.size(); ++i) {
+		REQUIRE(f(i) == Catch::Approx(f_ref(i))
+		        .epsilon(1e-12).margin(1e-12));
+		for (std::size_t j = 0; j < y.size(); ++j) {
+			REQUIRE(J(i,j) == Catch::Approx(J_ref(i,j))
+			        .epsilon(1e-12).margin(1e-12));
+			REQUIRE(Js(i,j) == J(i,j));
+		}
+	}
+}
+
+
+TEST_CASE("Mass-action networks match the hand-written problems",
+          "[reaction_network]")
+{
+	SECTION("Robertson") {
+		reaction_network net;
+		net.add_reaction("A -> B", 0.04);
+		net.add_reaction("B + C -> A + C", 1e4);
+		net.add_reaction("2 B -> B + C", 3e7);
+		REQUIRE(net.n_species() == 3);
+		mass_action_functor func = net.build();
+
+		// dC/dA and dC/dC are structurally zero: C is not
+		// changed by the only reaction that depends on it.
+		REQUIRE(func.n_nonzero() == 7);
+
+		test_equations::rober ref;
+		check_same(func, ref, vec_type{ 0.9, 1e-5, 0.1 });
+		check_same(func, ref, vec_type{ 0.2, 3e-6, 0.8 });
+	}
+
+	SECTION("Dimer") {
+		double rate = 3.0;
+		reaction_network net;
+		net.add_reaction("2 A -> B", rate);
+		net.add_reaction("B -> 2A", 1.0 / rate);
+		mass_action_functor func = net.build();
+		test_equations::dimer ref(rate);
+		check_same(func, ref, vec_type{ 0.7, 0.4 });
+	}
+
+	SECTION("Kinetic 4") {
+		double b2 = 0.5, b3 = 0.25, b4 = 0.125;
+		reaction_network net;
+		net.add_species("A");
+		net.add_species("B");
+		net.add_species("C");
+		net.add_species("D");
+		net.add_reaction("2A -> B", 1.0);
+		net.add_reaction("A + B -> C", 1.0);
+		net.add_reaction("A + C -> D", 1.0);
+		net.add_reaction("B -> 2A", b2);
+		net.add_reaction("C -> A + B", b3);
+		net.add_reaction("D -> A + C", b4);
+		mass_action_functor func = net.build();
+		test_equations::kinetic_4 ref(b2, b3, b4);
+		check_same(func, ref, vec_type{ 1.0, 0.5, 0.25, 0.125 });
+		check_same(func, ref, vec_type{ 0.0, 0.3, 0.0, 0.7 });
+	}
+
+	SECTION("Malformed equations are rejected") {
+		reaction_network net;
+		REQUIRE(net.add_reaction("A + -> B", 1.0) == reaction_network::invalid);
+		REQUIRE(net.add_reaction("A B", 1.0) == reaction_network::invalid);
+		REQUIRE(net.n_reactions() == 0);
+		REQUIRE(net.add_reaction("0 -> A", 1.0) == 0);
+		REQUIRE(net.add_reaction("A -> 0", 1.0) == 1);
+	}
+}
+
+
+TEST_CASE("Mass-action networks work with the implicit solvers",
+          "[reaction_network]")
+{
+	reaction_network net;
+	net.add_reaction("A -> B", 0.04);
+	net.add_reaction("B + C -> A + C", 1e4);
+	net.add_reaction("2 B -> B + C", 3e7);
+	mass_action_functor func = net.build();
+	test_equations::rober ref;
+	vec_type y0 = { 1.0, 0.0, 0.0 };
+
+	irk::solver_options opts = irk::default_solver_options();
+	newton::options n_opts;
+	opts.newton_opts = &n_opts;
+	output_options output_opts;
+	irk::rk_output sol = irk::odeint(func, 0.0, 100.0, y0, opts,
+	                                 output_opts, irk::RADAU_IIA_53, 1e-6);
+	irk::rk_output sol_ref = irk::odeint(ref, 0.0, 100.0, y0, opts,
+	                                     output_opts, irk::RADAU_IIA_53, 1e-6);
+	REQUIRE(sol.status == SUCCESS);
+	REQUIRE(sol.t_vals.size() == sol_ref.t_vals.size());
+	for (std::size_t i = 0; i < 3; ++i) {
+		REQUIRE(sol.y_vals.back()(i) ==
+		        Catch::Approx(sol_ref.y_vals.back()(i))
+		        .epsilon(1e-8).margin(1e-12));
+	}
+
+	multistep::solver_options mso;
+	mso.order = 2;
+	multistep::multistep_output bdf_sol =
+		multistep::bdf(func, 0.0, 1.0, y0, mso, 1e-3);
+	REQUIRE(bdf_sol.status == SUCCESS);
+	vec_type y1 = bdf_sol.y_vals.back();
+	REQUIRE(y1(0) + y1(1) + y1(2) == Catch::Approx(1.0).epsilon(1e-8));
+}
@@ -0,0 +1,62 @@
+#include <catch2/catch_all.hpp>
+
+#include "../realtime.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Bounded-latency stepping", "[realtime]")
+{
+	test_equations::exponential func(-2.0);
+	vec_type y = { 1.0 };
+	double t = 0.0, dt = 0.01;
+
+	SECTION("Radau IIA converges within the budget") {
+		irk::realtime_options rt_opts;
+		rt_opts.reuse_factorization = true;
+		irk::realtime_stepper<test_equations::exponential> stepper(
+			func, 1, irk::RADAU_IIA_53, rt_opts);
+
+		for (int i = 0; i < 100; ++i) {
+			REQUIRE(stepper.step(t, y, dt) == SUCCESS);
+			const irk::realtime_step_stats &stats = stepper.last_stats();
+			REQUIRE(stats.newton_iters <= rt_opts.max_newton_iters);
+			REQUIRE(!stats.used_fallback);
+		}
+		REQUIRE(t == Catch::Approx(1.0));
+		REQUIRE(y(0) == Catch::Approx(std::exp(-2.0)).epsilon(1e-6));
+	}
+
+	SECTION("Stiff steps succeed within the work bound") {
+		test_equations::vdpol stiff(1e-2);
+		vec_type z = { 2.0, 0.0 };
+		irk::realtime_options rt_opts;
+		rt_opts.reuse_factorization = true;
+		irk::realtime_stepper<test_equations::vdpol> stepper(
+			stiff, 2, irk::RADAU_IIA_53, rt_opts);
+
+		for (int i = 0; i < 1000; ++i) {
+			REQUIRE(stepper.step(t, z, 1e-3) == SUCCESS);
+			const irk::realtime_step_stats &stats = stepper.last_stats();
+			REQUIRE(stats.newton_iters <= rt_opts.max_step_newton_iters());
+			REQUIRE(stats.factorizations
+			        <= rt_opts.max_step_factorizations());
+		}
+		REQUIRE(t == Catch::Approx(1.0));
+		REQUIRE(std::isfinite(z(0)));
+		REQUIRE(std::fabs(z(0)) <= 2.1);
+	}
+
+	SECTION("Falls back to implicit Euler when the budget runs out") {
+		irk::realtime_options rt_opts;
+		rt_opts.max_newton_iters = 1;
+		rt_opts.max_rejections = 0;
+		rt_opts.newton_tol = 1e-300;
+		irk::realtime_stepper<test_equations::exponential> stepper(
+			func, 1, irk::RADAU_IIA_53, rt_opts);
+
+		REQUIRE(stepper.step(t, y, dt) == INTERNAL_SOLVE_FAILURE);
+		REQUIRE(stepper.last_stats().used_fallback);
+		REQUIRE(t == 0.0);
+		REQUIRE(y(0) == 1.0);
+	}
+}
@@ -0,0 +1,79 @@
+#include <catch2/catch_all.hpp>
+
+#include "../erk.hpp"
+
+
+namespace {
+
+/// Van der Pol oscillator for any scalar type.
+template <typename real_type>
+struct vdpol_of
+{
+	typedef arma::Col<real_type> vec_t;
+
+	explicit vdpol_of(real_type mu) : mu(mu) {}
+
+	vec_t fun(double t, const vec_t &y)
+	{
+		vec_t f(2);
+		f(0) = y(1);
+		f(1) = mu*(1 - y(0)*y(0))*y(1) - y(0);
+		return f;
+	}
+
+	real_type mu;
+};
+
+} // namespace
+
+
+TEST_CASE("Single precision explicit RK", "[scalar_type]")
+{
+	output_options output_opts;
+	erk::solver_options so = erk::default_solver_options();
+	so.rel_tol = so.abs_tol = 1e-3;
+	double t1 = 10.0;
+
+	vdpol_of<double> fd(1.0);
+	vdpol_of<float>  ff(1.0f);
+	arma::vec  y0d = { 2.0, 0.0 };
+	arma::fvec y0f = { 2.0f, 0.0f };
+
+	erk::rk_output sd = erk::odeint(fd, 0.0, t1, y0d, so, output_opts);
+	erk::basic_rk_output<float> sf = erk::odeint(ff, 0.0, t1, y0f, so,
+	                                             output_opts);
+
+	REQUIRE(sd.status == SUCCESS);
+	REQUIRE(sf.status == SUCCESS);
+	REQUIRE(sf.t_vals.back() == t1);
+
+	// At this tolerance both runs take practically the same steps:
+	double n_d = sd.t_vals.size(), n_f = sf.t_vals.size();
+	REQUIRE(std::fabs(n_f - n_d) <= 0.05*n_d);
+	for (std::size_t i = 0; i < 2; ++i) {
+		REQUIRE(sf.y_vals.back()(i) ==
+		        Catch::Approx(sd.y_vals.back()(i))
+		        .epsilon(1e-2).margin(1e-2));
+	}
+}
+
+
+TEST_CASE("Tolerance floor follows the scalar type", "[scalar_type]")
+{
+	REQUIRE(min_rel_tol<float>() > 1e-6);
+	REQUIRE(min_rel_tol<double>() < 1e-14);
+	REQUIRE(machine_precision_of<float>() > machine_precision_of<double>());
+
+	// A tolerance float cannot meet is raised instead of grinding to
+	// ever smaller steps:
+	output_options output_opts;
+	erk::solver_options so = erk::default_solver_options();
+	so.rel_tol = 1e-12;
+	so.abs_tol = 1e-6;
+	so.max_steps = 100000;
+	vdpol_of<float> ff(1.0f);
+	arma::fvec y0f = { 2.0f, 0.0f };
+	erk::basic_rk_output<float> sf = erk::odeint(ff, 0.0, 1.0, y0f, so,
+	                                             output_opts);
+	REQUIRE(sf.status == SUCCESS);
+}
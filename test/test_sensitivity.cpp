@@ -0,0 +1,122 @@
+#include <catch2/catch_all.hpp>
+
+#include "../adjoint.hpp"
+#include "../irk.hpp"
+#include "../multistep.hpp"
+#include "test_equations.hpp"
+
+
+// y' = l*y, so dy/dl = t*exp(l*t) and dy/dy0 = exp(l*t).
+struct exponential_dfdp : public test_equations::exponential
+{
+	explicit exponential_dfdp(double l) : exponential(l) {}
+
+	mat_type dfdp(double t, const vec_type &y)
+	{
+		mat_type dfdp(1,1);
+		dfdp(0,0) = y(0);
+		return dfdp;
+	}
+};
+
+
+TEST_CASE("Forward sensitivities", "[sensitivity]")
+{
+	double l = -0.5;
+	exponential_dfdp func(l);
+	vec_type y0 = { 1.0 };
+	double t1 = 2.0;
+
+	REQUIRE(has_dfdp<exponential_dfdp>::value);
+	REQUIRE(!has_dfdp<test_equations::exponential>::value);
+
+	// First column is the sensitivity to y0, second to l:
+	sensitivity_options sens_opts;
+	sens_opts.S0 = { { 1.0, 0.0 } };
+	sens_opts.param_col = 1;
+
+	SECTION("IRK") {
+		output_options output_opts;
+		newton::options n_opts;
+		n_opts.tol = 1e-10;
+		n_opts.dx_delta = 1e-10;
+		auto so = irk::default_solver_options();
+		so.rel_tol = 1e-8;
+		so.abs_tol = 1e-8;
+		so.newton_opts = &n_opts;
+		so.sens_opts = &sens_opts;
+
+		// The Jacobian is constant, so re-using the one of the Newton
+		// solve is as accurate as evaluating it at every stage:
+		for (int variant = 0; variant < 4; ++variant) {
+			sens_opts.error_control   = variant & 1;
+			sens_opts.stage_jacobians = variant & 2;
+			auto sol = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+			REQUIRE(sol.status == SUCCESS);
+			REQUIRE(sol.sens_vals.size() == sol.t_vals.size());
+
+			for (std::size_t i = 0; i < sol.t_vals.size(); ++i) {
+				double t = sol.t_vals[i];
+				const mat_type &S = sol.sens_vals[i];
+				REQUIRE(S(0,0) == Catch::Approx(std::exp(l*t)).epsilon(1e-5));
+				REQUIRE(S(0,1) == Catch::Approx(t*std::exp(l*t))
+				        .epsilon(1e-5).margin(1e-8));
+			}
+		}
+	}
+
+	SECTION("BDF") {
+		multistep::solver_options opts;
+		opts.order = 3;
+		opts.sens_opts = &sens_opts;
+		double dt = 1e-3;
+		auto sol = multistep::bdf(func, 0.0, t1, y0, opts, dt);
+		REQUIRE(sol.status == SUCCESS);
+		REQUIRE(sol.sens_vals.size() == sol.t_vals.size());
+
+		std::size_t N = sol.t_vals.size();
+		double t = sol.t_vals[N-1];
+		const mat_type &S = sol.sens_vals[N-1];
+		REQUIRE(S(0,0) == Catch::Approx(std::exp(l*t)).epsilon(1e-4));
+		REQUIRE(S(0,1) == Catch::Approx(t*std::exp(l*t)).epsilon(1e-4));
+	}
+}
+
+
+// G = y(t1), so dG/dy0 = exp(l*t1) and dG/dl = t1*exp(l*t1).
+struct final_value
+{
+	double value(const vec_type &y) { return y(0); }
+	vec_type grad(const vec_type &y) { return { 1.0 }; }
+};
+
+
+TEST_CASE("Adjoint sensitivities", "[adjoint]")
+{
+	double l = -0.5;
+	exponential_dfdp func(l);
+	vec_type y0 = { 1.0 };
+	double t1 = 2.0;
+	final_value G;
+
+	newton::options n_opts;
+	n_opts.tol = 1e-10;
+	n_opts.dx_delta = 1e-10;
+	auto so = irk::default_solver_options();
+	so.rel_tol = 1e-8;
+	so.abs_tol = 1e-8;
+	so.newton_opts = &n_opts;
+
+	irk::adjoint_options adj_opts;
+	adj_opts.n_params = 1;
+
+	for (std::size_t n_ck : { 1, 4, 16 }) {
+		adj_opts.n_checkpoints = n_ck;
+		auto res = irk::adjoint_gradient(func, 0.0, t1, y0, so, adj_opts, G);
+		REQUIRE(res.status == SUCCESS);
+		REQUIRE(res.objective == Catch::Approx(std::exp(l*t1)).epsilon(1e-6));
+		REQUIRE(res.grad_y0(0) == Catch::Approx(std::exp(l*t1)).epsilon(1e-5));
+		REQUIRE(res.grad_p(0) == Catch::Approx(t1*std::exp(l*t1)).epsilon(1e-5));
+		REQUIRE(res.recomputed_steps == res.forward_steps);
+	}
+}
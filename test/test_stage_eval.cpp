@@ -0,0 +1,81 @@
+#include <catch2/catch_all.hpp>
+
+#include "../erk.hpp"
+#include "../irk.hpp"
+#include "test_equations.hpp"
+
+
+// The van der Pol oscillator, with all stages evaluated in one call.
+struct batched_vdpol : public test_equations::vdpol
+{
+	batched_vdpol() : vdpol(1.0), batches(0), stages(0) {}
+
+	void fun_stages(const vec_type &ts, const mat_type &Ys, mat_type &Fs)
+	{
+		++batches;
+		stages += Ys.n_cols;
+		for (std::size_t i = 0; i < Ys.n_cols; ++i) {
+			Fs(0,i) = Ys(1,i);
+			Fs(1,i) = ((1 - Ys(0,i)*Ys(0,i))*Ys(1,i) - Ys(0,i)) / mu;
+		}
+	}
+
+	std::size_t batches, stages;
+};
+
+
+TEST_CASE("Detect batched stage evaluation", "[stage_eval]")
+{
+	REQUIRE(has_fun_stages<batched_vdpol>::value);
+	REQUIRE(!has_fun_stages<test_equations::vdpol>::value);
+}
+
+
+TEST_CASE("IRK evaluates all stages in one call", "[stage_eval]")
+{
+	batched_vdpol batched;
+	test_equations::vdpol plain(1.0);
+	vec_type y0 = { 2.0, 0.0 };
+	irk::solver_options opts = irk::default_solver_options();
+	newton::options n_opts;
+	opts.newton_opts = &n_opts;
+	output_options output_opts;
+
+	irk::rk_output sol = irk::odeint(batched, 0.0, 5.0, y0, opts,
+	                                 output_opts, irk::RADAU_IIA_53, 1e-3);
+	irk::rk_output ref = irk::odeint(plain, 0.0, 5.0, y0, opts,
+	                                 output_opts, irk::RADAU_IIA_53, 1e-3);
+	REQUIRE(sol.status == SUCCESS);
+	REQUIRE(batched.batches > 0);
+	REQUIRE(batched.stages == 3*batched.batches);
+	REQUIRE(sol.t_vals.size() == ref.t_vals.size());
+	for (std::size_t i = 0; i < 2; ++i) {
+		REQUIRE(sol.y_vals.back()(i) ==
+		        Catch::Approx(ref.y_vals.back()(i)).epsilon(1e-10));
+	}
+}
+
+
+TEST_CASE("Independent explicit stages are grouped", "[stage_eval]")
+{
+	mat_type A(4,4);
+	A.zeros();
+	A(1,0) = 0.5;
+	A(2,0) = 0.5;
+	A(3,1) = 0.5;
+	A(3,2) = 0.5;
+
+	std::vector<std::size_t> groups = erk::independent_stage_groups(A, 0, true);
+	REQUIRE(groups.size() == 4);
+	REQUIRE(groups[0] == 0);
+	REQUIRE(groups[1] == 1);
+	REQUIRE(groups[2] == 3);
+	REQUIRE(groups[3] == 4);
+
+	std::vector<std::size_t> single = erk::independent_stage_groups(A, 1, false);
+	REQUIRE(single.size() == 4);
+	REQUIRE(single[0] == 1);
+	REQUIRE(single[1] == 2);
+	REQUIRE(single[2] == 3);
+	REQUIRE(single[3] == 4);
+}
@@ -0,0 +1,65 @@
+#include <catch2/catch_all.hpp>
+
+#include "../erk.hpp"
+#include "../irk.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Early termination at steady state", "[steady_state]")
+{
+	test_equations::exponential func(-1.0);
+	vec_type y0 = { 1.0 };
+	double t1 = 1e6;
+	output_options output_opts;
+
+	SECTION("IRK") {
+		irk::solver_options so = irk::default_solver_options();
+		newton::options n_opts;
+		n_opts.tol = 0.1*so.rel_tol;
+		so.newton_opts = &n_opts;
+		so.max_dt = 10.0;
+		irk::rk_output full = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+
+		so.steady_state_tol = 1e-3;
+		irk::rk_output sol = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+
+		REQUIRE(full.status == SUCCESS);
+		REQUIRE(sol.status == STEADY_STATE_REACHED);
+		REQUIRE(sol.t_vals.back() == t1);
+		REQUIRE(std::fabs(sol.y_vals.back()(0)) < 1e-5);
+		REQUIRE(sol.t_vals.size() < full.t_vals.size());
+
+		so.steady_state_jump = false;
+		sol = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+		REQUIRE(sol.status == STEADY_STATE_REACHED);
+		REQUIRE(sol.t_vals.back() < t1);
+	}
+
+	SECTION("IRK, not stiffly accurate") {
+		// Needs an extra RHS evaluation for the check:
+		irk::solver_options so = irk::default_solver_options();
+		newton::options n_opts;
+		n_opts.tol = 0.1*so.rel_tol;
+		so.newton_opts = &n_opts;
+		so.max_dt = 10.0;
+		so.steady_state_tol = 1e-3;
+		irk::rk_output sol = irk::odeint(func, 0.0, t1, y0, so, output_opts,
+		                                 irk::GAUSS_LEGENDRE_63);
+
+		REQUIRE(sol.status == STEADY_STATE_REACHED);
+		REQUIRE(sol.t_vals.back() == t1);
+		REQUIRE(std::fabs(sol.y_vals.back()(0)) < 1e-3);
+	}
+
+	SECTION("ERK") {
+		erk::solver_options so;
+		so.max_dt = 1.0;
+		so.steady_state_tol = 1e-3;
+		so.max_steps = 100000;
+		erk::rk_output sol = erk::odeint(func, 0.0, t1, y0, so, output_opts);
+
+		REQUIRE(sol.status == STEADY_STATE_REACHED);
+		REQUIRE(sol.t_vals.back() == t1);
+		REQUIRE(std::fabs(sol.y_vals.back()(0)) < 1e-5);
+	}
+}
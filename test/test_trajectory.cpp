@@ -0,0 +1,145 @@
+#include <catch2/catch_all.hpp>
+
+#include "../irk.hpp"
+#include "test_equations.hpp"
+
+
+TEST_CASE("Chunked trajectory storage", "[trajectory]")
+{
+	trajectory traj(8);
+	for (std::size_t i = 0; i < 100; ++i) {
+		traj.push_back(vec_type{ double(i), -double(i) });
+	}
+	REQUIRE(traj.size() == 100);
+	REQUIRE(traj.n_rows() == 2);
+
+	// 16 columns would not fit, so all chunks are capped at 8.
+	REQUIRE(traj.n_chunks() == 13);
+
+	const double *p0 = traj.colptr(0);
+	for (std::size_t i = 0; i < 100; ++i) {
+		REQUIRE(traj[i](0) == double(i));
+		REQUIRE(traj[i](1) == -double(i));
+	}
+	REQUIRE(traj.back()(0) == 99.0);
+
+	// Growing does not move stored columns:
+	for (std::size_t i = 0; i < 100; ++i) {
+		traj.push_back(vec_type{ 0.0, 0.0 });
+	}
+	REQUIRE(traj.colptr(0) == p0);
+
+	mat_type M = traj.to_mat();
+	REQUIRE(M.n_rows == 2);
+	REQUIRE(M.n_cols == 200);
+	REQUIRE(M(0, 42) == 42.0);
+	REQUIRE(M(1, 99) == -99.0);
+
+	traj.drop_front(10);
+	REQUIRE(traj.size() == 190);
+	REQUIRE(traj[0](0) == 10.0);
+
+	trajectory other = { vec_type{ 1.0, 2.0 }, vec_type{ 3.0, 4.0 } };
+	traj.append(other, 1);
+	REQUIRE(traj.size() == 191);
+	REQUIRE(traj.back()(1) == 4.0);
+
+	// Copies that span several chunks on both sides:
+	trajectory copy(5);
+	copy.append(traj, 3);
+	REQUIRE(copy.size() == 188);
+	for (std::size_t i = 0; i < copy.size(); ++i) {
+		REQUIRE(copy[i](0) == traj[i + 3](0));
+		REQUIRE(copy[i](1) == traj[i + 3](1));
+	}
+
+	std::size_t n = 0;
+	for (const auto &y : traj) {
+		REQUIRE(y(0) == traj[n](0));
+		++n;
+	}
+	REQUIRE(n == traj.size());
+	REQUIRE(std::distance(traj.begin(), traj.end()) == 191);
+}
+
+
+TEST_CASE("Moving trajectories splices their chunks", "[trajectory]")
+{
+	trajectory a(32), b(32);
+	for (std::size_t i = 0; i < 40; ++i) {
+		a.push_back(vec_type{ double(i) });
+		b.push_back(vec_type{ 100.0 + i });
+	}
+	const double *b0 = b.colptr(0);
+	const double *b39 = b.colptr(39);
+	a.append(std::move(b));
+
+	REQUIRE(b.empty());
+	REQUIRE(a.size() == 80);
+	REQUIRE(a.colptr(40) == b0);
+	REQUIRE(a.colptr(79) == b39);
+	for (std::size_t i = 0; i < 80; ++i) {
+		double expect = i < 40 ? double(i) : 60.0 + i;
+		REQUIRE(a[i](0) == expect);
+	}
+
+	// Appending after a splice continues in the last chunk:
+	a.push_back(vec_type{ -1.0 });
+	REQUIRE(a.size() == 81);
+	REQUIRE(a.back()(0) == -1.0);
+	REQUIRE(a.to_mat()(0, 45) == 105.0);
+
+	// A short tail is copied into the free space instead:
+	trajectory c;
+	c.push_back(vec_type{ 7.0 });
+	std::size_t chunks = a.n_chunks();
+	a.append(std::move(c));
+	REQUIRE(a.n_chunks() == chunks);
+	REQUIRE(a.back()(0) == 7.0);
+
+	// Copies get their own chunks:
+	trajectory d(a);
+	REQUIRE(d.size() == a.size());
+	REQUIRE(d.colptr(0) != a.colptr(0));
+	REQUIRE(d[45](0) == 105.0);
+}
+
+
+TEST_CASE("Small chunks are not counted as heap memory", "[trajectory]")
+{
+	// A 1 x 16 chunk fits in the matrix object itself, a 2 x 16 one
+	// does not. The bookkeeping is the same for both:
+	trajectory one, two;
+	for (std::size_t i = 0; i < 16; ++i) {
+		one.push_back(vec_type{ double(i) });
+		two.push_back(vec_type{ double(i), 0.0 });
+	}
+	REQUIRE(one.n_chunks() == 1);
+	REQUIRE(two.n_chunks() == 1);
+	REQUIRE(two.heap_bytes() - one.heap_bytes() == 32*sizeof(double));
+}
+
+
+TEST_CASE("Solver output is stored in chunks", "[trajectory]")
+{
+	test_equations::vdpol func(1.0);
+	irk::solver_options opts = irk::default_solver_options();
+	newton::options n_opts;
+	opts.newton_opts = &n_opts;
+	output_options output_opts;
+	vec_type y0 = { 2.0, 0.0 };
+
+	irk::rk_output sol = irk::odeint(func, 0.0, 10.0, y0, opts,
+	                                 output_opts, irk::RADAU_IIA_53, 1e-3);
+	REQUIRE(sol.status == SUCCESS);
+	std::size_t Nt = sol.t_vals.size();
+	REQUIRE(sol.y_vals.size() == Nt);
+	REQUIRE(sol.stages.size() == Nt);
+	REQUIRE(sol.err_est.size() == Nt);
+
+	mat_type Y = sol.y_vals.to_mat();
+	for (std::size_t i = 0; i < Nt; ++i) {
+		REQUIRE(Y(0, i) == sol.y_vals[i](0));
+		REQUIRE(Y(1, i) == sol.y_vals[i](1));
+	}
+}
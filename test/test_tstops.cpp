@@ -0,0 +1,86 @@
+#include <catch2/catch_all.hpp>
+
+#include "../erk.hpp"
+#include "../irk.hpp"
+
+
+// y' = -y + u(t) with u switching off at t = 1.
+struct switched_forcing
+{
+	typedef mat_type jac_type;
+
+	vec_type fun(double t, const vec_type &y)
+	{
+		double u = t < 1.0 ? 1.0 : 0.0;
+		return { -y(0) + u };
+	}
+
+	jac_type jac(double t, const vec_type &y)
+	{
+		jac_type J(1,1);
+		J(0,0) = -1.0;
+		return J;
+	}
+
+	static double exact(double t)
+	{
+		if (t < 1.0) return 1.0 - std::exp(-t);
+		return (1.0 - std::exp(-1.0))*std::exp(1.0 - t);
+	}
+};
+
+
+template <typename rk_output_type>
+bool lands_on(const rk_output_type &sol, double ts)
+{
+	for (double t : sol.t_vals) {
+		if (t == ts) return true;
+	}
+	return false;
+}
+
+
+TEST_CASE("Integrators land on tstops", "[tstops]")
+{
+	switched_forcing func;
+	vec_type y0 = { 0.0 };
+	double t1 = 4.0;
+	output_options output_opts;
+
+	SECTION("IRK") {
+		irk::solver_options so = irk::default_solver_options();
+		newton::options n_opts;
+		n_opts.tol = 0.1*so.rel_tol;
+		so.newton_opts = &n_opts;
+		irk::rk_output plain = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+
+		so.tstops = { 1.0, 10.0 };
+		irk::rk_output sol = irk::odeint(func, 0.0, t1, y0, so, output_opts);
+
+		REQUIRE(sol.status == SUCCESS);
+		REQUIRE(lands_on(sol, 1.0));
+		REQUIRE(sol.t_vals.back() == t1);
+		REQUIRE(sol.count.reject_err <= plain.count.reject_err);
+		for (std::size_t i = 0; i < sol.t_vals.size(); ++i) {
+			double ye = switched_forcing::exact(sol.t_vals[i]);
+			REQUIRE(sol.y_vals[i](0) == Catch::Approx(ye).margin(1e-3));
+		}
+	}
+
+	SECTION("ERK") {
+		erk::solver_options so;
+		erk::rk_output plain = erk::odeint(func, 0.0, t1, y0, so, output_opts);
+
+		so.tstops = { 1.0 };
+		so.tstop_dt = 1e-3;
+		erk::rk_output sol = erk::odeint(func, 0.0, t1, y0, so, output_opts);
+
+		REQUIRE(sol.status == SUCCESS);
+		REQUIRE(lands_on(sol, 1.0));
+		REQUIRE(sol.count.reject_err <= plain.count.reject_err);
+		for (std::size_t i = 0; i < sol.t_vals.size(); ++i) {
+			double ye = switched_forcing::exact(sol.t_vals[i]);
+			REQUIRE(sol.y_vals[i](0) == Catch::Approx(ye).margin(1e-3));
+		}
+	}
+}
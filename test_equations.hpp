@@ -32,6 +32,9 @@
 
 namespace test_equations {
 
+typedef arma::vec vec_type;
+typedef arma::mat mat_type;
+
 
 // Exponential function:
 struct exponential : public functor
@@ -0,0 +1,391 @@
+/*
+   Rehuel: a simple C++ library for solving ODEs
+
+
+   Copyright 2017-2019, Stefan Paquay (stefanpaquay@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+============================================================================= */
+
+/**
+   \file trajectory.hpp
+
+   \brief Chunked column storage for the states of a solution.
+*/
+
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "alloc_stats.hpp"
+#include "arma_include.hpp"
+
+
+/**
+   \brief Stores a sequence of equally sized vectors column-wise in a few
+   large matrices ("chunks").
+
+   Appending a vector copies it into the last chunk and only allocates
+   when that chunk is full. Chunks are never moved or resized once
+   allocated, so views to stored columns stay valid while the trajectory
+   grows. The first chunks double in size up to chunk_size, so short
+   solutions do not reserve a full chunk.
+
+   Each chunk is held through a pointer. Armadillo keeps small matrices
+   in a buffer inside the matrix object, so moving the object would move
+   the data as well. Splicing the pointers keeps it in place.
+
+   The element access mimics std::vector<arma::vec>: sol.y_vals[i] is a
+   column view that can be used wherever an arma::vec is expected, and
+   range-based for loops visit these views in order.
+
+   \tparam eT  The scalar type of the stored vectors.
+*/
+template <typename eT>
+class basic_trajectory
+{
+public:
+	typedef arma::Mat<eT> chunk_type;
+	typedef arma::Col<eT> value_type;
+
+	/**
+	   \brief Random access iterator that yields column views.
+	*/
+	template <typename traj_type, typename view_type>
+	class basic_iterator
+	{
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef arma::Col<eT> value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef view_type reference;
+		typedef void pointer;
+
+		basic_iterator() : traj(nullptr), i(0) {}
+		basic_iterator(traj_type *traj, std::size_t i) : traj(traj), i(i) {}
+
+		view_type operator*() const { return (*traj)[i]; }
+		view_type operator[](difference_type n) const
+		{
+			return (*traj)[i + n];
+		}
+
+		basic_iterator &operator++() { ++i; return *this; }
+		basic_iterator &operator--() { --i; return *this; }
+		basic_iterator operator++(int) { return basic_iterator(traj, i++); }
+		basic_iterator operator--(int) { return basic_iterator(traj, i--); }
+		basic_iterator &operator+=(difference_type n) { i += n; return *this; }
+		basic_iterator &operator-=(difference_type n) { i -= n; return *this; }
+
+		basic_iterator operator+(difference_type n) const
+		{
+			return basic_iterator(traj, i + n);
+		}
+		basic_iterator operator-(difference_type n) const
+		{
+			return basic_iterator(traj, i - n);
+		}
+		difference_type operator-(const basic_iterator &o) const
+		{
+			return difference_type(i) - difference_type(o.i);
+		}
+
+		bool operator==(const basic_iterator &o) const { return i == o.i; }
+		bool operator!=(const basic_iterator &o) const { return i != o.i; }
+		bool operator<(const basic_iterator &o) const { return i < o.i; }
+		bool operator>(const basic_iterator &o) const { return i > o.i; }
+		bool operator<=(const basic_iterator &o) const { return i <= o.i; }
+		bool operator>=(const basic_iterator &o) const { return i >= o.i; }
+
+	private:
+		traj_type *traj;
+		std::size_t i;
+	};
+
+	typedef basic_iterator<basic_trajectory,
+	                       arma::subview_col<eT> > iterator;
+	typedef basic_iterator<const basic_trajectory,
+	                       const arma::subview_col<eT> > const_iterator;
+
+	/// Default number of columns of a full chunk.
+	static constexpr const std::size_t default_chunk_size = 256;
+
+	/// Number of columns of the first chunk.
+	static constexpr const std::size_t first_chunk_size = 16;
+
+	explicit basic_trajectory( std::size_t chunk_size = default_chunk_size )
+		: n_rows_(0), size_(0),
+		  chunk_size_(std::max<std::size_t>(chunk_size, 1))
+	{ }
+
+	basic_trajectory( std::initializer_list<value_type> ys )
+		: n_rows_(0), size_(0), chunk_size_(default_chunk_size)
+	{
+		for (const value_type &y : ys) push_back(y);
+	}
+
+	/// Copies the vectors of o into freshly allocated chunks.
+	basic_trajectory( const basic_trajectory &o )
+		: n_rows_(0), size_(0), chunk_size_(o.chunk_size_)
+	{
+		append(o);
+	}
+
+	basic_trajectory( basic_trajectory &&o )
+		: n_rows_(0), size_(0), chunk_size_(o.chunk_size_)
+	{
+		swap(o);
+	}
+
+	basic_trajectory &operator=( basic_trajectory o )
+	{
+		swap(o);
+		return *this;
+	}
+
+	/// Number of stored vectors.
+	std::size_t size() const { return size_; }
+
+	/// Is the trajectory empty?
+	bool empty() const { return size_ == 0; }
+
+	/// Length of the stored vectors (0 if empty).
+	std::size_t n_rows() const { return n_rows_; }
+
+	/// Maximum number of columns per chunk.
+	std::size_t chunk_size() const { return chunk_size_; }
+
+	/// Number of allocated chunks.
+	std::size_t n_chunks() const { return chunks_.size(); }
+
+	/**
+	   \brief Appends y as a new column.
+
+	   The first vector fixes the length of all others.
+	*/
+	void push_back( const value_type &y )
+	{
+		if (size_ == 0) n_rows_ = y.n_elem;
+		assert(y.n_elem == n_rows_ && "Vector length does not match!");
+
+		if (chunks_.empty() || used_in_last() == chunks_.back()->n_cols) {
+			add_chunk();
+		}
+		chunks_.back()->col(used_in_last()) = y;
+		++size_;
+	}
+
+	/// Column view of the i-th vector.
+	arma::subview_col<eT> operator[]( std::size_t i )
+	{
+		std::size_t k = find_chunk(i);
+		return chunks_[k]->col(i - first_[k]);
+	}
+
+	/// Column view of the i-th vector.
+	const arma::subview_col<eT> operator[]( std::size_t i ) const
+	{
+		std::size_t k = find_chunk(i);
+		return chunks_[k]->col(i - first_[k]);
+	}
+
+	arma::subview_col<eT> back()
+	{
+		assert(size_ > 0 && "Trajectory is empty!");
+		return chunks_.back()->col(used_in_last() - 1);
+	}
+
+	const arma::subview_col<eT> back() const
+	{
+		assert(size_ > 0 && "Trajectory is empty!");
+		return chunks_.back()->col(used_in_last() - 1);
+	}
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, size_); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, size_); }
+
+	/// Pointer to the elements of the i-th vector.
+	const eT *colptr( std::size_t i ) const
+	{
+		std::size_t k = find_chunk(i);
+		return chunks_[k]->colptr(i - first_[k]);
+	}
+
+	/// Appends the vectors of o, starting at index first. Copies
+	/// whole column ranges between the chunks.
+	void append( const basic_trajectory &o, std::size_t first = 0 )
+	{
+		if (first >= o.size_) return;
+		if (size_ == 0) n_rows_ = o.n_rows_;
+		assert(o.n_rows_ == n_rows_ && "Vector length does not match!");
+
+		std::size_t i = first;
+		while (i < o.size_) {
+			std::size_t k = o.find_chunk(i);
+			std::size_t src = i - o.first_[k];
+			std::size_t n = o.used_in(k) - src;
+
+			if (chunks_.empty() ||
+			    used_in_last() == chunks_.back()->n_cols) {
+				add_chunk();
+			}
+			std::size_t dst = used_in_last();
+			n = std::min<std::size_t>(n, chunks_.back()->n_cols - dst);
+
+			if (n_rows_ > 0) {
+				chunks_.back()->cols(dst, dst + n - 1) =
+					o.chunks_[k]->cols(src, src + n - 1);
+			}
+			size_ += n;
+			i += n;
+		}
+	}
+
+	/**
+	   \brief Moves the vectors of o to the end, leaving o empty.
+
+	   The chunks of o are spliced in as they are, so no vector is
+	   copied unless o fits in the free space of the last chunk.
+	*/
+	void append( basic_trajectory &&o )
+	{
+		if (o.empty()) return;
+		if (empty()) {
+			swap(o);
+			o.clear();
+			return;
+		}
+		assert(o.n_rows_ == n_rows_ && "Vector length does not match!");
+
+		if (o.size_ <= chunks_.back()->n_cols - used_in_last()) {
+			append(o);
+		} else {
+			for (std::size_t k = 0; k < o.chunks_.size(); ++k) {
+				chunks_.push_back(std::move(o.chunks_[k]));
+				first_.push_back(size_ + o.first_[k]);
+			}
+			size_ += o.size_;
+		}
+		o.clear();
+	}
+
+	/// Removes the first n vectors. Linear in size().
+	void drop_front( std::size_t n )
+	{
+		if (n == 0) return;
+		basic_trajectory rest(chunk_size_);
+		rest.append(*this, std::min(n, size_));
+		swap(rest);
+	}
+
+	void clear()
+	{
+		chunks_.clear();
+		first_.clear();
+		size_ = 0;
+		n_rows_ = 0;
+	}
+
+	void swap( basic_trajectory &o )
+	{
+		std::swap(n_rows_, o.n_rows_);
+		std::swap(size_, o.size_);
+		std::swap(chunk_size_, o.chunk_size_);
+		chunks_.swap(o.chunks_);
+		first_.swap(o.first_);
+	}
+
+	/// Copies all vectors into one n_rows() x size() matrix.
+	chunk_type to_mat() const
+	{
+		chunk_type M(n_rows_, size_);
+		if (size_ == 0 || n_rows_ == 0) return M;
+		for (std::size_t k = 0; k < chunks_.size(); ++k) {
+			std::size_t used = used_in(k);
+			M.cols(first_[k], first_[k] + used - 1) =
+				chunks_[k]->cols(0, used - 1);
+		}
+		return M;
+	}
+
+	/// Heap memory held by the chunks and the bookkeeping.
+	std::size_t heap_bytes() const
+	{
+		std::size_t b = first_.capacity()*sizeof(std::size_t)
+			+ chunks_.capacity()*sizeof(chunk_ptr)
+			+ chunks_.size()*sizeof(chunk_type);
+		for (const chunk_ptr &c : chunks_) {
+			if (alloc_tracking::elems_on_heap(*c)) {
+				b += c->n_elem*sizeof(eT);
+			}
+		}
+		return b;
+	}
+
+private:
+	std::size_t used_in( std::size_t k ) const
+	{
+		std::size_t end = k + 1 < first_.size() ? first_[k+1] : size_;
+		return end - first_[k];
+	}
+
+	std::size_t used_in_last() const
+	{
+		return size_ - first_.back();
+	}
+
+	std::size_t find_chunk( std::size_t i ) const
+	{
+		assert(i < size_ && "Index out of bounds!");
+		// Most accesses are near the end or sequential, try the
+		// last chunk first:
+		if (i >= first_.back()) return first_.size() - 1;
+		auto it = std::upper_bound(first_.begin(), first_.end(), i);
+		return (it - first_.begin()) - 1;
+	}
+
+	void add_chunk()
+	{
+		// Double the stored size until the chunks are full size:
+		std::size_t n_cols = first_chunk_size;
+		if (size_ > n_cols) n_cols = size_;
+		if (chunk_size_ < n_cols) n_cols = chunk_size_;
+		chunks_.push_back(chunk_ptr(
+			new chunk_type(n_rows_, n_cols, arma::fill::none)));
+		first_.push_back(size_);
+	}
+
+	std::size_t n_rows_, size_, chunk_size_;
+
+	typedef std::unique_ptr<chunk_type> chunk_ptr;
+
+	std::vector<chunk_ptr> chunks_;   ///< Chunks never move in memory
+	std::vector<std::size_t> first_;  ///< Index of the first column per chunk
+};
+
+
+/// The trajectory type of the double precision solvers.
+typedef basic_trajectory<double> trajectory;
+
+
+#endif // TRAJECTORY_HPP